@@ -0,0 +1,52 @@
+#include "network/CircularBuffer.h"
+#include "System.h"
+#include <algorithm>
+#include <vector>
+
+#define CIRCULAR_BUFFER_TEST_BYTES (16*1024*1024)
+
+// a counting byte stream goes through the buffer in pieces of random sizes,
+// so both ends wrap many times, and each piece is peeked at an offset first.
+bool RunCircularBufferTest(size_t size, bool is_mirrored)
+{
+    CircularBuffer buffer(size, is_mirrored);
+    std::vector<char> data(size);
+    size_t written = 0, read = 0;
+    bool is_intact = true;
+    while (read < CIRCULAR_BUFFER_TEST_BYTES && is_intact) {
+        size_t n = std::min(buffer.GetWritableSpace(), size_t(System::Rand(1, int(size) + 1)));
+        for (size_t i = 0; i < n; ++i) {
+            data[i] = char(written + i);
+        }
+        written += buffer.Write(data.data(), n);
+
+        n = std::min(buffer.GetReadableSpace(), size_t(System::Rand(1, int(size) + 1)));
+        const size_t offset = n / 2;
+        if (buffer.Peek(data.data(), n - offset, offset) != n - offset) {
+            is_intact = false;
+        }
+        for (size_t i = 0; i < n - offset && is_intact; ++i) {
+            is_intact = data[i] == char(read + offset + i);
+        }
+        if (buffer.Read(data.data(), n) != n) {
+            is_intact = false;
+        }
+        for (size_t i = 0; i < n && is_intact; ++i) {
+            is_intact = data[i] == char(read + i);
+        }
+        read += n;
+    }
+    printf("%-10zu %-10s %-10s %s\n", size, is_mirrored ? "yes" : "no",
+        buffer.IsMirrored() ? "yes" : "no", is_intact ? "intact" : "CORRUPT");
+    return is_intact;
+}
+
+void CircularBufferMain(int argc, char **argv)
+{
+    System::Init();
+    printf("%-10s %-10s %-10s\n", "size", "mirror", "mirrored");
+    RunCircularBufferTest(1 << 16, false);
+    RunCircularBufferTest(1 << 16, true);
+    // not a multiple of the page size, so it falls back to a plain buffer.
+    RunCircularBufferTest(1 << 8, true);
+}
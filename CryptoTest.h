@@ -0,0 +1,171 @@
+#include "openssl/CipherStream.h"
+#include "openssl/Crypto.hpp"
+#include "network/Connection.h"
+#include "PipeFixture.h"
+#include <chrono>
+#include <memory>
+
+#define CRYPTO_TEST_HANDSHAKE_COUNT (2000)
+#define CRYPTO_TEST_PIPE_PACKETS (2000)
+
+// runs both ends of a handshake on one thread, the server side is timed apart.
+template <typename NewServer, typename NewClient>
+void RunHandshakeTest(const char *name, NewServer new_server, NewClient new_client, size_t count)
+{
+    typedef std::chrono::steady_clock clock;
+    clock::duration server_time(0);
+    size_t done = 0;
+    auto start_time = clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto t0 = clock::now();
+        std::unique_ptr<aead::Handshake> server(new_server());
+        const std::string hello = server->TakeOutgoing();
+        auto t1 = clock::now();
+        std::unique_ptr<aead::Handshake> client(new_client());
+        client->Feed(hello.data(), hello.size());
+        const std::string reply = client->TakeOutgoing();
+        auto t2 = clock::now();
+        server->Feed(reply.data(), reply.size());
+        auto t3 = clock::now();
+        server_time += (t1 - t0) + (t3 - t2);
+        if (server->IsDone() && client->IsDone()) {
+            ++done;
+        }
+    }
+    auto end_time = clock::now();
+    const double total = std::chrono::duration<double>(end_time - start_time).count();
+    const double server = std::chrono::duration<double>(server_time).count();
+    printf("%-16s %-16.0f %-16.0f %zu/%zu done\n", name, count / total, count / server, done, count);
+}
+
+// a client must refuse the hello of a server whose key it was not given.
+template <typename NewServer, typename NewClient>
+bool IsHandshakeRefused(NewServer new_server, NewClient new_client)
+{
+    std::unique_ptr<aead::Handshake> server(new_server());
+    std::unique_ptr<aead::Handshake> client(new_client());
+    const std::string hello = server->TakeOutgoing();
+    return !client->Feed(hello.data(), hello.size()) && !client->IsDone();
+}
+
+// the cipher pipes of one end share its handshake.
+struct CipherPipeEnd : public PipeEnd {
+    CipherPipeEnd(std::shared_ptr<aead::Handshake> handshake)
+        : PipeEnd(new SendDataCipherPipe(handshake), new RecvDataCipherPipe(handshake))
+    {}
+};
+
+static bool IsCipherPipeRejected(PipeEnd &end, const std::string &data)
+{
+    bool is_rejected = false;
+    TRY_BEGIN {
+        size_t space = 0;
+        char *buffer = end.recv->GetRecvDataBuffer(space);
+        DBGASSERT(space >= data.size());
+        memcpy(buffer, data.data(), data.size());
+        end.recv->IncrementRecvData(data.size());
+    } TRY_END
+    CATCH_BEGIN(const RecvDataException &) {
+        is_rejected = true;
+    } CATCH_END
+    return is_rejected;
+}
+
+// packets of random sizes go both ways through a pair of cipher pipes, then
+// a record with a flipped bit and an oversized handshake must be refused.
+template <typename NewServer, typename NewClient>
+void RunCipherPipeTest(const char *name, NewServer new_server, NewClient new_client, size_t count)
+{
+    CipherPipeEnd server{std::shared_ptr<aead::Handshake>(new_server())};
+    CipherPipeEnd client{std::shared_ptr<aead::Handshake>(new_client())};
+    std::deque<std::string> to_server, to_client;
+    std::string data;
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        data.resize(System::Rand(0, 8192));
+        for (auto &c : data) {
+            c = char(System::Rand(0, 256));
+        }
+        NetPacket pck(1);
+        pck.Append(data.data(), data.size());
+        if (i % 2 == 0) {
+            client.first->GetBuffer().WritePacket(pck);
+            to_server.push_back(data);
+        } else {
+            server.first->GetBuffer().WritePacket(pck);
+            to_client.push_back(data);
+        }
+        while (PumpPipe(server, client) + PumpPipe(client, server) != 0) {
+            continue;
+        }
+        bytes += data.size();
+    }
+
+    const bool is_intact = server.packets == to_server && client.packets == to_client;
+
+    NetPacket pck(1);
+    pck << "tampered";
+    client.first->GetBuffer().WritePacket(pck);
+    size_t size = 0;
+    const char *record = client.send->GetSendDataBuffer(size);
+    std::string tampered(record, size);
+    client.send->RemoveSendData(size);
+    tampered[tampered.size() / 2] ^= 1;
+    const bool is_tag_checked = IsCipherPipeRejected(server, tampered);
+
+    CipherPipeEnd fresh{std::shared_ptr<aead::Handshake>(new_client())};
+    const bool is_handshake_capped = IsCipherPipeRejected(fresh, std::string("\xff\xff", 2));
+
+    printf("%-16s %zu bytes %s, tag %s, handshake cap %s\n", name, bytes,
+        is_intact ? "intact" : "CORRUPT", is_tag_checked ? "checked" : "IGNORED",
+        is_handshake_capped ? "enforced" : "IGNORED");
+}
+
+void CryptoMain(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? atoi(argv[1]) : CRYPTO_TEST_HANDSHAKE_COUNT;
+    RSA *rsa = rsa::generate_key(), *other_rsa = rsa::generate_key();
+    EVP_PKEY *key = x25519::generate_key(), *other_key = x25519::generate_key();
+    const std::string rsa_pubkey = rsa::encode_pubkey(rsa);
+    const std::string other_rsa_pubkey = rsa::encode_pubkey(other_rsa);
+    const std::string ecdh_pubkey = x25519::encode_pubkey(key);
+    const std::string other_ecdh_pubkey = x25519::encode_pubkey(other_key);
+
+    printf("%-16s %-16s %-16s (handshakes/s per core)\n", "exchange", "full", "server");
+    RunHandshakeTest("rsa",
+        [rsa]() { return new aead::RsaHandshake(rsa, aead::AES_128_GCM); },
+        [&rsa_pubkey]() { return new aead::RsaHandshake(rsa_pubkey); }, count);
+    RunHandshakeTest("x25519",
+        [key]() { return new aead::EcdhHandshake(key, aead::AES_128_GCM); },
+        [&ecdh_pubkey]() { return new aead::EcdhHandshake(ecdh_pubkey); }, count);
+
+    const bool is_rsa_pinned =
+        IsHandshakeRefused([rsa]() { return new aead::RsaHandshake(rsa, aead::AES_128_GCM); },
+            []() { return new aead::RsaHandshake(std::string()); }) &&
+        IsHandshakeRefused([rsa]() { return new aead::RsaHandshake(rsa, aead::AES_128_GCM); },
+            [&other_rsa_pubkey]() { return new aead::RsaHandshake(other_rsa_pubkey); });
+    printf("%-16s pin %s\n", "rsa", is_rsa_pinned ? "enforced" : "IGNORED");
+    const bool is_ecdh_pinned =
+        IsHandshakeRefused([key]() { return new aead::EcdhHandshake(key, aead::AES_128_GCM); },
+            []() { return new aead::EcdhHandshake(std::string()); }) &&
+        IsHandshakeRefused([key]() { return new aead::EcdhHandshake(key, aead::AES_128_GCM); },
+            [&other_ecdh_pubkey]() { return new aead::EcdhHandshake(other_ecdh_pubkey); });
+    printf("%-16s pin %s\n", "x25519", is_ecdh_pinned ? "enforced" : "IGNORED");
+
+    System::Init();
+    Connection::InitSendBufferPool();
+    INetPacket::InitNetPacketPool();
+    RunCipherPipeTest("rsa",
+        [rsa]() { return new aead::RsaHandshake(rsa, aead::AES_128_GCM); },
+        [&rsa_pubkey]() { return new aead::RsaHandshake(rsa_pubkey); }, CRYPTO_TEST_PIPE_PACKETS);
+    RunCipherPipeTest("x25519",
+        [key]() { return new aead::EcdhHandshake(key, aead::CHACHA20_POLY1305); },
+        [&ecdh_pubkey]() { return new aead::EcdhHandshake(ecdh_pubkey); }, CRYPTO_TEST_PIPE_PACKETS);
+    Connection::ClearSendBufferPool();
+    INetPacket::ClearNetPacketPool();
+
+    x25519::free_key(other_key);
+    x25519::free_key(key);
+    rsa::free_key(other_rsa);
+    rsa::free_key(rsa);
+}
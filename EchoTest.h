@@ -102,6 +102,7 @@ public:
 class EchoServer : public Thread, public Singleton<EchoServer> {
 public:
     virtual bool Initialize() {
+        start_time_ = System::GetRealSysTime();
         for (int i = 0; i < 5; ++i) {
             ProducerSession::New();
             OS::SleepMS(1);
@@ -117,11 +118,15 @@ public:
             }
         }
         sSessionManager.Update();
-        printf("[%d] --- %d <---> %d\r", sDataManager.trans_pck_count_.load(),
-            sDataManager.send_pck_count_.load(), sDataManager.recv_pck_count_.load());
+        const uint64 elapsed = System::GetRealSysTime() - start_time_;
+        printf("[%d] --- %d <---> %d, %llu pck/s\r", sDataManager.trans_pck_count_.load(),
+            sDataManager.send_pck_count_.load(), sDataManager.recv_pck_count_.load(),
+            elapsed != 0 ? sDataManager.recv_pck_count_.load() * 1000ull / elapsed : 0);
         System::Update();
         OS::SleepMS(1);
     }
+private:
+    uint64 start_time_ = 0;
 };
 
 class EchoServerMaster : public IServerMaster, public Singleton<EchoServerMaster> {
@@ -154,11 +159,16 @@ protected:
     virtual std::string GetConfigFile() { return "config"; }
     virtual size_t GetAsyncServiceCount() { return 0; }
     virtual size_t GetIOServiceCount() { return 3; }
+    virtual bool IsIOServiceUring() { return is_uring_; }
+public:
+    bool is_uring_ = false;
 };
 
 void EchoMain(int argc, char **argv)
 {
     EchoServerMaster::newInstance();
+    // a first argument of "uring" runs the io_uring backend against asio.
+    sEchoServerMaster.is_uring_ = argc > 1 && strcmp(argv[1], "uring") == 0;
     sEchoServerMaster.InitSingleton();
     sEchoServerMaster.Initialize(argc, argv);
     sEchoServerMaster.Run(argc, argv);
@@ -0,0 +1,266 @@
+#include "network/ConnectionManager.h"
+#include "network/IOServiceManager.h"
+#include "network/SessionManager.h"
+#include "network/Listener.h"
+#include "Logger.h"
+#include "System.h"
+#include "OS.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <string.h>
+
+#define NETBENCH_HOST_STRING "127.0.0.1"
+#define NETBENCH_PORT_STRING "9998"
+#define NETBENCH_OPCODE (1)
+
+// every argument is name=list, a run is made for each combination:
+//   sizes=64,1024,16384 connections=1,16,64 pipes=plain,zlib,lz4 workers=1,2
+//   accepts=balance depth=8 seconds=2 warmup=0.5 out=netbench.csv
+// accepts takes balance and reuseport, the listener is started anew for
+// every run.  depth is the packets each connection keeps in flight.  a csv
+// row per run goes to out, the log shares stdout.
+struct NetBenchConfig {
+    size_t size, connections, workers, depth;
+    std::string pipe, accept;
+    double seconds, warmup;
+};
+
+struct NetBenchResult {
+    uint64 packets = 0, bytes = 0;
+    double seconds = 0;
+    std::vector<uint64> latency;
+};
+
+static NetBenchConfig sNetBenchConfig;
+static NetBenchResult sNetBenchResult;
+static std::atomic<size_t> sNetBenchConnected{0};
+static bool sNetBenchRunning = false;
+
+static uint64 NetBenchNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void NetBenchAddDataPipes(Connection &connection, const std::string &pipe)
+{
+    if (pipe == "zlib") {
+        connection.AddDataPipe(new SendDataZlibPipe, new RecvDataZlibPipe);
+    } else if (pipe == "lz4") {
+        connection.AddDataPipe(new SendDataLz4Pipe, new RecvDataLz4Pipe);
+    }
+}
+
+// the payload starts with the send time, the rest compresses moderately.
+class NetBenchClientSession : public Session {
+public:
+    virtual void OnConnected() {
+        sNetBenchConnected.fetch_add(1);
+    }
+    virtual int HandlePacket(INetPacket *pck) {
+        const uint64 now = NetBenchNow();
+        sNetBenchResult.latency.push_back(now - pck->Read<uint64>());
+        sNetBenchResult.packets += 1;
+        sNetBenchResult.bytes += sNetBenchConfig.size;
+        if (sNetBenchRunning) {
+            SendPacket();
+        }
+        return SessionHandleSuccess;
+    }
+    void SendPacket() {
+        static std::string padding;
+        if (padding.size() < sNetBenchConfig.size) {
+            padding.resize(sNetBenchConfig.size);
+            for (size_t i = 0; i < padding.size(); ++i) {
+                padding[i] = 'a' + System::Rand(0, 16);
+            }
+        }
+        NetPacket pck(NETBENCH_OPCODE);
+        pck << NetBenchNow();
+        pck.Append(padding.data(), sNetBenchConfig.size - sizeof(uint64));
+        PushSendPacket(pck);
+    }
+    static NetBenchClientSession *New() {
+        NetBenchClientSession *session = new NetBenchClientSession;
+        session->SetConnection(sConnectionManager.NewConnection(*session));
+        NetBenchAddDataPipes(*session->GetConnection(), sNetBenchConfig.pipe);
+        session->GetConnection()->AsyncConnect(NETBENCH_HOST_STRING, NETBENCH_PORT_STRING);
+        sSessionManager.AddSession(session);
+        return session;
+    }
+};
+
+class NetBenchEchoSession : public Session {
+public:
+    virtual int HandlePacket(INetPacket *pck) {
+        PushSendPacket(*pck);
+        return SessionHandleSuccess;
+    }
+};
+
+class NetBenchListener : public Listener {
+public:
+    virtual std::string GetBindAddress() { return NETBENCH_HOST_STRING; }
+    virtual std::string GetBindPort() { return NETBENCH_PORT_STRING; }
+    virtual AcceptMode GetAcceptMode() {
+        return sNetBenchConfig.accept == "reuseport" ? AcceptReusePort : AcceptLoadBalance;
+    }
+    virtual Session *NewSessionObject() { return new NetBenchEchoSession(); }
+    virtual void AddDataPipes(Session *session) {
+        NetBenchAddDataPipes(*session->GetConnection(), sNetBenchConfig.pipe);
+    }
+};
+
+static void NetBenchPump(double seconds)
+{
+    const uint64 deadline = NetBenchNow() + uint64(seconds * 1e9);
+    while (NetBenchNow() < deadline) {
+        System::Update();
+        sSessionManager.Update();
+    }
+}
+
+static uint64 NetBenchPercentile(const std::vector<uint64> &latency, double rank)
+{
+    return !latency.empty() ? latency[std::min(size_t(latency.size() * rank), latency.size() - 1)] : 0;
+}
+
+// the sessions of both ends are updated by this thread, the io workers
+// carry the sockets and the pipes.
+static bool RunNetBench(const NetBenchConfig &config, FILE *out)
+{
+    sNetBenchConfig = config;
+    sNetBenchConfig.size = std::max(config.size, sizeof(uint64));
+    sNetBenchResult = NetBenchResult();
+    sNetBenchConnected = 0;
+
+    sIOServiceManager.SetWorkerCount(config.workers);
+    if (!sIOServiceManager.Start()) {
+        printf("start io workers failed.\n");
+        return false;
+    }
+    NetBenchListener listener;
+    listener.Start();
+    OS::SleepMS(10);
+
+    std::vector<NetBenchClientSession*> clients;
+    for (size_t i = 0; i < config.connections; ++i) {
+        clients.push_back(NetBenchClientSession::New());
+    }
+    const uint64 connect_deadline = NetBenchNow() + 5000000000ull;
+    while (sNetBenchConnected < config.connections && NetBenchNow() < connect_deadline) {
+        NetBenchPump(0.001);
+    }
+
+    const bool is_connected = sNetBenchConnected == config.connections;
+    if (is_connected) {
+        sNetBenchRunning = true;
+        for (auto client : clients) {
+            for (size_t i = 0; i < config.depth; ++i) {
+                client->SendPacket();
+            }
+        }
+        NetBenchPump(config.warmup);
+        sNetBenchResult = NetBenchResult();
+        const uint64 start = NetBenchNow();
+        NetBenchPump(config.seconds);
+        sNetBenchResult.seconds = (NetBenchNow() - start) / 1e9;
+        sNetBenchRunning = false;
+    } else {
+        printf("%zu of %zu connections made.\n", sNetBenchConnected.load(), config.connections);
+    }
+
+    NetBenchResult result;
+    std::swap(result, sNetBenchResult);
+    sSessionManager.Stop();
+    listener.Stop();
+    sIOServiceManager.Stop();
+    if (!is_connected) {
+        return false;
+    }
+
+    std::sort(result.latency.begin(), result.latency.end());
+    fprintf(out, "%zu,%zu,%s,%zu,%s,%zu,%.3f,%llu,%.0f,%.2f,%.1f,%.1f,%.1f\n",
+        sNetBenchConfig.size, config.connections, config.pipe.c_str(), config.workers,
+        config.accept.c_str(), config.depth, result.seconds, result.packets, result.packets / result.seconds,
+        result.bytes / result.seconds / (1024 * 1024),
+        NetBenchPercentile(result.latency, 0.5) / 1e3,
+        NetBenchPercentile(result.latency, 0.99) / 1e3,
+        NetBenchPercentile(result.latency, 0.999) / 1e3);
+    fflush(out);
+    return true;
+}
+
+static std::vector<std::string> NetBenchSplit(const std::string &text)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(text);
+    for (std::string item; std::getline(stream, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+void NetBenchMain(int argc, char **argv)
+{
+    std::map<std::string, std::string> args = {
+        {"sizes", "64,1024,16384"}, {"connections", "1,16,64"},
+        {"pipes", "plain,zlib,lz4"}, {"workers", "1,2"}, {"accepts", "balance"},
+        {"depth", "8"}, {"seconds", "2"}, {"warmup", "0.5"}, {"out", "netbench.csv"},
+    };
+    for (int i = 1; i < argc; ++i) {
+        const char *value = strchr(argv[i], '=');
+        if (value != nullptr) {
+            args[std::string(argv[i], value - argv[i])] = value + 1;
+        }
+    }
+
+    System::Init();
+    System::Update();
+    Connection::InitSendBufferPool();
+    INetPacket::InitNetPacketPool();
+    Logger::newInstance();
+    IOServiceManager::newInstance();
+    SessionManager::newInstance();
+    ConnectionManager::newInstance();
+
+    FILE *out = fopen(args["out"].c_str(), "w");
+    if (out != nullptr) {
+        fprintf(out, "size,connections,pipe,workers,accept,depth,seconds,packets,"
+                     "packets_per_sec,mb_per_sec,p50_us,p99_us,p999_us\n");
+        NetBenchConfig config;
+        config.depth = std::stoul(args["depth"]);
+        config.seconds = std::stod(args["seconds"]);
+        config.warmup = std::stod(args["warmup"]);
+        for (auto &workers : NetBenchSplit(args["workers"])) {
+            for (auto &accept : NetBenchSplit(args["accepts"])) {
+                for (auto &pipe : NetBenchSplit(args["pipes"])) {
+                    for (auto &connections : NetBenchSplit(args["connections"])) {
+                        for (auto &size : NetBenchSplit(args["sizes"])) {
+                            config.workers = std::stoul(workers);
+                            config.accept = accept;
+                            config.pipe = pipe;
+                            config.connections = std::stoul(connections);
+                            config.size = std::stoul(size);
+                            RunNetBench(config, out);
+                        }
+                    }
+                }
+            }
+        }
+        fclose(out);
+    } else {
+        printf("open %s failed.\n", args["out"].c_str());
+    }
+
+    ConnectionManager::deleteInstance();
+    SessionManager::deleteInstance();
+    IOServiceManager::deleteInstance();
+    Logger::deleteInstance();
+    Connection::ClearSendBufferPool();
+    INetPacket::ClearNetPacketPool();
+}
@@ -0,0 +1,102 @@
+#include "network/OpcodeDispatcher.h"
+#include "System.h"
+#include <string>
+
+#define DISPATCHER_TEST_DENSE_FIRST (100)
+#define DISPATCHER_TEST_DENSE_COUNT (16)
+
+class DispatcherSession : public Session {
+public:
+    virtual int HandlePacket(INetPacket *pck) {
+        return dispatcher_.Dispatch(this, pck);
+    }
+
+    int HandleRaw(INetPacket *pck) {
+        last_ = "raw:" + pck->CastReadableString();
+        return SessionHandleSuccess;
+    }
+    int HandleMove(float x, float y, const std::string &map) {
+        last_ = "move:" + std::to_string(int(x)) + "," + std::to_string(int(y)) + "," + map;
+        return SessionHandleSuccess;
+    }
+    int HandleKick(uint32 reason) {
+        last_ = "kick:" + std::to_string(reason);
+        return SessionHandleKill;
+    }
+
+    static OpcodeDispatcher<DispatcherSession> dispatcher_;
+    std::string last_;
+};
+
+OpcodeDispatcher<DispatcherSession> DispatcherSession::dispatcher_(
+    DISPATCHER_TEST_DENSE_FIRST, DISPATCHER_TEST_DENSE_COUNT);
+
+static bool IsDispatched(DispatcherSession &session, INetPacket &pck, int status, const std::string &last)
+{
+    session.last_.clear();
+    return session.HandlePacket(&pck) == status && session.last_ == last;
+}
+
+static bool IsDispatchThrown(DispatcherSession &session, INetPacket &pck)
+{
+    bool is_thrown = false;
+    TRY_BEGIN {
+        session.HandlePacket(&pck);
+    } TRY_END
+    CATCH_BEGIN(const NetStreamException &) {
+        is_thrown = true;
+    } CATCH_END
+    return is_thrown;
+}
+
+static bool IsRegisterThrown(uint32 opcode)
+{
+    bool is_thrown = false;
+    TRY_BEGIN {
+        DispatcherSession::dispatcher_.Register(opcode, &DispatcherSession::HandleRaw, "again");
+    } TRY_END
+    CATCH_BEGIN(const InternalException &) {
+        is_thrown = true;
+    } CATCH_END
+    return is_thrown;
+}
+
+// raw and typed handlers inside and outside the dense range, unknown
+// opcodes, short packets and a second registration of an opcode.
+void OpcodeDispatcherMain(int argc, char **argv)
+{
+    System::Init();
+    auto &dispatcher = DispatcherSession::dispatcher_;
+    dispatcher.Register(DISPATCHER_TEST_DENSE_FIRST, &DispatcherSession::HandleRaw, "raw");
+    dispatcher.Register(DISPATCHER_TEST_DENSE_FIRST + 1, &DispatcherSession::HandleMove, "move");
+    dispatcher.Register(50000, &DispatcherSession::HandleKick, "kick");
+    size_t timed = 0;
+    dispatcher.SetTimingHook([&timed](uint32 opcode, const char *name, uint64 time_ns) {
+        ++timed;
+    });
+
+    DispatcherSession session;
+    NetPacket raw(DISPATCHER_TEST_DENSE_FIRST);
+    raw.Append("hello", 5);
+    NetPacket move(DISPATCHER_TEST_DENSE_FIRST + 1);
+    move << 3.0f << 4.0f << std::string("town");
+    NetPacket kick(50000);
+    kick << uint32(7);
+    NetPacket unknown(DISPATCHER_TEST_DENSE_FIRST + 2), sparse_unknown(60000);
+    NetPacket short_move(DISPATCHER_TEST_DENSE_FIRST + 1);
+    short_move << 3.0f;
+
+    const bool is_dispatched =
+        IsDispatched(session, raw, SessionHandleSuccess, "raw:hello") &&
+        IsDispatched(session, move, SessionHandleSuccess, "move:3,4,town") &&
+        IsDispatched(session, kick, SessionHandleKill, "kick:7") &&
+        IsDispatched(session, unknown, SessionHandleUnhandle, "") &&
+        IsDispatched(session, sparse_unknown, SessionHandleUnhandle, "");
+    const bool is_short_thrown = IsDispatchThrown(session, short_move);
+    const bool is_duplicate_thrown =
+        IsRegisterThrown(DISPATCHER_TEST_DENSE_FIRST) && IsRegisterThrown(50000);
+
+    printf("dispatch %s, timed %zu/3, short packet %s, duplicate %s\n",
+        is_dispatched ? "ok" : "WRONG", timed,
+        is_short_thrown ? "thrown" : "IGNORED", is_duplicate_thrown ? "thrown" : "IGNORED");
+}
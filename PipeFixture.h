@@ -0,0 +1,48 @@
+#pragma once
+
+#include "network/IODataPipe.h"
+#include "System.h"
+#include <algorithm>
+#include <deque>
+#include <string>
+
+// one end of a connection, the send chain and the recv chain of its pipes.
+struct PipeEnd {
+    bool active = true;
+    SendDataFirstPipe *first;
+    ISendDataPipe *send;
+    IRecvDataPipe *recv;
+    std::deque<std::string> packets;
+    PipeEnd(ISendDataPipe *send_pipe, IRecvDataPipe *recv_pipe) {
+        first = new SendDataFirstPipe(active);
+        send = send_pipe;
+        send->Init(first);
+        recv = recv_pipe;
+        recv->Init(new RecvDataLastPipe([this](INetPacket *pck) {
+            packets.push_back(pck->CastReadableString());
+            delete pck;
+        }, active));
+    }
+    ~PipeEnd() { delete send; delete recv; }
+};
+
+// moves what from has to send into to in pieces of random sizes, so the
+// data lands across the end of the rings.  from and to may be one end.
+static size_t PumpPipe(PipeEnd &from, PipeEnd &to)
+{
+    size_t total = 0;
+    while (true) {
+        size_t size = 0, space = 0;
+        const char *data = from.send->GetSendDataBuffer(size);
+        char *buffer = to.recv->GetRecvDataBuffer(space);
+        size = std::min({size, space, size_t(System::Rand(1, 3000))});
+        if (size == 0) {
+            break;
+        }
+        memcpy(buffer, data, size);
+        from.send->RemoveSendData(size);
+        to.recv->IncrementRecvData(size);
+        total += size;
+    }
+    return total;
+}
@@ -0,0 +1,54 @@
+#include "network/Connection.h"
+#include "PipeFixture.h"
+
+#define PIPE_TEST_PACKETS (2000)
+
+// packets of 1KB and up fill the output of the codec, every one of them
+// must come out once its bytes are in, not when the next one arrives.
+void RunCompressPipeTest(const char *name, ISendDataPipe *send, IRecvDataPipe *recv, size_t count)
+{
+    PipeEnd ends(send, recv);
+    std::deque<std::string> sent;
+    std::string data;
+    size_t stalls = 0;
+    for (size_t i = 0; i < count; ++i) {
+        data.resize(System::Rand(1024, 32768));
+        for (size_t j = 0; j < data.size(); ++j) {
+            data[j] = j % 64 < 48 ? char('a' + j % 13) : char(System::Rand(0, 256));
+        }
+        NetPacket pck(1);
+        pck.Append(data.data(), data.size());
+        ends.first->GetBuffer().WritePacket(pck);
+        sent.push_back(data);
+        PumpPipe(ends, ends);
+        if (ends.packets.size() != sent.size()) {
+            ++stalls;
+        }
+    }
+    printf("%-16s %zu/%zu packets, %zu stalls, %s\n", name, ends.packets.size(),
+        sent.size(), stalls, ends.packets == sent ? "intact" : "CORRUPT");
+}
+
+void PipeMain(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? atoi(argv[1]) : PIPE_TEST_PACKETS;
+    System::Init();
+    Connection::InitSendBufferPool();
+    INetPacket::InitNetPacketPool();
+    RunCompressPipeTest("zlib", new SendDataZlibPipe, new RecvDataZlibPipe, count);
+    RunCompressPipeTest("lz4", new SendDataLz4Pipe, new RecvDataLz4Pipe, count);
+    RunCompressPipeTest("zlib-adaptive",
+        new SendDataZlibPipe(true), new RecvDataZlibPipe(true), count);
+    RunCompressPipeTest("lz4-adaptive",
+        new SendDataLz4Pipe(true), new RecvDataLz4Pipe(true), count);
+    // primed with the repeating part of the packets, both ends share it.
+    std::string sample(16*1024, '\0');
+    for (size_t i = 0; i < sample.size(); ++i) {
+        sample[i] = char('a' + i % 13);
+    }
+    auto dict = std::make_shared<const lz4::Dictionary>(sample.data(), sample.size());
+    RunCompressPipeTest("lz4-dict",
+        new SendDataLz4Pipe(false, dict), new RecvDataLz4Pipe(false, dict), count);
+    Connection::ClearSendBufferPool();
+    INetPacket::ClearNetPacketPool();
+}
@@ -0,0 +1,54 @@
+#include "MultiBufferQueue.h"
+#include "LockFreeBufferQueue.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define QUEUE_TEST_TOTAL_COUNT (4*1024*1024)
+
+template <typename Queue>
+double RunQueueTest(size_t producers)
+{
+    Queue queue;
+    std::atomic<bool> is_start{false};
+    std::vector<std::thread> threads;
+    const size_t count = QUEUE_TEST_TOTAL_COUNT / producers;
+    for (size_t i = 0; i < producers; ++i) {
+        threads.emplace_back([&queue, &is_start, count]() {
+            while (!is_start.load()) {
+                std::this_thread::yield();
+            }
+            for (size_t n = 1; n <= count; ++n) {
+                queue.Enqueue(n);
+            }
+        });
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    is_start.store(true);
+    size_t value = 0, total = 0;
+    for (size_t n = count * producers; n != 0;) {
+        if (queue.Dequeue(value)) {
+            total += value, --n;
+        }
+    }
+    auto end_time = std::chrono::steady_clock::now();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    DBGASSERT(total == producers * (count * (count + 1) / 2));
+    return std::chrono::duration<double>(end_time - start_time).count();
+}
+
+void QueueMain(int argc, char **argv)
+{
+    printf("%-10s %-16s %-16s\n", "producers", "MultiBuffer", "LockFreeBuffer");
+    for (size_t producers = 1; producers <= 32; producers <<= 1) {
+        const size_t total = QUEUE_TEST_TOTAL_COUNT / producers * producers;
+        double locked = RunQueueTest<MultiBufferQueue<size_t>>(producers);
+        double lockfree = RunQueueTest<LockFreeBufferQueue<size_t>>(producers);
+        printf("%-10zu %-16.2f %-16.2f (Mops/s)\n", producers,
+            total / locked / 1e6, total / lockfree / 1e6);
+    }
+}
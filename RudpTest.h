@@ -0,0 +1,97 @@
+#include "network/ReliableUdp.h"
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string.h>
+
+#define RUDP_TEST_SECONDS (60)
+#define RUDP_TEST_MESSAGE_SIZE (64)
+#define RUDP_TEST_MESSAGE_INTERVAL (20)
+
+// a one way link with loss and delay, datagrams may overtake each other.
+class RudpTestLink
+{
+public:
+    RudpTestLink(std::mt19937 &random, double loss, uint32 delay, uint32 jitter)
+        : random_(random), loss_(loss), delay_(delay), jitter_(jitter) {}
+
+    void Send(const char *data, size_t size, uint32 now) {
+        if (std::uniform_real_distribution<double>(0, 1)(random_) < loss_) {
+            return;
+        }
+        const uint32 jitter = jitter_ != 0 ? random_() % jitter_ : 0;
+        queue_.emplace(now + delay_ + jitter, std::string(data, size));
+    }
+    template <typename Receiver>
+    void Deliver(uint32 now, Receiver deliver) {
+        while (!queue_.empty() && queue_.begin()->first <= now) {
+            deliver(queue_.begin()->second);
+            queue_.erase(queue_.begin());
+        }
+    }
+
+private:
+    std::mt19937 &random_;
+    const double loss_;
+    const uint32 delay_, jitter_;
+    std::multimap<uint32, std::string> queue_;
+};
+
+// small timestamped messages one way, the other way only carries acks.
+void RunRudpTest(const char *name, double loss, std::function<void(ReliableUdp&)> config)
+{
+    std::mt19937 random(1);
+    RudpTestLink uplink(random, loss, 30, 20), downlink(random, loss, 30, 20);
+    uint32 now = 0;
+    ReliableUdp client(1, [&](const char *data, size_t size) { uplink.Send(data, size, now); });
+    ReliableUdp server(1, [&](const char *data, size_t size) { downlink.Send(data, size, now); });
+    config(client), config(server);
+
+    std::vector<uint32> latency;
+    char message[RUDP_TEST_MESSAGE_SIZE] = {};
+    std::string stream;
+    for (now = 0; now < RUDP_TEST_SECONDS * 1000; ++now) {
+        if (now % RUDP_TEST_MESSAGE_INTERVAL == 0) {
+            memcpy(message, &now, sizeof(now));
+            client.Send(message, sizeof(message));
+            client.Flush(now);
+        }
+        uplink.Deliver(now, [&](const std::string &data) { server.Input(data.data(), data.size(), now); });
+        downlink.Deliver(now, [&](const std::string &data) { client.Input(data.data(), data.size(), now); });
+        char buffer[4096];
+        while (size_t n = server.Recv(buffer, sizeof(buffer))) {
+            stream.append(buffer, n);
+        }
+        for (; stream.size() >= RUDP_TEST_MESSAGE_SIZE; stream.erase(0, RUDP_TEST_MESSAGE_SIZE)) {
+            uint32 sent = 0;
+            memcpy(&sent, stream.data(), sizeof(sent));
+            latency.push_back(now - sent);
+        }
+        client.Update(now);
+        server.Update(now);
+    }
+
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&latency](double p) {
+        return latency.empty() ? 0 : latency[size_t(p * (latency.size() - 1))];
+    };
+    const ReliableUdp::Stats &stats = client.GetStats();
+    printf("%-8s %-6.0f %-8zu %-6u %-6u %-6u %-6u %-10llu %-10llu\n",
+        name, loss * 100, latency.size(), percentile(0.5), percentile(0.99),
+        percentile(0.999), latency.empty() ? 0 : latency.back(),
+        stats.retransmits, stats.fast_retransmits);
+}
+
+void RudpMain(int argc, char **argv)
+{
+    printf("%-8s %-6s %-8s %-6s %-6s %-6s %-6s %-10s %-10s (latency ms, 30ms+0-20ms one way)\n",
+        "mode", "loss%", "messages", "p50", "p99", "p99.9", "max", "rto", "fast");
+    for (double loss : {0.0, 0.02, 0.05, 0.1, 0.2}) {
+        RunRudpTest("default", loss, [](ReliableUdp &rudp) {
+            rudp.SetNoDelay(false, 40, 0, false);
+        });
+        RunRudpTest("fast", loss, [](ReliableUdp &rudp) {
+            rudp.SetNoDelay(true, 10, 2, true);
+        });
+    }
+}
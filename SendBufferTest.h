@@ -0,0 +1,99 @@
+#include "network/SendBuffer.h"
+#include "System.h"
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SEND_BUFFER_TEST_PRODUCERS (4)
+#define SEND_BUFFER_TEST_PACKETS (20000)
+
+// small chunks, so shared packets often close one that is being drained.
+typedef TSendBuffer<4096> TestSendBuffer;
+
+static void FillSendBufferPayload(std::string &data, size_t producer, uint32 seq)
+{
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = char(producer * 31 + seq * 7 + i);
+    }
+}
+
+// producers mix shared and copied packets, while the consumer drains the
+// buffer, every producer's packets must come out whole and in order.
+bool RunSendBufferTest(size_t producers, size_t count)
+{
+    TestSendBuffer buffer;
+    std::atomic<size_t> running{producers};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < producers; ++i) {
+        threads.emplace_back([&buffer, &running, i, count]() {
+            std::minstd_rand engine(uint32(i) + 1);
+            std::string data;
+            for (uint32 seq = 0; seq < count; ++seq) {
+                data.resize(std::uniform_int_distribution<size_t>(0, 3000)(engine));
+                FillSendBufferPayload(data, i, seq);
+                NetPacket pck((uint32)i);
+                pck << seq;
+                pck.Append(data.data(), data.size());
+                if (engine() % 2 == 0) {
+                    SharedNetPacket *shared = SharedNetPacket::Create(pck);
+                    buffer.WritePacket(*shared);
+                    shared->Release();
+                } else {
+                    buffer.WritePacket(pck);
+                }
+            }
+            running.fetch_sub(1);
+        });
+    }
+
+    std::string stream;
+    SendDataSpan spans[MAX_SEND_DATA_SPANS];
+    while (running.load() != 0 || buffer.HasDataAwaiting()) {
+        size_t n = buffer.GetSendDataBuffers(spans, MAX_SEND_DATA_SPANS);
+        size_t size = 0;
+        for (size_t i = 0; i < n; ++i) {
+            stream.append(spans[i].data, spans[i].size);
+            size += spans[i].size;
+        }
+        if (size != 0) {
+            buffer.RemoveSendData(size);
+        }
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<uint32> seqs(producers, 0);
+    std::string data, expect;
+    ConstNetPacket reader(stream.data(), stream.size());
+    bool is_intact = true;
+    while (!reader.IsReadableEmpty() && is_intact) {
+        NetPacket pck;
+        reader.ReadPacket(pck);
+        uint32 seq = 0;
+        pck >> seq;
+        data.assign(pck.GetReadableBuffer(), pck.GetReadableSize());
+        expect.resize(data.size());
+        FillSendBufferPayload(expect, pck.GetOpcode(), seq);
+        is_intact = pck.GetOpcode() < producers &&
+            seqs[pck.GetOpcode()]++ == seq && data == expect;
+    }
+    for (size_t i = 0; i < producers; ++i) {
+        is_intact = is_intact && seqs[i] == count;
+    }
+    return is_intact;
+}
+
+void SendBufferMain(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? atoi(argv[1]) : SEND_BUFFER_TEST_PACKETS;
+    System::Init();
+    INetPacket::InitNetPacketPool();
+    for (size_t producers = 1; producers <= SEND_BUFFER_TEST_PRODUCERS; ++producers) {
+        bool is_intact = RunSendBufferTest(producers, count);
+        printf("send buffer %zu producers, %s\n", producers, is_intact ? "intact" : "CORRUPT");
+    }
+    TestSendBuffer::ClearBufferPool();
+    INetPacket::ClearNetPacketPool();
+}
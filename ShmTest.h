@@ -0,0 +1,122 @@
+#include "network/ShmChannel.h"
+#include <algorithm>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHM_TEST_MESSAGES (20000000)
+#define SHM_TEST_ROUND_TRIPS (200000)
+#define SHM_TEST_MESSAGE_SIZE (32)
+
+static uint64 ShmTestNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// spins, or parks on the eventfd through the io service when parking.
+static void ShmTestRead(ShmChannel &shm, boost::asio::io_service &io_service,
+                        char *data, size_t size, bool parking)
+{
+    for (size_t offset = 0; offset < size;) {
+        const size_t bytes = shm.Read(data + offset, size - offset);
+        offset += bytes;
+        if (bytes == 0 && parking && shm.ParkReader()) {
+            shm.AsyncWaitReadable([](const boost::system::error_code&) {});
+            io_service.reset();
+            io_service.run_one();
+        }
+    }
+}
+
+static void ShmTestWrite(ShmChannel &shm, const char *data, size_t size)
+{
+    for (size_t offset = 0; offset < size;) {
+        offset += shm.Write(data + offset, size - offset);
+    }
+}
+
+// the child echoes round trips back, then sinks the stream.
+static void RunShmTestPeer(int sockfd)
+{
+    boost::asio::io_service io_service;
+    ShmChannel shm(io_service);
+    boost::system::error_code ec;
+    shm.Attach(sockfd, ec);
+    if (ec) {
+        printf("attach, %s.\n", ec.message().c_str());
+        return;
+    }
+
+    char message[SHM_TEST_MESSAGE_SIZE] = {};
+    for (bool parking : {false, true}) {
+        for (int i = 0; i < SHM_TEST_ROUND_TRIPS; ++i) {
+            ShmTestRead(shm, io_service, message, sizeof(message), parking);
+            ShmTestWrite(shm, message, sizeof(message));
+        }
+    }
+    char buffer[65536];
+    for (uint64 total = 0; total < uint64(SHM_TEST_MESSAGES) * SHM_TEST_MESSAGE_SIZE;) {
+        total += shm.Read(buffer, sizeof(buffer));
+    }
+    ShmTestWrite(shm, message, sizeof(message));
+}
+
+static void RunShmTestLatency(ShmChannel &shm, boost::asio::io_service &io_service, bool parking)
+{
+    std::vector<uint64> latency;
+    latency.reserve(SHM_TEST_ROUND_TRIPS);
+    char message[SHM_TEST_MESSAGE_SIZE] = {};
+    for (int i = 0; i < SHM_TEST_ROUND_TRIPS; ++i) {
+        const uint64 start = ShmTestNow();
+        ShmTestWrite(shm, message, sizeof(message));
+        ShmTestRead(shm, io_service, message, sizeof(message), parking);
+        latency.push_back(ShmTestNow() - start);
+    }
+    std::sort(latency.begin(), latency.end());
+    printf("%-8s round trip ns p50 %llu p99 %llu p99.9 %llu\n", parking ? "parked" : "spinning",
+        latency[latency.size() / 2], latency[latency.size() * 99 / 100],
+        latency[latency.size() * 999 / 1000]);
+}
+
+void ShmMain(int argc, char **argv)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        printf("socketpair(), errno: %d.\n", errno);
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        RunShmTestPeer(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+
+    boost::asio::io_service io_service;
+    ShmChannel shm(io_service);
+    boost::system::error_code ec;
+    shm.Create(fds[0], ec);
+    if (ec) {
+        printf("create, %s.\n", ec.message().c_str());
+        return;
+    }
+
+    RunShmTestLatency(shm, io_service, false);
+    RunShmTestLatency(shm, io_service, true);
+
+    char message[SHM_TEST_MESSAGE_SIZE] = {};
+    const uint64 start = ShmTestNow();
+    for (int i = 0; i < SHM_TEST_MESSAGES; ++i) {
+        ShmTestWrite(shm, message, sizeof(message));
+    }
+    ShmTestRead(shm, io_service, message, sizeof(message), false);
+    const double seconds = (ShmTestNow() - start) / 1e9;
+    printf("%d messages of %d bytes in %.2fs, %.1fM messages/s\n", SHM_TEST_MESSAGES,
+        SHM_TEST_MESSAGE_SIZE, seconds, SHM_TEST_MESSAGES / seconds / 1e6);
+
+    waitpid(pid, nullptr, 0);
+    close(fds[0]);
+}
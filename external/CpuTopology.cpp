@@ -0,0 +1,113 @@
+#include "CpuTopology.h"
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <set>
+#include <thread>
+
+const std::vector<CpuTopology::Cpu> &CpuTopology::GetCpus()
+{
+    static const std::vector<Cpu> cpus = []() {
+        std::vector<Cpu> cpus = LoadFromSys();
+        if (cpus.empty()) {
+            cpus = LoadFromProc();
+        }
+        if (cpus.empty()) {
+            for (int i = 0, n = std::thread::hardware_concurrency(); i < n; ++i) {
+                cpus.push_back({i, i, 0});
+            }
+        }
+        return cpus;
+    }();
+    return cpus;
+}
+
+std::vector<int> CpuTopology::ParseCpuList(const std::string &text)
+{
+    std::vector<int> cpus;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        const std::string item = text.substr(pos, end - pos);
+        pos = end + 1;
+        int first = 0, last = 0;
+        const int n = sscanf(item.c_str(), "%d-%d", &first, &last);
+        if (n <= 0 || first < 0) {
+            continue;
+        }
+        if (n == 1) {
+            last = first;
+        }
+        for (int i = first; i <= last; ++i) {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> CpuTopology::ArrangeCpus(const std::vector<int> &cpus)
+{
+    const std::vector<Cpu> &topology = GetCpus();
+    std::vector<int> primary, sibling;
+    std::set<std::pair<int, int>> cores;
+    for (int id : cpus) {
+        auto itr = std::find_if(topology.begin(), topology.end(),
+            [id](const Cpu &cpu) { return cpu.id == id; });
+        if (itr == topology.end()) {
+            continue;
+        }
+        if (cores.insert(std::make_pair(itr->package, itr->core)).second) {
+            primary.push_back(id);
+        } else {
+            sibling.push_back(id);
+        }
+    }
+    primary.insert(primary.end(), sibling.begin(), sibling.end());
+    return primary;
+}
+
+std::vector<CpuTopology::Cpu> CpuTopology::LoadFromSys()
+{
+    std::vector<Cpu> cpus;
+    std::ifstream online("/sys/devices/system/cpu/online");
+    std::string text;
+    if (!std::getline(online, text)) {
+        return cpus;
+    }
+    for (int id : ParseCpuList(text)) {
+        const std::string path =
+            "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+        Cpu cpu = {id, id, 0};
+        std::ifstream(path + "core_id") >> cpu.core;
+        std::ifstream(path + "physical_package_id") >> cpu.package;
+        cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<CpuTopology::Cpu> CpuTopology::LoadFromProc()
+{
+    std::vector<Cpu> cpus;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        const size_t pos = line.find(':');
+        if (pos == std::string::npos) {
+            continue;
+        }
+        const int value = atoi(line.c_str() + pos + 1);
+        if (line.compare(0, 9, "processor") == 0) {
+            cpus.push_back({value, value, 0});
+        } else if (cpus.empty()) {
+            continue;
+        } else if (line.compare(0, 11, "physical id") == 0) {
+            cpus.back().package = value;
+        } else if (line.compare(0, 7, "core id") == 0) {
+            cpus.back().core = value;
+        }
+    }
+    return cpus;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class CpuTopology
+{
+public:
+    struct Cpu {
+        int id;
+        int core;
+        int package;
+    };
+
+    static const std::vector<Cpu> &GetCpus();
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}.
+    static std::vector<int> ParseCpuList(const std::string &text);
+
+    // distinct physical cores come first, hyper-thread siblings last.
+    static std::vector<int> ArrangeCpus(const std::vector<int> &cpus);
+
+private:
+    static std::vector<Cpu> LoadFromSys();
+    static std::vector<Cpu> LoadFromProc();
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include "InlineFuncs.h"
+#include "ThreadSafePool.h"
+
+// be useful for:
+// multi producer, single consumer.
+
+#define S_MAX_LOCKFREE_QUEUE_POOL_COUNT (8)
+#define S_LOCKFREE_QUEUE_CACHE_LINE (64)
+
+template <typename T, size_t N = 128>
+class LockFreeBufferQueue
+{
+    struct DataQueue {
+        DataQueue() : next(nullptr), retired(nullptr), wpos(0), rpos(0) {
+            for (auto &flag : ready) {
+                flag.store(false, std::memory_order_relaxed);
+            }
+        }
+        std::atomic<DataQueue*> next;
+        DataQueue *retired;
+        std::atomic<size_t> wpos;
+        size_t rpos;
+        std::atomic<bool> ready[N];
+        T queue[N];
+    };
+    struct ActiveCount {
+        std::atomic<long> n;
+        char padding[S_LOCKFREE_QUEUE_CACHE_LINE - sizeof(std::atomic<long>)];
+    };
+
+public:
+    class Batch {
+    public:
+        Batch() : owner_(nullptr), head_(nullptr), tail_(nullptr), end_(0) {}
+        ~Batch() { Release(); }
+
+        bool Dequeue(T &v) {
+            while (head_ != nullptr) {
+                const size_t end = head_ != tail_ ? N : end_;
+                if (head_->rpos < end) {
+                    auto &ready = head_->ready[head_->rpos];
+                    while (!ready.load(std::memory_order_acquire)) {
+                        std::this_thread::yield();
+                    }
+                    v = head_->queue[head_->rpos++];
+                    return true;
+                }
+                RetireHead();
+            }
+            return false;
+        }
+
+        void Release() {
+            while (head_ != nullptr) {
+                RetireHead();
+            }
+        }
+
+    private:
+        friend class LockFreeBufferQueue;
+        void RetireHead() {
+            auto next = head_ != tail_ ? head_->next.load() : nullptr;
+            owner_->RetireQueue(head_, head_->next.load());
+            head_ = next;
+        }
+        LockFreeBufferQueue *owner_;
+        DataQueue *head_, *tail_;
+        size_t end_;
+    };
+
+    LockFreeBufferQueue() : epoch_(0), retired_(nullptr), waiting_(nullptr) {
+        std::call_once(s_queue_flag_, AutoQueuePool);
+        head_ = AllocQueue();
+        tail_.store(head_);
+        active_[0].n.store(0), active_[1].n.store(0);
+    }
+    ~LockFreeBufferQueue() {
+        do {
+            auto next = head_->next.load(std::memory_order_relaxed);
+            FreeQueue(head_);
+            head_ = next;
+        } while (head_ != nullptr);
+        FreeRetiredQueues(retired_);
+        FreeRetiredQueues(waiting_);
+    }
+
+    // only called by the consumer.
+    bool IsEmpty() const {
+        const DataQueue *queue = head_;
+        if (queue->rpos >= N) {
+            if ((queue = queue->next.load(std::memory_order_acquire)) == nullptr) {
+                return true;
+            }
+        }
+        return !queue->ready[queue->rpos].load(std::memory_order_acquire);
+    }
+
+    void Enqueue(const T &v) {
+        const int epoch = EnterEpoch();
+        while (true) {
+            DataQueue *tail = tail_.load();
+            const size_t pos = tail->wpos.fetch_add(1);
+            if (pos < N) {
+                tail->queue[pos] = v;
+                tail->ready[pos].store(true, std::memory_order_release);
+                break;
+            }
+            DataQueue *next = tail->next.load();
+            if (next == nullptr) {
+                DataQueue *queue = AllocQueue();
+                if (tail->next.compare_exchange_strong(next, queue)) {
+                    next = queue;
+                } else {
+                    FreeQueue(queue);
+                }
+            }
+            tail_.compare_exchange_strong(tail, next);
+        }
+        LeaveEpoch(epoch);
+    }
+
+    bool Dequeue(T &v) {
+        while (true) {
+            if (head_->rpos < N) {
+                if (!head_->ready[head_->rpos].load(std::memory_order_acquire)) {
+                    return false;
+                }
+                v = head_->queue[head_->rpos++];
+                return true;
+            }
+            DataQueue *next = head_->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return false;
+            }
+            RetireQueue(head_, next);
+            head_ = next;
+        }
+    }
+
+    // only called by the consumer, producers move on to a fresh block
+    // and the detached one is sealed so no more slots can be claimed.
+    void Detach(Batch &batch) {
+        batch.Release();
+        if (IsEmpty()) {
+            return;
+        }
+        DataQueue *queue = AllocQueue();
+        DataQueue *tail = tail_.load();
+        while (true) {
+            DataQueue *next = nullptr;
+            if (tail->next.compare_exchange_strong(next, queue)) {
+                break;
+            }
+            tail = next;
+        }
+        batch.end_ = std::min(tail->wpos.fetch_add(N), N);
+        batch.owner_ = this;
+        batch.head_ = head_;
+        batch.tail_ = tail;
+        head_ = queue;
+    }
+
+private:
+    // producers may still hold a drained block they read from tail_,
+    // so it's only recycled after the epoch they entered has drained.
+    int EnterEpoch() {
+        while (true) {
+            const int epoch = epoch_.load();
+            active_[epoch].n.fetch_add(1);
+            if (epoch_.load() == epoch) {
+                return epoch;
+            }
+            active_[epoch].n.fetch_sub(1);
+        }
+    }
+    void LeaveEpoch(int epoch) {
+        active_[epoch].n.fetch_sub(1);
+    }
+
+    void RetireQueue(DataQueue *queue, DataQueue *next) {
+        DataQueue *tail = queue;
+        tail_.compare_exchange_strong(tail, next);
+        queue->retired = retired_;
+        retired_ = queue;
+        if (waiting_ != nullptr) {
+            if (active_[epoch_.load() ^ 1].n.load() != 0) {
+                return;
+            }
+            FreeRetiredQueues(waiting_);
+        }
+        waiting_ = retired_, retired_ = nullptr;
+        epoch_.store(epoch_.load() ^ 1);
+    }
+
+    DataQueue *head_;
+    char padding_head_[S_LOCKFREE_QUEUE_CACHE_LINE];
+    std::atomic<DataQueue*> tail_;
+    char padding_tail_[S_LOCKFREE_QUEUE_CACHE_LINE];
+    std::atomic<int> epoch_;
+    ActiveCount active_[2];
+    DataQueue *retired_, *waiting_;
+
+private:
+    static void AutoQueuePool() {
+        InitQueuePool();
+        std::atexit(ClearQueuePool);
+    }
+
+    static void InitQueuePool() {
+    }
+    static void ClearQueuePool() {
+        DataQueue *queue = nullptr;
+        while ((queue = s_queue_pool_.Get()) != nullptr) {
+            delete queue;
+        }
+    }
+
+    static DataQueue *AllocQueue() {
+        DataQueue *queue = nullptr;
+        if ((queue = s_queue_pool_.Get()) != nullptr) {
+            return REINIT_OBJECT(queue);
+        } else {
+            return new DataQueue;
+        }
+    }
+    static void FreeQueue(DataQueue *queue) {
+        if (!s_queue_pool_.Put(queue)) {
+            delete queue;
+        }
+    }
+    static void FreeRetiredQueues(DataQueue *queue) {
+        while (queue != nullptr) {
+            auto next = queue->retired;
+            FreeQueue(queue);
+            queue = next;
+        }
+    }
+
+    static std::once_flag s_queue_flag_;
+    static ThreadSafePool<DataQueue, S_MAX_LOCKFREE_QUEUE_POOL_COUNT>
+        s_queue_pool_;
+};
+
+template <typename T, size_t N>
+std::once_flag LockFreeBufferQueue<T, N>::s_queue_flag_;
+template <typename T, size_t N>
+ThreadSafePool<
+    typename LockFreeBufferQueue<T, N>::DataQueue,
+    S_MAX_LOCKFREE_QUEUE_POOL_COUNT
+> LockFreeBufferQueue<T, N>::s_queue_pool_;
@@ -19,6 +19,37 @@ class MultiBufferQueue
     };
 
 public:
+    class Batch {
+    public:
+        Batch() : head_(nullptr) {}
+        ~Batch() { Release(); }
+
+        bool Dequeue(T &v) {
+            while (head_ != nullptr) {
+                if (head_->rpos < head_->wpos) {
+                    v = head_->queue[head_->rpos++];
+                    return true;
+                }
+                auto next = head_->next;
+                FreeQueue(head_);
+                head_ = next;
+            }
+            return false;
+        }
+
+        void Release() {
+            while (head_ != nullptr) {
+                auto next = head_->next;
+                FreeQueue(head_);
+                head_ = next;
+            }
+        }
+
+    private:
+        friend class MultiBufferQueue;
+        DataQueue *head_;
+    };
+
     MultiBufferQueue() {
         std::call_once(s_queue_flag_, AutoQueuePool);
         tail_ = head_ = AllocQueue();
@@ -96,6 +127,34 @@ mark:           v = head_->queue[head_->rpos++];
         return isOK;
     }
 
+    void Detach(Batch &batch) {
+        batch.Release();
+        DataQueue *queue = nullptr;
+mark:   bool isOk = false;
+        do {
+            std::lock_guard<spinlock> rlock(r_spin_);
+            std::lock_guard<spinlock> wlock(w_spin_);
+            if (head_ == tail_ && head_->rpos >= head_->wpos) {
+                isOk = true;
+                break;
+            }
+            if (queue != nullptr) {
+                batch.head_ = head_;
+                head_ = tail_ = queue;
+                queue = nullptr;
+                isOk = true;
+            }
+        } while (0);
+        if (isOk) {
+            if (queue != nullptr) {
+                FreeQueue(queue);
+            }
+        } else {
+            queue = AllocQueue();
+            goto mark;
+        }
+    }
+
 private:
     DataQueue *head_, *tail_;
     spinlock r_spin_, w_spin_;
@@ -112,3 +112,113 @@ void INetPacket::WritePacket(const INetPacket &other)
     WriteHeader(Header(other.GetOpcode(), other.GetReadableSize() + Header::SIZE));
     Append(other.GetReadableBuffer(), other.GetReadableSize());
 }
+
+SharedNetPacket *SharedNetPacket::Create(const INetPacket &pck)
+{
+    const size_t size = INetPacket::Header::SIZE + pck.GetReadableSize();
+    if (size > MAX_NET_PACKET_SIZE) {
+        THROW_EXCEPTION(NetStreamException());
+    }
+
+    void *ptr = ::operator new(sizeof(SharedNetPacket) + size);
+    SharedNetPacket *shared = new(ptr) SharedNetPacket(pck.GetOpcode(), size);
+    ConstNetPacket wrapper(shared->buffer_, size);
+    wrapper.Shrink(0);
+    wrapper.WriteHeader(INetPacket::Header(pck.GetOpcode(), size));
+    wrapper.Append(pck.GetReadableBuffer(), pck.GetReadableSize());
+    return shared;
+}
+
+void SharedNetPacket::Release()
+{
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        this->~SharedNetPacket();
+        ::operator delete(this);
+    }
+}
+
+ChunkNetPacket::ChunkNetPacket(uint32 opcode, size_t size)
+: INetPacket(opcode)
+, size_(0)
+, offset_(0)
+, index_(0)
+{
+    chunks_.reserve(size / INetPacket::MAX_BUFFER_SIZE + 1);
+}
+
+ChunkNetPacket::~ChunkNetPacket()
+{
+    for (auto pck : chunks_) {
+        delete pck;
+    }
+}
+
+void ChunkNetPacket::AppendChunk(INetPacket *pck)
+{
+    if (pck->IsReadableEmpty()) {
+        delete pck;
+        return;
+    }
+    chunks_.push_back(pck);
+    size_ += pck->GetReadableSize();
+}
+
+const char *ChunkNetPacket::GetRemainChunk(size_t &size)
+{
+    while (index_ < chunks_.size()) {
+        INetPacket *pck = chunks_[index_];
+        if (!pck->IsReadableEmpty()) {
+            size = pck->GetReadableSize();
+            return pck->GetReadableBuffer();
+        }
+        ++index_;
+    }
+    size = 0;
+    return nullptr;
+}
+
+void ChunkNetPacket::AdjustChunkPos(size_t size)
+{
+    if (size > GetRemainSize()) {
+        THROW_EXCEPTION(NetStreamException());
+    }
+    offset_ += size;
+    while (size > 0) {
+        INetPacket *pck = chunks_[index_];
+        const size_t avail = std::min(size, pck->GetReadableSize());
+        pck->AdjustReadPos(avail);
+        size -= avail;
+        if (pck->IsReadableEmpty()) {
+            ++index_;
+        }
+    }
+}
+
+ChunkNetPacket &ChunkNetPacket::TakeData(void *data, size_t size)
+{
+    if (size > GetRemainSize()) {
+        THROW_EXCEPTION(NetStreamException());
+    }
+    char *ptr = (char*)data;
+    while (size > 0) {
+        size_t avail = 0;
+        const char *chunk = GetRemainChunk(avail);
+        avail = std::min(avail, size);
+        memcpy(ptr, chunk, avail);
+        AdjustChunkPos(avail);
+        ptr += avail, size -= avail;
+    }
+    return *this;
+}
+
+INetPacket *ChunkNetPacket::Flatten() const
+{
+    const size_t size = GetRemainSize();
+    INetPacket *pck = size <= MAX_NET_PACKET_SIZE ?
+        New(GetOpcode(), size) : new NetPacket(GetOpcode());
+    pck->Reserve(size);
+    for (size_t i = index_; i < chunks_.size(); ++i) {
+        pck->Append(chunks_[i]->GetReadableBuffer(), chunks_[i]->GetReadableSize());
+    }
+    return pck;
+}
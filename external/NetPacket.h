@@ -2,6 +2,7 @@
 
 #include "NetStream.h"
 #include <atomic>
+#include <vector>
 #include "Macro.h"
 #include "ThreadSafePool.h"
 
@@ -121,3 +122,57 @@ template <size_t N>
 ThreadSafePool<void, S_MAX_NET_PACKET_POOL_COUNT(N)> TNetPacket<N>::s_pool_;
 
 typedef TNetPacket<256> NetPacket;
+
+// large packet kept as the chain of its fragments, read it in place,
+// or flatten it when contiguous data is required.
+class ChunkNetPacket : public INetPacket
+{
+public:
+    // size is a hint for the chunks expected.
+    ChunkNetPacket(uint32 opcode, size_t size);
+    virtual ~ChunkNetPacket();
+
+    // takes ownership, the readable part of pck becomes the next chunk.
+    void AppendChunk(INetPacket *pck);
+
+    size_t GetChunkCount() const { return chunks_.size(); }
+    size_t GetDataSize() const { return size_; }
+    size_t GetRemainSize() const { return size_ - offset_; }
+    bool IsRemainEmpty() const { return offset_ >= size_; }
+
+    const char *GetRemainChunk(size_t &size);
+    void AdjustChunkPos(size_t size);
+
+    ChunkNetPacket &TakeData(void *data, size_t size);
+    template <typename T> T ReadData() {
+        T v; TakeData(&v, sizeof(v)); return v;
+    }
+
+    INetPacket *Flatten() const;
+
+private:
+    std::vector<INetPacket*> chunks_;
+    size_t size_, offset_, index_;
+};
+
+// immutable, header pre-encoded, shared by many send buffers.
+class SharedNetPacket : public noncopyable
+{
+public:
+    static SharedNetPacket *Create(const INetPacket &pck);
+
+    void AddRef() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void Release();
+
+    const char *GetBuffer() const { return buffer_; }
+    size_t GetSize() const { return size_; }
+    uint32 GetOpcode() const { return opcode_; }
+
+private:
+    SharedNetPacket(uint32 opcode, size_t size)
+        : refs_(1), opcode_(opcode), size_(size) {}
+    std::atomic<long> refs_;
+    const uint32 opcode_;
+    const size_t size_;
+    char buffer_[1];
+};
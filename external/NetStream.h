@@ -66,6 +66,11 @@ public:
         wpos_ = size;
         rpos_ = std::min(rpos_, size);
     }
+    void Reserve(size_t size) {
+        if (size > size_) {
+            Reallocate(size);
+        }
+    }
 
     INetStream &Append(const void *data, size_t size) {
         if (size != 0) WriteStream(data, size);
@@ -186,17 +191,19 @@ private:
     }
     void Resize(size_t size) {
         if (size > size_) {
-            size_t newSize = std::max(size, size_ << 1);
-            char *newBuffer = new char[newSize];
-            if (wpos_ != 0) {
-                memcpy(newBuffer, buffer_, wpos_);
-            }
-            if (buffer_ != nullptr) {
-                DeleteBuffer();
-            }
-            buffer_ = newBuffer;
-            size_ = newSize;
+            Reallocate(std::max(size, size_ << 1));
+        }
+    }
+    void Reallocate(size_t newSize) {
+        char *newBuffer = new char[newSize];
+        if (wpos_ != 0) {
+            memcpy(newBuffer, buffer_, wpos_);
+        }
+        if (buffer_ != nullptr) {
+            DeleteBuffer();
         }
+        buffer_ = newBuffer;
+        size_ = newSize;
     }
     void DeleteBuffer() {
         if (buffer_ != nullptr && buffer_ != internal_) {
@@ -13,6 +13,8 @@
     #include <libgen.h>
     #include <limits.h>
     #include <unistd.h>
+    #include <pthread.h>
+    #include <time.h>
 #endif
 
 void OS::SleepS(long s)
@@ -121,6 +123,40 @@ bool OS::is_file_exist(const char *filepath)
 #endif
 }
 
+bool OS::set_thread_affinity(int cpu)
+{
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+    return false;
+#endif
+}
+
+uint64 OS::thread_cpu_time_ns()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime, k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime, u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 100;
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return uint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 bool OS::non_blocking(SOCKET sockfd)
 {
 #if defined(_WIN32)
@@ -143,6 +179,16 @@ bool OS::reuse_address(SOCKET sockfd)
 #endif
 }
 
+bool OS::reuse_port(SOCKET sockfd)
+{
+#if defined(SO_REUSEPORT)
+    const int opt = 1;
+    return setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == 0;
+#else
+    return false;
+#endif
+}
+
 bool OS::no_delay(SOCKET sockfd)
 {
 #if defined(_WIN32)
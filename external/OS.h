@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include "Base.h"
 #include "Macro.h"
 
 class OS
@@ -17,7 +18,11 @@ public:
 
     static bool is_file_exist(const char *filepath);
 
+    static bool set_thread_affinity(int cpu);
+    static uint64 thread_cpu_time_ns();
+
     static bool non_blocking(SOCKET sockfd);
     static bool reuse_address(SOCKET sockfd);
+    static bool reuse_port(SOCKET sockfd);
     static bool no_delay(SOCKET sockfd);
 };
@@ -1,5 +1,6 @@
 #include "Thread.h"
 #include "Exception.h"
+#include "Logger.h"
 #include "OS.h"
 
 #if defined(_WIN32)
@@ -8,6 +9,7 @@
 
 Thread::Thread()
 : status_(Stopped)
+, cpu_affinity_(-1)
 , thread_running_(false)
 {
 }
@@ -77,6 +79,10 @@ void Thread::Run()
     SetThreadName(-1, GetThreadName());
 #endif
 
+    if (cpu_affinity_ >= 0 && !OS::set_thread_affinity(cpu_affinity_)) {
+        WLOG("%s bind cpu %d failed.", GetThreadName(), cpu_affinity_);
+    }
+
     if (!Initialize()) {
         Stop();
         return;
@@ -23,6 +23,8 @@ public:
     bool Start();
     void Stop();
 
+    void SetAffinity(int cpu) { cpu_affinity_ = cpu; }
+
     void Resume();
     void Pause();
 
@@ -41,6 +43,7 @@ private:
     void Run();
 
     Status status_;
+    int cpu_affinity_;
     std::thread thread_;
     bool thread_running_;
 };
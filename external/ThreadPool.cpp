@@ -14,6 +14,10 @@ bool ThreadPool::Start()
         return false;
     }
 
+    for (size_t i = 0; i < threads_.size() && !cpu_affinity_.empty(); ++i) {
+        threads_[i]->SetAffinity(cpu_affinity_[i % cpu_affinity_.size()]);
+    }
+
     for (auto thread : threads_) {
         if (!thread->Start()) {
             return false;
@@ -18,6 +18,9 @@ public:
 
     void Foreach(const std::function<void(Thread*)> &func) const;
 
+    // threads are pinned round-robin over cpus when the pool starts.
+    void SetAffinity(const std::vector<int> &cpus) { cpu_affinity_ = cpus; }
+
 protected:
     virtual bool Prepare() = 0;
     virtual void Abort() {}
@@ -32,4 +35,5 @@ private:
     void ClearThreads();
 
     std::vector<Thread*> threads_;
+    std::vector<int> cpu_affinity_;
 };
@@ -3,8 +3,17 @@
 #endif
 
 //#include "AITest.h"
+//#include "CircularBufferTest.h"
+//#include "CryptoTest.h"
 //#include "EchoTest.h"
+//#include "NetBenchTest.h"
+//#include "OpcodeDispatcherTest.h"
 #include "ParallelTest.h"
+//#include "PipeTest.h"
+//#include "QueueTest.h"
+//#include "RudpTest.h"
+//#include "SendBufferTest.h"
+//#include "ShmTest.h"
 
 const char *I18N_StrID(uint32 strid) {
     return "";
@@ -13,7 +22,16 @@ const char *I18N_StrID(uint32 strid) {
 int main(int argc, char **argv)
 {
     //AIMain(argc, argv);
+    //CircularBufferMain(argc, argv);
+    //CryptoMain(argc, argv);
     //EchoMain(argc, argv);
+    //NetBenchMain(argc, argv);
+    //OpcodeDispatcherMain(argc, argv);
     ParallelMain(argc, argv);
+    //PipeMain(argc, argv);
+    //QueueMain(argc, argv);
+    //RudpMain(argc, argv);
+    //SendBufferMain(argc, argv);
+    //ShmMain(argc, argv);
     return 0;
 }
@@ -0,0 +1,11 @@
+#include "NetBenchTest.h"
+
+const char *I18N_StrID(uint32 strid) {
+    return "";
+}
+
+int main(int argc, char **argv)
+{
+    NetBenchMain(argc, argv);
+    return 0;
+}
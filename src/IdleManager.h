@@ -1,6 +1,7 @@
 #pragma once
 
 #include <condition_variable>
+#include "MultiBufferQueue.h"
 #include "async/AsyncTaskOwner.h"
 #include "network/Session.h"
 
@@ -8,6 +8,7 @@
 #include "System.h"
 #include "CoreDumper.h"
 #include "SignalHandler.h"
+#include "CpuTopology.h"
 
 IServerMaster *IServerMaster::instance_ = nullptr;
 IServerMaster::IServerMaster()
@@ -61,6 +62,11 @@ bool IServerMaster::ParseConfigFile(KeyFile &config, const std::string &file)
     return false;
 }
 
+std::vector<int> IServerMaster::GetAffinityCpus(const std::string &text)
+{
+    return CpuTopology::ArrangeCpus(CpuTopology::ParseCpuList(text));
+}
+
 int IServerMaster::Initialize(int argc, char *argv[])
 {
     const std::string configFile = GetConfigFile();
@@ -69,6 +75,10 @@ int IServerMaster::Initialize(int argc, char *argv[])
         return -1;
     }
 
+    const std::vector<int> loggerCpus = GetAffinityCpus(GetLoggerAffinity());
+    if (!loggerCpus.empty()) {
+        sLogger.SetAffinity(loggerCpus.front());
+    }
     if (!sLogger.Start()) {
         printf("sLogger.Start() failed.\n");
         return -1;
@@ -88,18 +98,34 @@ int IServerMaster::Initialize(int argc, char *argv[])
 
 int IServerMaster::Run(int argc, char *argv[])
 {
+    const std::vector<int> mainCpus = GetAffinityCpus(GetMainAffinity());
+    if (!mainCpus.empty() && !OS::set_thread_affinity(mainCpus.front())) {
+        WLOG("bind main thread to cpu %d failed.", mainCpus.front());
+    }
+
     sAsyncTaskMgr.SetWorkerCount(GetAsyncServiceCount());
+    sAsyncTaskMgr.SetAffinity(GetAffinityCpus(GetAsyncServiceAffinity()));
     if (!sAsyncTaskMgr.Start()) {
         ELOG("--- sAsyncTaskMgr.Start() failed.");
         return -1;
     }
 
     sIOServiceManager.SetWorkerCount(GetIOServiceCount());
+    sIOServiceManager.SetUringEnabled(IsIOServiceUring());
+    sIOServiceManager.SetAffinity(GetAffinityCpus(GetIOServiceAffinity()));
     if (!sIOServiceManager.Start()) {
         ELOG("--- sIOServiceManager.Start() failed.");
         return -1;
     }
 
+    sSessionManager.SetShardCount(GetSessionShardCount());
+    sSessionManager.SetShardAffinity(GetAffinityCpus(GetSessionShardAffinity()));
+    sSessionManager.SetIdleTimeout(GetSessionIdleTimeout());
+    if (!sSessionManager.StartShards()) {
+        ELOG("--- sSessionManager.StartShards() failed.");
+        return -1;
+    }
+
     if (!StartServices()) {
         ELOG("StartServices() failed.");
         return -1;
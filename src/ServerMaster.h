@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+#include "Base.h"
 #include "KeyFile.h"
 #include "noncopyable.h"
 
@@ -32,8 +34,22 @@ protected:
     virtual std::string GetConfigFile() = 0;
     virtual size_t GetAsyncServiceCount() = 0;
     virtual size_t GetIOServiceCount() = 0;
+    // sessions stay on the main thread when 0.
+    virtual size_t GetSessionShardCount() { return 0; }
+    // milliseconds a session may receive nothing before it is shut down, 0 never.
+    virtual uint64 GetSessionIdleTimeout() { return 0; }
+    // io_uring for socket reads and writes, asio where the kernel lacks it.
+    virtual bool IsIOServiceUring() { return false; }
+
+    // cpu lists such as "0-3,8", empty means no pinning.
+    virtual std::string GetIOServiceAffinity() { return ""; }
+    virtual std::string GetAsyncServiceAffinity() { return ""; }
+    virtual std::string GetSessionShardAffinity() { return ""; }
+    virtual std::string GetLoggerAffinity() { return ""; }
+    virtual std::string GetMainAffinity() { return ""; }
 
     static bool ParseConfigFile(KeyFile &config, const std::string &file);
+    static std::vector<int> GetAffinityCpus(const std::string &text);
 
 private:
     KeyFile config_;
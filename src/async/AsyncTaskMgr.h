@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Singleton.h"
+#include "MultiBufferQueue.h"
 #include "ThreadPool.h"
 #include "AsyncTask.h"
 #include "AsyncTaskOwner.h"
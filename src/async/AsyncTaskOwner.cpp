@@ -22,7 +22,9 @@ AsyncTaskOwner::~AsyncTaskOwner()
 void AsyncTaskOwner::UpdateTask()
 {
     AsyncTask *task = nullptr;
-    while (tasks_.Dequeue(task)) {
+    LockFreeBufferQueue<AsyncTask*>::Batch batch;
+    tasks_.Detach(batch);
+    while (batch.Dequeue(task)) {
         subjects_.Remove(task);
         TRY_BEGIN {
             task->Finish(this);
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "MultiBufferQueue.h"
+#include "LockFreeBufferQueue.h"
 #include "ThreadSafeSet.h"
 #include "noncopyable.h"
 #include "enable_linked_from_this.h"
@@ -31,7 +31,7 @@ public:
     bool HasSubject() const;
 
 private:
-    MultiBufferQueue<AsyncTask*> tasks_;
+    LockFreeBufferQueue<AsyncTask*> tasks_;
     ThreadSafeSet<const void *> subjects_;
 
     IEventObserver *event_observer_;
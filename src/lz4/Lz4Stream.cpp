@@ -2,21 +2,87 @@
 #include "Logger.h"
 #include <string.h>
 #include <algorithm>
+#include <fstream>
+#include <sstream>
 
 namespace lz4 {
 
 static const size_t MAX_SRC_SIZE = 64*1024;
 
-CompressStream::CompressStream()
-: cctx_(nullptr)
+static const size_t DICT_WINDOW_SIZE = 64*1024;
+static const size_t DICT_HISTORY_SIZE = DICT_WINDOW_SIZE + MAX_SRC_SIZE;
+static const size_t DICT_HEADER_SIZE = 4 + 4;
+static const size_t DICT_BLOCK_HEADER_SIZE = 4;
+static const unsigned DICT_STREAM_MAGIC = 0x445a4c46;
+
+static void WriteLE32(char *dst, unsigned v)
+{
+    for (int i = 0; i < 4; ++i) dst[i] = char(v >> (i * 8));
+}
+
+static unsigned ReadLE32(const char *src)
+{
+    unsigned v = 0;
+    for (int i = 0; i < 4; ++i) v |= unsigned((unsigned char)src[i]) << (i * 8);
+    return v;
+}
+
+static unsigned HashDictionary(const std::string &data)
+{
+    unsigned hash = 2166136261u;
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+Dictionary::Dictionary(const void *data, size_t size)
+: data_((const char *)data + size - std::min(size, DICT_WINDOW_SIZE),
+        std::min(size, DICT_WINDOW_SIZE))
+, id_(HashDictionary(data_))
+{
+}
+
+std::shared_ptr<const Dictionary> Dictionary::Load(const std::string &file)
+{
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream.is_open()) {
+        ELOG("Open lz4 dictionary '%s' failed.", file.c_str());
+        return nullptr;
+    }
+    std::ostringstream data;
+    data << stream.rdbuf();
+    const std::string &str = data.str();
+    return std::make_shared<Dictionary>(str.data(), str.size());
+}
+
+CompressStream::CompressStream(std::shared_ptr<const Dictionary> dict)
+: dict_(std::move(dict))
+, cctx_(nullptr)
+, stream_(nullptr)
 , dst_(nullptr)
+, hist_(nullptr)
 , i_(0)
 , n_(0)
 , cap_(0)
+, hpos_(0)
+, bpos_(0)
 , flush_(true)
 {
     memset(&prefs_, 0, sizeof(prefs_));
     prefs_.frameInfo.blockSizeID = LZ4F_max64KB;
+    if (dict_) {
+        dst_ = new char[cap_ = DICT_BLOCK_HEADER_SIZE + LZ4_COMPRESSBOUND(MAX_SRC_SIZE)];
+        hist_ = new char[DICT_HISTORY_SIZE];
+        stream_ = LZ4_createStream();
+        memcpy(hist_, dict_->GetData(), dict_->GetSize());
+        LZ4_loadDict(stream_, hist_, (int)dict_->GetSize());
+        hpos_ = bpos_ = dict_->GetSize();
+        WriteLE32(dst_, DICT_STREAM_MAGIC);
+        WriteLE32(dst_ + 4, dict_->GetID());
+        n_ = DICT_HEADER_SIZE;
+        return;
+    }
     dst_ = new char[cap_ = LZ4F_compressBound(MAX_SRC_SIZE, &prefs_)];
     LZ4F_errorCode_t ret = LZ4F_createCompressionContext(&cctx_, LZ4F_VERSION);
     if (LZ4F_isError(ret)) {
@@ -33,6 +99,13 @@ CompressStream::CompressStream()
 CompressStream::~CompressStream()
 {
     delete[] dst_;
+    delete[] hist_;
+    if (stream_ != nullptr) {
+        LZ4_freeStream(stream_);
+    }
+    if (cctx_ == nullptr) {
+        return;
+    }
     LZ4F_errorCode_t ret = LZ4F_freeCompressionContext(cctx_);
     if (LZ4F_isError(ret)) {
         WLOG("LZ4F_freeCompressionContext() Has Error %s.", LZ4F_getErrorName(ret));
@@ -54,9 +127,7 @@ bool CompressStream::Compress(const void *in, size_t &inlen, void *out, size_t &
             return true;
         }
         const size_t avail = std::min(MAX_SRC_SIZE, inlen - in_digest);
-        n_ = LZ4F_compressUpdate(cctx_, dst_, cap_, (const char *)in + in_digest, avail, nullptr);
-        if (LZ4F_isError(n_)) {
-            WLOG("LZ4F_compressUpdate() Has Error %s.", LZ4F_getErrorName(n_));
+        if (!Update((const char *)in + in_digest, avail)) {
             return false;
         }
         in_digest += avail;
@@ -77,18 +148,93 @@ bool CompressStream::Flush(void *out, size_t &outlen)
             outlen = out_avail;
             return true;
         }
+        if (!FlushBlock()) {
+            return false;
+        }
+    }
+}
+
+bool CompressStream::Update(const char *src, size_t size)
+{
+    if (!dict_) {
+        n_ = LZ4F_compressUpdate(cctx_, dst_, cap_, src, size, nullptr);
+        if (LZ4F_isError(n_)) {
+            WLOG("LZ4F_compressUpdate() Has Error %s.", LZ4F_getErrorName(n_));
+            return false;
+        }
+        return true;
+    }
+
+    n_ = 0;
+    if (hpos_ - bpos_ + size > MAX_SRC_SIZE && !CompressBlock()) {
+        return false;
+    }
+    if (hpos_ + size > DICT_HISTORY_SIZE) {
+        const size_t pending = hpos_ - bpos_;
+        const size_t window = LZ4_saveDict(stream_, hist_, DICT_WINDOW_SIZE);
+        memmove(hist_ + window, hist_ + bpos_, pending);
+        bpos_ = window, hpos_ = window + pending;
+    }
+    memcpy(hist_ + hpos_, src, size);
+    hpos_ += size;
+    return true;
+}
+
+bool CompressStream::FlushBlock()
+{
+    if (!dict_) {
         n_ = LZ4F_flush(cctx_, dst_, cap_, nullptr);
         if (LZ4F_isError(n_)) {
             WLOG("LZ4F_flush() Has Error %s.", LZ4F_getErrorName(n_));
             return false;
         }
+        return true;
+    }
+    n_ = 0;
+    return CompressBlock();
+}
+
+bool CompressStream::CompressBlock()
+{
+    if (hpos_ == bpos_) {
+        return true;
     }
+    int ret = LZ4_compress_fast_continue(stream_, hist_ + bpos_,
+        dst_ + n_ + DICT_BLOCK_HEADER_SIZE, int(hpos_ - bpos_),
+        int(cap_ - n_ - DICT_BLOCK_HEADER_SIZE), 1);
+    if (ret <= 0) {
+        WLOG("LZ4_compress_fast_continue() Has Error %d.", ret);
+        return false;
+    }
+    WriteLE32(dst_ + n_, ret);
+    n_ += DICT_BLOCK_HEADER_SIZE + ret;
+    bpos_ = hpos_;
+    return true;
 }
 
 
-DecompressStream::DecompressStream()
-: dctx_(nullptr)
+DecompressStream::DecompressStream(std::shared_ptr<const Dictionary> dict)
+: dict_(std::move(dict))
+, dctx_(nullptr)
+, stream_(nullptr)
+, src_(nullptr)
+, hist_(nullptr)
+, i_(0)
+, n_(0)
+, dpos_(0)
+, spos_(0)
+, slen_(DICT_HEADER_SIZE)
+, stage_(0)
 {
+    if (dict_) {
+        src_ = new char[LZ4_COMPRESSBOUND(MAX_SRC_SIZE)];
+        hist_ = new char[DICT_HISTORY_SIZE];
+        stream_ = LZ4_createStreamDecode();
+        memcpy(hist_, dict_->GetData(), dict_->GetSize());
+        LZ4_setStreamDecode(stream_, hist_, (int)dict_->GetSize());
+        i_ = n_ = dpos_ = dict_->GetSize();
+        return;
+    }
     LZ4F_errorCode_t ret = LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION);
     if (LZ4F_isError(ret)) {
         ELOG("LZ4F_createDecompressionContext() Fatal Error %s.", LZ4F_getErrorName(ret));
@@ -98,6 +244,14 @@ DecompressStream::DecompressStream()
 
 DecompressStream::~DecompressStream()
 {
+    delete[] src_;
+    delete[] hist_;
+    if (stream_ != nullptr) {
+        LZ4_freeStreamDecode(stream_);
+    }
+    if (dctx_ == nullptr) {
+        return;
+    }
     LZ4F_errorCode_t ret = LZ4F_freeDecompressionContext(dctx_);
     if (LZ4F_isError(ret)) {
         WLOG("LZ4F_freeDecompressionContext() Has Error %s.", LZ4F_getErrorName(ret));
@@ -106,6 +260,9 @@ DecompressStream::~DecompressStream()
 
 bool DecompressStream::Decompress(const void *in, size_t &inlen, void *out, size_t &outlen)
 {
+    if (dict_) {
+        return DecompressDict(in, inlen, out, outlen);
+    }
     size_t ret = LZ4F_decompress(dctx_, out, &outlen, in, &inlen, nullptr);
     if (LZ4F_isError(ret)) {
         WLOG("LZ4F_decompress() Has Error %s.", LZ4F_getErrorName(ret));
@@ -114,4 +271,65 @@ bool DecompressStream::Decompress(const void *in, size_t &inlen, void *out, size
     return true;
 }
 
+bool DecompressStream::DecompressDict(const void *in, size_t &inlen, void *out, size_t &outlen)
+{
+    size_t in_digest = 0, out_avail = 0;
+    for (;;) {
+        if (i_ < n_) {
+            const size_t avail = std::min(n_ - i_, outlen - out_avail);
+            memcpy((char *)out + out_avail, hist_ + i_, avail);
+            out_avail += avail;
+            i_ += avail;
+        }
+        if (out_avail >= outlen || in_digest >= inlen) {
+            outlen = out_avail, inlen = in_digest;
+            return true;
+        }
+        const size_t avail = std::min(slen_ - spos_, inlen - in_digest);
+        memcpy(src_ + spos_, (const char *)in + in_digest, avail);
+        in_digest += avail;
+        if ((spos_ += avail) >= slen_ && !DecompressBlock()) {
+            return false;
+        }
+    }
+}
+
+bool DecompressStream::DecompressBlock()
+{
+    spos_ = 0;
+    if (stage_ == 0) {
+        if (ReadLE32(src_) != DICT_STREAM_MAGIC ||
+            ReadLE32(src_ + 4) != dict_->GetID()) {
+            WLOG("lz4 Dictionary Mismatch %u:%u.", ReadLE32(src_ + 4), dict_->GetID());
+            return false;
+        }
+        slen_ = DICT_BLOCK_HEADER_SIZE, stage_ = 1;
+        return true;
+    }
+    if (stage_ == 1) {
+        slen_ = ReadLE32(src_), stage_ = 2;
+        if (slen_ == 0 || slen_ > (size_t)LZ4_COMPRESSBOUND(MAX_SRC_SIZE)) {
+            WLOG("lz4 Block Size Error %zu.", slen_);
+            return false;
+        }
+        return true;
+    }
+
+    if (dpos_ + MAX_SRC_SIZE > DICT_HISTORY_SIZE) {
+        const size_t window = std::min(dpos_, DICT_WINDOW_SIZE);
+        memmove(hist_, hist_ + dpos_ - window, window);
+        LZ4_setStreamDecode(stream_, hist_, (int)window);
+        dpos_ = window;
+    }
+    int ret = LZ4_decompress_safe_continue(stream_, src_, hist_ + dpos_,
+        (int)slen_, (int)MAX_SRC_SIZE);
+    if (ret < 0) {
+        WLOG("LZ4_decompress_safe_continue() Has Error %d.", ret);
+        return false;
+    }
+    i_ = dpos_, n_ = dpos_ += ret;
+    slen_ = DICT_BLOCK_HEADER_SIZE, stage_ = 1;
+    return true;
+}
+
 }
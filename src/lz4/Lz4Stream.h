@@ -1,36 +1,74 @@
 #pragma once
 
+#include <lz4.h>
 #include <lz4frame.h>
+#include <memory>
+#include <string>
 
 namespace lz4 {
 
+// shared by every connection, only the last 64KB are kept.
+class Dictionary
+{
+public:
+    Dictionary(const void *data, size_t size);
+
+    static std::shared_ptr<const Dictionary> Load(const std::string &file);
+
+    const char *GetData() const { return data_.data(); }
+    size_t GetSize() const { return data_.size(); }
+    unsigned GetID() const { return id_; }
+
+private:
+    const std::string data_;
+    const unsigned id_;
+};
+
+// with a dictionary the stream is [magic:4][dict id:4] then [size:4][block]...,
+// blocks are chained through a 64KB window that starts out as the dictionary.
 class CompressStream
 {
 public:
-    CompressStream();
+    CompressStream(std::shared_ptr<const Dictionary> dict = nullptr);
     ~CompressStream();
 
     bool Compress(const void *in, size_t &inlen, void *out, size_t &outlen);
     bool Flush(void *out, size_t &outlen);
 
 private:
+    bool Update(const char *src, size_t size);
+    bool FlushBlock();
+    bool CompressBlock();
+
+    const std::shared_ptr<const Dictionary> dict_;
     LZ4F_preferences_t prefs_;
     LZ4F_cctx *cctx_;
-    char *dst_;
+    LZ4_stream_t *stream_;
+    char *dst_, *hist_;
     size_t i_, n_, cap_;
+    size_t hpos_, bpos_;
     bool flush_;
 };
 
 class DecompressStream
 {
 public:
-    DecompressStream();
+    DecompressStream(std::shared_ptr<const Dictionary> dict = nullptr);
     ~DecompressStream();
 
     bool Decompress(const void *in, size_t &inlen, void *out, size_t &outlen);
 
 private:
+    bool DecompressDict(const void *in, size_t &inlen, void *out, size_t &outlen);
+    bool DecompressBlock();
+
+    const std::shared_ptr<const Dictionary> dict_;
     LZ4F_dctx *dctx_;
+    LZ4_streamDecode_t *stream_;
+    char *src_, *hist_;
+    size_t i_, n_, dpos_;
+    size_t spos_, slen_;
+    int stage_;
 };
 
 }
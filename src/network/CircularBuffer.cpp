@@ -1,21 +1,80 @@
 #include "CircularBuffer.h"
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 #include <type_traits>
 #include "Debugger.h"
-
-CircularBuffer::CircularBuffer(size_t size)
-: base_(new char[size])
+#include "Logger.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+CircularBuffer::CircularBuffer(size_t size, bool is_mirrored)
+: base_(is_mirrored ? NewMirroredBuffer(size) : nullptr)
 , size_(size)
+, is_mirrored_(base_ != nullptr)
 , in_(0)
 , out_(0)
 {
     assert((size & (size - 1)) == 0);
+    if (!is_mirrored_) {
+        base_ = new char[size];
+    }
+    // warned once, every later buffer falls back the same way.
+    static std::atomic<bool> is_warned(false);
+    if (is_mirrored && !is_mirrored_ && !is_warned.exchange(true)) {
+        WLOG("CircularBuffer[%zu] can't be mirrored, fall back to plain.", size);
+    }
 }
 
 CircularBuffer::~CircularBuffer()
 {
-    delete[] base_;
+    if (is_mirrored_) {
+        DeleteMirroredBuffer(base_, size_);
+    } else {
+        delete[] base_;
+    }
+}
+
+// an address range of twice the size is reserved first, then the memfd
+// is mapped over both of its halves.
+char *CircularBuffer::NewMirroredBuffer(size_t size)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if (size % sysconf(_SC_PAGESIZE) != 0) {
+        return nullptr;
+    }
+    int fd = memfd_create("CircularBuffer", MFD_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    char *base = nullptr;
+    if (ftruncate(fd, size) == 0) {
+        void *addr = mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr != MAP_FAILED) {
+            base = (char*)addr;
+            for (auto i = 0; i < 2 && base != nullptr; ++i) {
+                if (mmap(base + size * i, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                    munmap(base, size * 2);
+                    base = nullptr;
+                }
+            }
+        }
+    }
+    close(fd);
+    return base;
+#else
+    return nullptr;
+#endif
+}
+
+void CircularBuffer::DeleteMirroredBuffer(char *base, size_t size)
+{
+#if defined(__linux__)
+    munmap(base, size * 2);
+#endif
 }
 
 bool CircularBuffer::IsEmpty() const
@@ -93,17 +152,23 @@ size_t CircularBuffer::Remove(size_t size)
     return n;
 }
 
-size_t CircularBuffer::Peek(char *data, size_t size) const
+size_t CircularBuffer::Peek(char *data, size_t size, size_t offset) const
 {
     std::aligned_storage<
         sizeof(CircularBuffer), alignof(CircularBuffer)>::type placeholder;
     CircularBuffer &other = *reinterpret_cast<CircularBuffer*>(&placeholder);
     memcpy(&other, this, sizeof(CircularBuffer));
+    if (other.Remove(offset) != offset) {
+        return 0;
+    }
     return other.Read(data, size);
 }
 
 size_t CircularBuffer::GetContiguiousWritableSpace() const
 {
+    if (is_mirrored_) {
+        return out_ + size_ - in_;
+    }
     return std::min(out_ + size_ - in_, size_ - (in_ & (size_ - 1)));
 }
 
@@ -114,12 +179,15 @@ char *CircularBuffer::GetContiguiousWritableBuffer() const
 
 void CircularBuffer::IncrementContiguiousWritten(size_t size)
 {
-    DBGASSERT(size <= std::min(out_ + size_ - in_, size_ - (in_ & (size_ - 1))));
+    DBGASSERT(size <= GetContiguiousWritableSpace());
     in_ += size;
 }
 
 size_t CircularBuffer::GetContiguiousReadableSpace() const
 {
+    if (is_mirrored_) {
+        return in_ - out_;
+    }
     return std::min(in_ - out_, size_ - (out_ & (size_ - 1)));
 }
 
@@ -130,6 +198,19 @@ const char *CircularBuffer::GetContiguiousReadableBuffer() const
 
 void CircularBuffer::IncrementContiguiousRead(size_t size)
 {
-    DBGASSERT(size <= std::min(in_ - out_, size_ - (out_ & (size_ - 1))));
+    DBGASSERT(size <= GetContiguiousReadableSpace());
     out_ += size;
 }
+
+size_t CircularBuffer::GetWrappedReadableSpace() const
+{
+    if (is_mirrored_) {
+        return 0;
+    }
+    return in_ - out_ - std::min(in_ - out_, size_ - (out_ & (size_ - 1)));
+}
+
+const char *CircularBuffer::GetWrappedReadableBuffer() const
+{
+    return base_;
+}
@@ -5,11 +5,15 @@
 
 // be useful for:
 // single producer, single consumer.
+//
+// a mirrored buffer maps its pages twice back to back, so all of the
+// readable or writable data is one contiguous span.  it falls back to a
+// plain one, with a warning, where the pages can not be mapped so.
 
 class CircularBuffer : public noncopyable
 {
 public:
-    CircularBuffer(size_t size);
+    CircularBuffer(size_t size, bool is_mirrored = false);
     ~CircularBuffer();
 
     bool IsEmpty() const;
@@ -23,7 +27,7 @@ public:
     size_t Read(char *data, size_t size);
 
     size_t Remove(size_t size);
-    size_t Peek(char *data, size_t size) const;
+    size_t Peek(char *data, size_t size, size_t offset = 0) const;
 
     size_t GetContiguiousWritableSpace() const;
     char *GetContiguiousWritableBuffer() const;
@@ -33,9 +37,21 @@ public:
     const char *GetContiguiousReadableBuffer() const;
     void IncrementContiguiousRead(size_t size);
 
+    size_t GetWrappedReadableSpace() const;
+    const char *GetWrappedReadableBuffer() const;
+
+    char *GetBuffer() const { return base_; }
+    size_t GetSize() const { return size_; }
+    size_t GetMappedSize() const { return is_mirrored_ ? size_ * 2 : size_; }
+    bool IsMirrored() const { return is_mirrored_; }
+
 private:
-    char * const base_;
+    static char *NewMirroredBuffer(size_t size);
+    static void DeleteMirroredBuffer(char *base, size_t size);
+
+    char *base_;
     size_t const size_;
+    bool const is_mirrored_;
 
     size_t in_;
     size_t out_;
@@ -1,30 +1,48 @@
 #include "Connection.h"
 #include "ConnectionManager.h"
+#include "TcpTransport.h"
+#include "ShmTransport.h"
+#include "UringTransport.h"
+#include "UdpTransport.h"
 #include "Session.h"
 #include "System.h"
 #include "Logger.h"
+#include <random>
 
-Connection::Connection(boost::asio::io_service &io_service,
+Connection::Connection(boost::asio::io_service &io_service, size_t worker_index,
     ConnectionManager &manager, Session &session, int load_value)
 : load_value_(load_value)
+, worker_index_(worker_index)
 , manager_(manager)
+, is_managed_(false)
 , session_(session)
 , is_active_(false)
-, resolver_(io_service)
-, sock_(io_service)
+, io_service_(io_service)
 , port_(0)
 , is_connected_(false)
 , first_send_pipe_(nullptr)
 , send_pipe_(nullptr)
 , recv_pipe_(nullptr)
+, is_gather_write_(false)
+, flush_bytes_(0)
+, flush_delay_us_(0)
+, flush_timer_(io_service)
 , is_reading_{ATOMIC_FLAG_INIT}
 , is_writing_{ATOMIC_FLAG_INIT}
+, is_corked_{ATOMIC_FLAG_INIT}
 , last_recv_data_time_(GET_APP_TIME)
 , last_send_data_time_(GET_APP_TIME)
+, write_size_(0)
 {
     send_pipe_ = first_send_pipe_ = new SendDataFirstPipe(is_active_);
-    recv_pipe_ = new RecvDataLastPipe(std::bind(&Session::PushRecvPacket,
-        std::ref(session), std::placeholders::_1), is_active_);
+    auto receiver = std::bind(&Connection::OnRecvPacket,
+        this, std::placeholders::_1);
+    if (session.IsZeroCopyRecvPacket()) {
+        recv_pipe_ = new RecvDataSlabPipe(receiver, is_active_);
+    } else {
+        recv_pipe_ = new RecvDataLastPipe(
+            receiver, is_active_, session.IsMirroredRecvBuffer());
+    }
 }
 
 Connection::~Connection()
@@ -51,6 +69,13 @@ void Connection::AddDataPipe(ISendDataPipe *send_pipe, IRecvDataPipe *recv_pipe)
     }
 }
 
+void Connection::GetStats(ConnectionStats &stats) const
+{
+    counter_.Snapshot(stats);
+    GetSendPipeStats(stats.send_pipe);
+    GetRecvPipeStats(stats.recv_pipe);
+}
+
 void Connection::Close()
 {
     if (is_active_) {
@@ -62,43 +87,131 @@ void Connection::Close()
             session_.KillSession();
         }
 
-        sock_.close();
+        boost::system::error_code ec;
+        flush_timer_.cancel(ec);
+        if (transport_) {
+            transport_->Close();
+        }
     }
 }
 
 void Connection::SetSocket(const boost::asio::ip::tcp::socket::protocol_type &protocol, SOCKET socket)
 {
     is_active_ = is_connected_ = true;
-    sock_.assign(protocol, socket);
-    sock_.non_blocking(true);
-    sock_.set_option(boost::asio::ip::tcp::no_delay(true));
-    RenewRemoteEndpoint();
+    TcpTransport *transport = NewStreamTransport<TcpTransport>();
+    transport_.reset(transport);
+    transport->Assign(protocol, socket);
+}
+
+bool Connection::SetUdpSocket(const boost::asio::ip::udp::socket::protocol_type &protocol,
+    SOCKET socket, uint32 conv, const char *hello, size_t size)
+{
+    is_active_ = is_connected_ = true;
+    UdpTransport *transport = new UdpTransport(*this, conv);
+    transport_.reset(transport);
+    return transport->Assign(protocol, socket, hello, size);
+}
+
+void Connection::AsyncConnectUdp(const std::string &address, const std::string &port)
+{
+    std::random_device random;
+    Connect(new UdpTransport(*this, random() | 1), address, port);
+}
+
+void Connection::SetUnixSocket(SOCKET socket, const std::string &path)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    is_active_ = is_connected_ = true;
+    addr_ = UNIX_ADDRESS_PREFIX + path;
+    port_ = 0;
+    UnixTransport *transport = NewStreamTransport<UnixTransport>();
+    transport_.reset(transport);
+    transport->Assign(socket);
+#endif
+}
+
+bool Connection::IsUnixAddress(const std::string &address)
+{
+    return address.compare(0, strlen(UNIX_ADDRESS_PREFIX), UNIX_ADDRESS_PREFIX) == 0;
+}
+
+void Connection::SetShmSocket(SOCKET socket, const std::string &path)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    is_active_ = is_connected_ = true;
+    addr_ = SHM_ADDRESS_PREFIX + path;
+    port_ = 0;
+    ShmTransport *transport = new ShmTransport(*this);
+    transport_.reset(transport);
+    transport->Assign(socket);
+#endif
+}
+
+bool Connection::IsShmAddress(const std::string &address)
+{
+    return address.compare(0, strlen(SHM_ADDRESS_PREFIX), SHM_ADDRESS_PREFIX) == 0;
 }
 
 void Connection::AsyncConnect(const std::string &address, const std::string &port)
+{
+    if (IsUnixAddress(address) || IsShmAddress(address)) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        if (IsShmAddress(address)) {
+            Connect(new ShmTransport(*this), address, port);
+        } else {
+            Connect(NewStreamTransport<UnixTransport>(), address, port);
+        }
+#else
+        is_active_ = true;
+        addr_ = address;
+        WLOG("Connect connection[%s], unix domain sockets unsupported.", addr_.c_str());
+        Close();
+#endif
+        return;
+    }
+    Connect(NewStreamTransport<TcpTransport>(), address, port);
+}
+
+void Connection::Connect(ConnectionTransport *transport, const std::string &address, const std::string &port)
 {
     is_active_ = true;
     addr_ = address;
     port_ = atoi(port.c_str());
+    transport_.reset(transport);
+    transport_->AsyncConnect(address, port);
+}
 
-    boost::asio::ip::tcp::resolver::query query(address, port);
-    resolver_.async_resolve(query,
-        std::bind(&Connection::OnResolveComplete, shared_from_this(),
-                  std::placeholders::_1, std::placeholders::_2));
+// io_uring takes over the socket calls where the worker runs one.
+template <typename Transport>
+Transport *Connection::NewStreamTransport()
+{
+    UringService *uring = sIOServiceManager.GetUringService(worker_index_);
+    if (uring != nullptr) {
+        return new UringTransport<Transport>(*this, *uring);
+    }
+    return new Transport(*this);
 }
 
 void Connection::PostReadRequest()
 {
     if (!is_reading_.test_and_set()) {
-        sock_.get_io_service().post(
+        io_service_.post(
             std::bind(&Connection::StartNextRead, shared_from_this()));
     }
 }
 
 void Connection::PostWriteRequest()
 {
+    const size_t flush_bytes = flush_bytes_.load();
+    if (flush_bytes != 0 && GetSendDataSize() < flush_bytes) {
+        if (IsConnected() && !is_corked_.test_and_set()) {
+            io_service_.post(
+                std::bind(&Connection::StartFlushTimer, shared_from_this()));
+        }
+        return;
+    }
     if (IsConnected() && !is_writing_.test_and_set()) {
-        sock_.get_io_service().post(
+        io_service_.post(
             std::bind(&Connection::StartNextWrite, shared_from_this()));
     }
 }
@@ -106,7 +219,7 @@ void Connection::PostWriteRequest()
 void Connection::PostCloseRequest()
 {
     if (IsActive()) {
-        sock_.get_io_service().post(
+        io_service_.post(
             std::bind(&Connection::Close, shared_from_this()));
     }
 }
@@ -119,11 +232,7 @@ void Connection::StartNextRead()
             return;
         }
 
-        size_t size = 0;
-        char *buffer = recv_pipe_->GetRecvDataBuffer(size);
-        sock_.async_read_some(boost::asio::buffer(buffer, size),
-            std::bind(&Connection::OnReadComplete, shared_from_this(),
-                      std::placeholders::_1, buffer, std::placeholders::_2));
+        transport_->StartNextRead();
 
     } TRY_END
     CATCH_BEGIN(const boost::system::system_error &e) {
@@ -149,18 +258,7 @@ void Connection::StartNextWrite()
             return;
         }
 
-        size_t size = 0;
-        const char *buffer = send_pipe_->GetSendDataBuffer(size);
-        if (buffer != nullptr && size != 0) {
-            sock_.async_write_some(boost::asio::buffer(buffer, size),
-                std::bind(&Connection::OnWriteComplete, shared_from_this(),
-                          std::placeholders::_1, buffer, std::placeholders::_2));
-        } else {
-            is_writing_.clear();
-            if (HasSendDataAwaiting() && !is_writing_.test_and_set()) {
-                StartNextWrite();
-            }
-        }
+        transport_->StartNextWrite();
 
     } TRY_END
     CATCH_BEGIN(const boost::system::system_error &e) {
@@ -178,7 +276,7 @@ void Connection::StartNextWrite()
     } CATCH_END
 }
 
-void Connection::OnResolveComplete(const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator itr)
+void Connection::StartFlushTimer()
 {
     TRY_BEGIN {
 
@@ -186,71 +284,56 @@ void Connection::OnResolveComplete(const boost::system::error_code &ec, boost::a
             return;
         }
 
-        if (ec) {
-            WLOG("Resolve connection[%s:%hu], %s.", addr_.c_str(), port_, ec.message().c_str());
-            Close();
-            return;
-        }
-
-        last_recv_data_time_ = GET_APP_TIME;
-        last_send_data_time_ = GET_APP_TIME;
-        sock_.async_connect(*itr,
-            std::bind(&Connection::OnConnectComplete, shared_from_this(),
+        flush_timer_.expires_from_now(std::chrono::microseconds(flush_delay_us_.load()));
+        flush_timer_.async_wait(
+            std::bind(&Connection::OnFlushTimeout, shared_from_this(),
                       std::placeholders::_1));
 
     } TRY_END
     CATCH_BEGIN(const boost::system::system_error &e) {
-        WLOG("OnResolveComplete[%s:%hu] exception[%s] occurred.", addr_.c_str(), port_, e.what());
+        WLOG("StartFlushTimer[%s:%hu] exception[%s] occurred.", addr_.c_str(), port_, e.what());
         Close();
     } CATCH_END
     CATCH_BEGIN(const IException &e) {
-        WLOG("OnResolveComplete[%s:%hu] exception occurred.", addr_.c_str(), port_);
+        WLOG("StartFlushTimer[%s:%hu] exception occurred.", addr_.c_str(), port_);
         e.Print();
         Close();
     } CATCH_END
     CATCH_BEGIN(...) {
-        WLOG("OnResolveComplete[%s:%hu] unknown exception occurred.", addr_.c_str(), port_);
+        WLOG("StartFlushTimer[%s:%hu] unknown exception occurred.", addr_.c_str(), port_);
         Close();
     } CATCH_END
 }
 
-void Connection::OnConnectComplete(const boost::system::error_code &ec)
+// writing is claimed here again, the claim was released before.
+void Connection::PostNextWrite()
 {
-    TRY_BEGIN {
-
-        if (!IsActive()) {
-            return;
-        }
+    if (HasSendDataAwaiting() && !is_writing_.test_and_set()) {
+        io_service_.post(
+            std::bind(&Connection::StartNextWrite, shared_from_this()));
+    }
+}
 
-        if (ec) {
-            WLOG("Connect connection[%s:%hu], %s.", addr_.c_str(), port_, ec.message().c_str());
-            Close();
-            return;
-        }
+void Connection::OnConnected()
+{
+    last_recv_data_time_ = GET_APP_TIME;
+    last_send_data_time_ = GET_APP_TIME;
+    is_connected_ = true;
+    PostReadRequest();
+    PostWriteRequest();
+    session_.OnConnected();
+}
 
-        last_recv_data_time_ = GET_APP_TIME;
-        last_send_data_time_ = GET_APP_TIME;
-        is_connected_ = true;
-        sock_.non_blocking(true);
-        sock_.set_option(boost::asio::ip::tcp::no_delay(true));
-        PostReadRequest();
-        PostWriteRequest();
-        session_.OnConnected();
+void Connection::OnFlushTimeout(const boost::system::error_code &ec)
+{
+    if (!IsActive() || ec) {
+        return;
+    }
 
-    } TRY_END
-    CATCH_BEGIN(const boost::system::system_error &e) {
-        WLOG("OnConnectComplete[%s:%hu] exception[%s] occurred.", addr_.c_str(), port_, e.what());
-        Close();
-    } CATCH_END
-    CATCH_BEGIN(const IException &e) {
-        WLOG("OnConnectComplete[%s:%hu] exception occurred.", addr_.c_str(), port_);
-        e.Print();
-        Close();
-    } CATCH_END
-    CATCH_BEGIN(...) {
-        WLOG("OnConnectComplete[%s:%hu] unknown exception occurred.", addr_.c_str(), port_);
-        Close();
-    } CATCH_END
+    is_corked_.clear();
+    if (IsConnected() && !is_writing_.test_and_set()) {
+        StartNextWrite();
+    }
 }
 
 void Connection::OnReadComplete(const boost::system::error_code &ec, const char *buffer, std::size_t bytes)
@@ -268,6 +351,9 @@ void Connection::OnReadComplete(const boost::system::error_code &ec, const char
         }
 
         last_recv_data_time_ = GET_APP_TIME;
+        if (NetworkStats::IsEnabled()) {
+            DataPipeCounter::Add(counter_.bytes_recv, bytes);
+        }
         OnRecvDataCallback(buffer, bytes);
         StartNextRead();
 
@@ -302,6 +388,13 @@ void Connection::OnWriteComplete(const boost::system::error_code &ec, const char
         }
 
         last_send_data_time_ = GET_APP_TIME;
+        if (NetworkStats::IsEnabled()) {
+            DataPipeCounter::Add(counter_.writes, 1);
+            DataPipeCounter::Add(counter_.bytes_sent, bytes);
+            if (bytes < write_size_) {
+                DataPipeCounter::Add(counter_.partial_writes, 1);
+            }
+        }
         OnSendDataCallback(buffer, bytes);
         StartNextWrite();
 
@@ -321,6 +414,21 @@ void Connection::OnWriteComplete(const boost::system::error_code &ec, const char
     } CATCH_END
 }
 
+void Connection::OnRecvPacket(INetPacket *pck)
+{
+    if (NetworkStats::IsEnabled()) {
+        DataPipeCounter::Add(counter_.packets_recv, 1);
+    }
+    if (pck->GetOpcode() == OPCODE_LARGE_PACKET) {
+        pck = fragment_assembler_.PushFragment(pck,
+            session_.overflow_packet_max_size(), session_.IsChunkedLargePacket());
+        if (pck == nullptr) {
+            return;
+        }
+    }
+    session_.PushRecvPacket(pck);
+}
+
 void Connection::OnRecvDataCallback(const char *buffer, size_t size)
 {
     size_t sizeCheck = 0;
@@ -330,12 +438,27 @@ void Connection::OnRecvDataCallback(const char *buffer, size_t size)
     }
 
     recv_pipe_->IncrementRecvData(size);
+
+    // recv pipes may queue replies of their own, such as handshakes.
+    if (HasSendDataAwaiting()) {
+        PostWriteRequest();
+    }
 }
 
 void Connection::OnSendDataCallback(const char *buffer, size_t size)
 {
     size_t sizeCheck = 0;
-    const char *bufferCheck = send_pipe_->GetSendDataBuffer(sizeCheck);
+    const char *bufferCheck = nullptr;
+    if (is_gather_write_) {
+        SendDataSpan spans[MAX_SEND_DATA_SPANS];
+        const size_t count = send_pipe_->GetSendDataBuffers(spans, ARRAY_SIZE(spans));
+        for (size_t i = 0; i < count; ++i) {
+            sizeCheck += spans[i].size;
+        }
+        bufferCheck = count != 0 ? spans[0].data : nullptr;
+    } else {
+        bufferCheck = send_pipe_->GetSendDataBuffer(sizeCheck);
+    }
     if (buffer != bufferCheck || size > sizeCheck) {
         THROW_EXCEPTION(SendDataException());
     }
@@ -343,22 +466,14 @@ void Connection::OnSendDataCallback(const char *buffer, size_t size)
     send_pipe_->RemoveSendData(size);
 }
 
-void Connection::RenewRemoteEndpoint()
-{
-    boost::system::error_code ec;
-    boost::asio::ip::tcp::endpoint endpoint = sock_.remote_endpoint(ec);
-    if (!ec) {
-        addr_ = endpoint.address().to_string();
-        port_ = endpoint.port();
-    }
-}
-
 void Connection::InitSendBufferPool()
 {
     SendBuffer::InitBufferPool();
+    RecvDataSlabPipe::InitSlabPool();
 }
 
 void Connection::ClearSendBufferPool()
 {
     SendBuffer::ClearBufferPool();
+    RecvDataSlabPipe::ClearSlabPool();
 }
@@ -2,6 +2,14 @@
 
 #include "AsioHeader.h"
 #include "IODataPipe.h"
+#include "NetworkStats.h"
+#include "FragmentAssembler.h"
+#include "ConnectionTransport.h"
+#include <list>
+#include <memory>
+
+#define UNIX_ADDRESS_PREFIX "unix:"
+#define SHM_ADDRESS_PREFIX "shm:"
 
 class ConnectionManager;
 class Session;
@@ -9,7 +17,7 @@ class Session;
 class Connection : public std::enable_shared_from_this<Connection>
 {
 public:
-    Connection(boost::asio::io_service &io_service,
+    Connection(boost::asio::io_service &io_service, size_t worker_index,
         ConnectionManager &manager, Session &session, int load_value);
     ~Connection();
 
@@ -21,8 +29,31 @@ public:
     void PostCloseRequest();
 
     void SetSocket(const boost::asio::ip::tcp::socket::protocol_type &protocol, SOCKET socket);
+    void SetGatherWrite(bool is_gather_write) { is_gather_write_ = is_gather_write; }
+    // hold writes until bytes are queued or delay_us elapses, 0 bytes disables.
+    void SetFlushPolicy(size_t bytes, uint64 delay_us) {
+        flush_delay_us_.store(delay_us), flush_bytes_.store(bytes);
+    }
     void AsyncConnect(const std::string &address, const std::string &port);
 
+    void SetUnixSocket(SOCKET socket, const std::string &path);
+    bool IsUnixSocket() const { return IsUnixAddress(addr_) || IsShmAddress(addr_); }
+    // "unix:/path" names a unix domain socket, the port is ignored then.
+    static bool IsUnixAddress(const std::string &address);
+
+    // "shm:/path" pairs two local processes through shared memory, set up
+    // over a unix domain socket at the path, the accepting side creates it.
+    void SetShmSocket(SOCKET socket, const std::string &path);
+    bool IsSharedMemory() const { return IsShmAddress(addr_); }
+    static bool IsShmAddress(const std::string &address);
+
+    // reliable udp instead of tcp, the socket is connected to the peer and
+    // hello is the datagram the listener took for it, false if it is not
+    // taken in by the conversation.
+    bool SetUdpSocket(const boost::asio::ip::udp::socket::protocol_type &protocol,
+        SOCKET socket, uint32 conv, const char *hello, size_t size);
+    void AsyncConnectUdp(const std::string &address, const std::string &port);
+
     bool IsActive() const { return is_active_; }
     bool IsConnected() const { return is_connected_; }
 
@@ -30,40 +61,63 @@ public:
     unsigned short port() const { return port_; }
 
     int get_load_value() const { return load_value_; }
-    boost::asio::io_service &get_io_service() { return sock_.get_io_service(); }
+    size_t get_worker_index() const { return worker_index_; }
+    boost::asio::io_service &get_io_service() { return io_service_; }
 
     bool HasSendDataAwaiting() const { return send_pipe_->HasSendDataAwaiting(); }
     size_t GetSendDataSize() const { return send_pipe_->GetSendDataSize(); }
 
     SendBuffer &GetSendBuffer() { return first_send_pipe_->GetBuffer(); }
 
+    void GetSendPipeStats(DataPipeStats &stats) const { send_pipe_->AccumulateStats(stats); }
+    void GetRecvPipeStats(DataPipeStats &stats) const { recv_pipe_->AccumulateStats(stats); }
+    // counters only move while NetworkStats is enabled.
+    void GetStats(ConnectionStats &stats) const;
+    ConnectionCounter &GetCounter() { return counter_; }
+
     static void InitSendBufferPool();
     static void ClearSendBufferPool();
 
 private:
+    friend class ConnectionManager;
+    friend class UdpTransport;
+    friend class TcpTransport;
+    friend class UnixTransport;
+    friend class ShmTransport;
+    template <typename Protocol> friend class StreamTransport;
+    template <typename Transport> friend class UringTransport;
+
     void Close();
 
     void StartNextRead();
     void StartNextWrite();
+    void StartFlushTimer();
+    void PostNextWrite();
+    void OnConnected();
 
-    void OnResolveComplete(const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator itr);
-    void OnConnectComplete(const boost::system::error_code &ec);
+    template <typename Transport>
+    Transport *NewStreamTransport();
+    void Connect(ConnectionTransport *transport, const std::string &address, const std::string &port);
     void OnReadComplete(const boost::system::error_code &ec, const char *buffer, std::size_t bytes);
     void OnWriteComplete(const boost::system::error_code &ec, const char *buffer, std::size_t bytes);
+    void OnFlushTimeout(const boost::system::error_code &ec);
+
+    void OnRecvPacket(INetPacket *pck);
 
     void OnRecvDataCallback(const char *buffer, size_t size);
     void OnSendDataCallback(const char *buffer, size_t size);
 
-    void RenewRemoteEndpoint();
-
     const int load_value_;
+    const size_t worker_index_;
 
     ConnectionManager &manager_;
+    // its node in the manager, removal needs no lookup.
+    std::list<std::shared_ptr<Connection>>::iterator manager_node_;
+    bool is_managed_;
     Session &session_;
     bool is_active_;
 
-    boost::asio::ip::tcp::resolver resolver_;
-    boost::asio::ip::tcp::socket sock_;
+    boost::asio::io_service &io_service_;
     std::string addr_;
     unsigned short port_;
     bool is_connected_;
@@ -71,7 +125,19 @@ private:
     SendDataFirstPipe *first_send_pipe_;
     ISendDataPipe *send_pipe_;
     IRecvDataPipe *recv_pipe_;
+    FragmentAssembler fragment_assembler_;
+
+    bool is_gather_write_;
 
-    std::atomic_flag is_reading_, is_writing_;
+    std::atomic<size_t> flush_bytes_;
+    std::atomic<uint64> flush_delay_us_;
+    boost::asio::steady_timer flush_timer_;
+
+    std::atomic_flag is_reading_, is_writing_, is_corked_;
     uint64 last_recv_data_time_, last_send_data_time_;
+
+    ConnectionCounter counter_;
+    size_t write_size_;
+
+    std::unique_ptr<ConnectionTransport> transport_;
 };
@@ -1,6 +1,7 @@
 #include "ConnectionManager.h"
 #include "IOServiceManager.h"
 #include "Session.h"
+#include <vector>
 
 ConnectionManager::ConnectionManager()
 {
@@ -12,9 +13,14 @@ ConnectionManager::~ConnectionManager()
 
 std::shared_ptr<Connection> ConnectionManager::NewConnection(Session &session)
 {
-    std::shared_ptr<Connection> connPtr =
-        std::make_shared<Connection>(sIOServiceManager.SelectWorkerLoadLowest(),
-            *this, session, session.GetConnectionLoadValue());
+    return NewConnection(session, sIOServiceManager.SelectWorkerIndexLoadLowest());
+}
+
+std::shared_ptr<Connection> ConnectionManager::NewConnection(Session &session, size_t worker_index)
+{
+    std::shared_ptr<Connection> connPtr = std::make_shared<Connection>(
+        sIOServiceManager.GetWorker(worker_index), worker_index,
+        *this, session, session.GetConnectionLoadValue());
     connPtr->Init();
     AddConnection(connPtr);
     return connPtr;
@@ -22,14 +28,56 @@ std::shared_ptr<Connection> ConnectionManager::NewConnection(Session &session)
 
 void ConnectionManager::AddConnection(const std::shared_ptr<Connection> &connPtr)
 {
-    connections_.Insert(connPtr);
+    Stripe &stripe = GetStripe(connPtr->get_worker_index());
+    do {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        if (connPtr->is_managed_) {
+            return;
+        }
+        connPtr->manager_node_ =
+            stripe.connections.insert(stripe.connections.end(), connPtr);
+        connPtr->is_managed_ = true;
+    } while (0);
     sIOServiceManager.AddWorkerLoadValue(
-        connPtr->get_io_service(), connPtr->get_load_value());
+        connPtr->get_worker_index(), connPtr->get_load_value());
 }
 
 void ConnectionManager::RemoveConnection(const std::shared_ptr<Connection> &connPtr)
 {
-    connections_.Remove(connPtr);
+    Stripe &stripe = GetStripe(connPtr->get_worker_index());
+    do {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        if (!connPtr->is_managed_) {
+            return;
+        }
+        stripe.connections.erase(connPtr->manager_node_);
+        connPtr->is_managed_ = false;
+    } while (0);
     sIOServiceManager.SubWorkerLoadValue(
-        connPtr->get_io_service(), connPtr->get_load_value());
+        connPtr->get_worker_index(), connPtr->get_load_value());
+}
+
+void ConnectionManager::ForEachConnection(
+    const std::function<void(const std::shared_ptr<Connection>&)> &func) const
+{
+    std::vector<std::shared_ptr<Connection>> connections;
+    for (const Stripe &stripe : stripes_) {
+        do {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            connections.assign(stripe.connections.begin(), stripe.connections.end());
+        } while (0);
+        for (const auto &connPtr : connections) {
+            func(connPtr);
+        }
+    }
+}
+
+size_t ConnectionManager::GetConnectionCount() const
+{
+    size_t count = 0;
+    for (const Stripe &stripe : stripes_) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        count += stripe.connections.size();
+    }
+    return count;
 }
@@ -1,9 +1,15 @@
 #pragma once
 
 #include "Singleton.h"
+#include <array>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include "Connection.h"
-#include "ThreadSafeSet.h"
+
+#define CONNECTION_MANAGER_STRIPE_COUNT (16)
+#define CONNECTION_MANAGER_CACHE_LINE (64)
 
 class ConnectionManager : public Singleton<ConnectionManager>
 {
@@ -12,11 +18,30 @@ public:
     virtual ~ConnectionManager();
 
     std::shared_ptr<Connection> NewConnection(Session &session);
+    std::shared_ptr<Connection> NewConnection(Session &session, size_t worker_index);
     void AddConnection(const std::shared_ptr<Connection> &connPtr);
     void RemoveConnection(const std::shared_ptr<Connection> &connPtr);
 
+    // a stripe is locked only while it is copied, func runs unlocked and
+    // connections may come and go meanwhile.
+    void ForEachConnection(const std::function<void(const std::shared_ptr<Connection>&)> &func) const;
+    size_t GetConnectionCount() const;
+
 private:
-    ThreadSafeSet<std::shared_ptr<Connection>> connections_;
+    // striped by worker, accepts and closes on one worker rarely wait
+    // for those of another.  the padding keeps neighbours off one cache
+    // line however the manager is allocated, new of c++11 ignores alignas.
+    struct Stripe {
+        mutable std::mutex mutex;
+        std::list<std::shared_ptr<Connection>> connections;
+        char padding[CONNECTION_MANAGER_CACHE_LINE];
+    };
+
+    Stripe &GetStripe(size_t worker_index) {
+        return stripes_[worker_index % CONNECTION_MANAGER_STRIPE_COUNT];
+    }
+
+    std::array<Stripe, CONNECTION_MANAGER_STRIPE_COUNT> stripes_;
 };
 
 #define sConnectionManager (*ConnectionManager::instance())
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "AsioHeader.h"
+#include <string>
+
+class Connection;
+
+// moves the bytes of a connection over one kind of link.  the connection
+// keeps the pipes, the session and the read and write claims, a transport
+// only owns its sockets and the state of its link.  its handlers hold the
+// connection, which owns the transport, so it outlives them.
+class ConnectionTransport
+{
+public:
+    ConnectionTransport(Connection &connection) : connection_(connection) {}
+    virtual ~ConnectionTransport() {}
+
+    // address and port as given to Connection::AsyncConnect, the transport
+    // calls Connection::OnConnected once the link is up.
+    virtual void AsyncConnect(const std::string &address, const std::string &port) = 0;
+
+    // both run on the io thread, a throw closes the connection.  writing is
+    // claimed for StartNextWrite, the transport releases the claim once it
+    // has nothing left in flight.
+    virtual void StartNextRead() = 0;
+    virtual void StartNextWrite() = 0;
+
+    virtual void Close() = 0;
+
+protected:
+    Connection &connection_;
+};
@@ -0,0 +1,71 @@
+#include "FragmentAssembler.h"
+#include <algorithm>
+#include <memory>
+
+FragmentAssembler::FragmentAssembler()
+{
+}
+
+FragmentAssembler::~FragmentAssembler()
+{
+    for (auto &pair : fragments_) {
+        delete pair.second.packet;
+    }
+}
+
+INetPacket *FragmentAssembler::PushFragment(INetPacket *pck, size_t max_size, bool is_chunked)
+{
+    std::unique_ptr<INetPacket> fragment(pck);
+    const bool is_last = pck->GetTotalSize() < INetPacket::MAX_BUFFER_SIZE;
+    const uint32 number = pck->Read<uint32>();
+
+    auto itr = fragments_.find(number);
+    if (itr == fragments_.end()) {
+        const uint32 len = pck->Read<uint32>();
+        const uint16 opcode = pck->Read<uint16>();
+        if (len < LARGE_PACKET_HEADER_SIZE ||
+            len - LARGE_PACKET_HEADER_SIZE > max_size ||
+            fragments_.size() >= FRAGMENT_MAX_ASSEMBLING_COUNT) {
+            THROW_EXCEPTION(NetStreamException());
+        }
+        const size_t size = len - LARGE_PACKET_HEADER_SIZE;
+        const size_t reserve = std::min(size, size_t(FRAGMENT_MAX_RESERVE_SIZE));
+        INetPacket *packet = nullptr;
+        if (is_chunked) {
+            packet = new ChunkNetPacket(opcode, reserve);
+        } else {
+            packet = size <= MAX_NET_PACKET_SIZE ?
+                INetPacket::New(opcode, size) : new NetPacket(opcode);
+            packet->Reserve(reserve);
+        }
+        itr = fragments_.emplace(number, Fragment{packet, size, is_chunked}).first;
+    }
+
+    Fragment &frag = itr->second;
+    if (pck->GetReadableSize() > frag.remain) {
+        THROW_EXCEPTION(NetStreamException());
+    }
+    frag.remain -= pck->GetReadableSize();
+    if (frag.is_chunked) {
+        static_cast<ChunkNetPacket*>(frag.packet)->AppendChunk(fragment.release());
+    } else {
+        frag.packet->Append(pck->GetReadableBuffer(), pck->GetReadableSize());
+    }
+
+    if (!is_last) {
+        return nullptr;
+    }
+    if (frag.remain != 0) {
+        THROW_EXCEPTION(NetStreamException());
+    }
+
+    INetPacket *packet = frag.packet;
+    fragments_.erase(itr);
+    return packet;
+}
+
+void FragmentAssembler::WritePacketHeader(INetPacket &pck, size_t size, uint32 opcode)
+{
+    pck.Write<uint32>(size + LARGE_PACKET_HEADER_SIZE);
+    pck.Write<uint16>(opcode);
+}
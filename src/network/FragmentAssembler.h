@@ -0,0 +1,33 @@
+#pragma once
+
+#include <unordered_map>
+#include "NetPacket.h"
+
+// the declared size is the peer's word, so at most this much is reserved
+// up front and the rest grows as fragments arrive.
+#define FRAGMENT_MAX_RESERVE_SIZE (1024*1024)
+#define FRAGMENT_MAX_ASSEMBLING_COUNT (16)
+
+// be useful for:
+// reassembling large packets, owned by one connection's read path.
+
+class FragmentAssembler
+{
+public:
+    FragmentAssembler();
+    ~FragmentAssembler();
+
+    // returns the whole packet once its last fragment arrived, or nullptr.
+    INetPacket *PushFragment(INetPacket *pck, size_t max_size, bool is_chunked);
+
+    static void WritePacketHeader(INetPacket &pck, size_t size, uint32 opcode);
+    static const size_t LARGE_PACKET_HEADER_SIZE = 4 + 2;
+
+private:
+    struct Fragment {
+        INetPacket *packet;
+        size_t remain;
+        bool is_chunked;
+    };
+    std::unordered_map<uint32, Fragment> fragments_;
+};
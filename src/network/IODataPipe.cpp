@@ -1,4 +1,20 @@
 #include "IODataPipe.h"
+#include "NetworkStats.h"
+#include "OS.h"
+
+static size_t GetReadableSpans(const CircularBuffer &buffer, SendDataSpan spans[], size_t count)
+{
+    size_t n = 0;
+    if (n < count && buffer.GetContiguiousReadableSpace() != 0) {
+        spans[n].data = buffer.GetContiguiousReadableBuffer();
+        spans[n++].size = buffer.GetContiguiousReadableSpace();
+    }
+    if (n < count && buffer.GetWrappedReadableSpace() != 0) {
+        spans[n].data = buffer.GetWrappedReadableBuffer();
+        spans[n++].size = buffer.GetWrappedReadableSpace();
+    }
+    return n;
+}
 
 SendDataFirstPipe::SendDataFirstPipe(const bool &active)
 {
@@ -10,6 +26,11 @@ const char *SendDataFirstPipe::GetSendDataBuffer(size_t &size)
     return buffer_.GetSendDataBuffer(size);
 }
 
+size_t SendDataFirstPipe::GetSendDataBuffers(SendDataSpan spans[], size_t count)
+{
+    return buffer_.GetSendDataBuffers(spans, count);
+}
+
 void SendDataFirstPipe::RemoveSendData(size_t size)
 {
     buffer_.RemoveSendData(size);
@@ -26,10 +47,10 @@ size_t SendDataFirstPipe::GetSendDataSize() const
 }
 
 
-RecvDataLastPipe::RecvDataLastPipe(
-    std::function<void(INetPacket*)> &&receiver, const bool &active)
+RecvDataLastPipe::RecvDataLastPipe(std::function<void(INetPacket*)> &&receiver,
+    const bool &active, bool is_mirrored)
 : receiver_(std::move(receiver))
-, buffer_(MAX_NET_PACKET_SIZE + 1)
+, buffer_(MAX_NET_PACKET_SIZE + 1, is_mirrored)
 {
     active_ = &active;
 }
@@ -59,11 +80,17 @@ INetPacket *RecvDataLastPipe::ReadPacketFromBuffer()
         return nullptr;
     }
 
+    // a mirrored buffer never splits a packet, it is parsed in place.
     INetPacket::Header header;
-    TNetPacket<INetPacket::Header::SIZE> wrapper;
-    wrapper.Erlarge(INetPacket::Header::SIZE);
-    buffer_.Peek((char*)wrapper.GetBuffer(), wrapper.GetTotalSize());
-    wrapper.ReadHeader(header);
+    if (buffer_.GetContiguiousReadableSpace() >= INetPacket::Header::SIZE) {
+        ConstNetPacket wrapper(buffer_.GetContiguiousReadableBuffer(), INetPacket::Header::SIZE);
+        wrapper.ReadHeader(header);
+    } else {
+        TNetPacket<INetPacket::Header::SIZE> wrapper;
+        wrapper.Erlarge(INetPacket::Header::SIZE);
+        buffer_.Peek((char*)wrapper.GetBuffer(), wrapper.GetTotalSize());
+        wrapper.ReadHeader(header);
+    }
     if (buffer_.GetReadableSpace() < header.len) {
         return nullptr;
     }
@@ -71,54 +98,270 @@ INetPacket *RecvDataLastPipe::ReadPacketFromBuffer()
     size_t size = header.len - INetPacket::Header::SIZE;
     INetPacket *pck = INetPacket::New(header.cmd, size);
     pck->Erlarge(size);
-    buffer_.Remove(INetPacket::Header::SIZE);
-    buffer_.Read((char*)pck->GetBuffer(), pck->GetTotalSize());
+    if (buffer_.GetContiguiousReadableSpace() >= header.len) {
+        memcpy((char*)pck->GetBuffer(), buffer_.GetContiguiousReadableBuffer() +
+            INetPacket::Header::SIZE, size);
+        buffer_.IncrementContiguiousRead(header.len);
+    } else {
+        buffer_.Remove(INetPacket::Header::SIZE);
+        buffer_.Read((char*)pck->GetBuffer(), pck->GetTotalSize());
+    }
     return pck;
 }
 
 
-SendDataZlibPipe::SendDataZlibPipe()
-: buffer_(1 << 16)
+#define MAX_RECV_DATA_SLAB_POOL_COUNT \
+    S_MAX_NET_PACKET_POOL_COUNT(RECV_DATA_SLAB_SIZE)
+
+static ThreadSafePool<void, MAX_RECV_DATA_SLAB_POOL_COUNT> s_slab_pool;
+static ThreadSafePool<void, MAX_NET_PACKET_POOL_COUNT> s_slab_packet_pool;
+
+struct RecvDataSlabPipe::DataSlab {
+    std::atomic<long> refs;
+    char buffer[RECV_DATA_SLAB_SIZE];
+    static DataSlab *New() {
+        void *slab = s_slab_pool.Get();
+        if (slab == nullptr) {
+            slab = ::operator new(sizeof(DataSlab));
+        }
+        DataSlab *self = (DataSlab*)slab;
+        new (&self->refs) std::atomic<long>(1);
+        return self;
+    }
+    void AddRef() {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    void Release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (!s_slab_pool.Put(this)) {
+                ::operator delete(this);
+            }
+        }
+    }
+    bool IsExclusive() const {
+        return refs.load(std::memory_order_acquire) == 1;
+    }
+};
+
+class RecvDataSlabPipe::SlabNetPacket : public INetPacket
+{
+public:
+    SlabNetPacket(uint32 opcode, DataSlab *slab, const char *data, size_t size)
+        : INetPacket(opcode)
+        , slab_(slab)
+    {
+        slab_->AddRef();
+        InitInternalBuffer((char*)data, size);
+        Erlarge(size);
+    }
+    virtual ~SlabNetPacket() {
+        slab_->Release();
+    }
+
+    static void *operator new(size_t size) {
+        void *pck = s_slab_packet_pool.Get();
+        if (pck == nullptr) {
+            pck = ::operator new(size);
+        }
+        return pck;
+    }
+    static void operator delete(void *pck) {
+        if (!s_slab_packet_pool.Put(pck)) {
+            ::operator delete(pck);
+        }
+    }
+
+private:
+    DataSlab * const slab_;
+};
+
+RecvDataSlabPipe::RecvDataSlabPipe(
+    std::function<void(INetPacket*)> &&receiver, const bool &active)
+: receiver_(std::move(receiver))
+, slab_(DataSlab::New())
+, rpos_(0)
+, wpos_(0)
+{
+    active_ = &active;
+}
+
+RecvDataSlabPipe::~RecvDataSlabPipe()
+{
+    slab_->Release();
+}
+
+char *RecvDataSlabPipe::GetRecvDataBuffer(size_t &size)
+{
+    size = RECV_DATA_SLAB_SIZE - wpos_;
+    return slab_->buffer + wpos_;
+}
+
+void RecvDataSlabPipe::IncrementRecvData(size_t size)
+{
+    wpos_ += size;
+    while (IsActive()) {
+        INetPacket *pck = ReadPacketFromSlab();
+        if (pck != nullptr) {
+            receiver_(pck);
+        } else {
+            break;
+        }
+    }
+    RenewSlab();
+}
+
+INetPacket *RecvDataSlabPipe::ReadPacketFromSlab()
+{
+    if (wpos_ - rpos_ < INetPacket::Header::SIZE) {
+        return nullptr;
+    }
+
+    INetPacket::Header header;
+    ConstNetPacket wrapper(slab_->buffer + rpos_, INetPacket::Header::SIZE);
+    wrapper.ReadHeader(header);
+    if (wpos_ - rpos_ < header.len) {
+        return nullptr;
+    }
+
+    INetPacket *pck = new SlabNetPacket(header.cmd, slab_,
+        slab_->buffer + rpos_ + INetPacket::Header::SIZE,
+        header.len - INetPacket::Header::SIZE);
+    rpos_ += header.len;
+    return pck;
+}
+
+// The trailing partial packet is the only data ever copied, and only when
+// the slab can no longer hold a whole packet past the write position.
+void RecvDataSlabPipe::RenewSlab()
+{
+    if (rpos_ == wpos_ && slab_->IsExclusive()) {
+        rpos_ = wpos_ = 0;
+        return;
+    }
+    if (RECV_DATA_SLAB_SIZE - wpos_ > MAX_NET_PACKET_SIZE) {
+        return;
+    }
+    const size_t size = wpos_ - rpos_;
+    if (slab_->IsExclusive()) {
+        memmove(slab_->buffer, slab_->buffer + rpos_, size);
+    } else {
+        DataSlab *slab = DataSlab::New();
+        memcpy(slab->buffer, slab_->buffer + rpos_, size);
+        slab_->Release();
+        slab_ = slab;
+    }
+    rpos_ = 0, wpos_ = size;
+}
+
+void RecvDataSlabPipe::InitSlabPool()
+{
+}
+
+void RecvDataSlabPipe::ClearSlabPool()
+{
+    void *ptr = nullptr;
+    while ((ptr = s_slab_pool.Get()) != nullptr) {
+        ::operator delete(ptr);
+    }
+    while ((ptr = s_slab_packet_pool.Get()) != nullptr) {
+        ::operator delete(ptr);
+    }
+}
+
+enum {
+    ADAPTIVE_BLOCK_RAW,
+    ADAPTIVE_BLOCK_COMPRESSED,
+    ADAPTIVE_BLOCK_NONE = -1,
+};
+
+static const size_t ADAPTIVE_BLOCK_HEADER_SIZE = 1 + 2;
+static const size_t ADAPTIVE_BLOCK_SPACE = 1 << 15;
+
+// the clock costs a syscall, it is read only for coarse adaptive blocks or
+// while stats are gathered.
+class CpuTimeCounter {
+public:
+    CpuTimeCounter(std::atomic<uint64> &counter, bool is_adaptive)
+        : counter_(counter)
+        , is_timed_(is_adaptive || NetworkStats::IsEnabled())
+        , start_(is_timed_ ? OS::thread_cpu_time_ns() : 0) {}
+    ~CpuTimeCounter() {
+        if (is_timed_) {
+            DataPipeCounter::Add(counter_, OS::thread_cpu_time_ns() - start_);
+        }
+    }
+private:
+    std::atomic<uint64> &counter_;
+    const bool is_timed_;
+    const uint64 start_;
+};
+
+SendDataCompressPipe::SendDataCompressPipe(bool is_adaptive, bool is_mirrored)
+: buffer_(1 << 16, is_mirrored)
 , flush_(true)
+, is_adaptive_(is_adaptive)
+, is_bypassing_(false)
+, bypass_blocks_(0)
+, block_(is_adaptive ? new char[ADAPTIVE_BLOCK_SPACE] : nullptr)
+{
+}
+
+SendDataCompressPipe::~SendDataCompressPipe()
 {
+    delete[] block_;
 }
 
-const char *SendDataZlibPipe::GetSendDataBuffer(size_t &size)
+const char *SendDataCompressPipe::GetSendDataBuffer(size_t &size)
 {
-    Compress();
+    is_adaptive_ ? CompressAdaptive() : Compress();
     size = buffer_.GetContiguiousReadableSpace();
     return buffer_.GetContiguiousReadableBuffer();
 }
 
-void SendDataZlibPipe::RemoveSendData(size_t size)
+size_t SendDataCompressPipe::GetSendDataBuffers(SendDataSpan spans[], size_t count)
 {
-    buffer_.IncrementContiguiousRead(size);
+    is_adaptive_ ? CompressAdaptive() : Compress();
+    return GetReadableSpans(buffer_, spans, count);
 }
 
-bool SendDataZlibPipe::HasSendDataAwaiting() const
+void SendDataCompressPipe::RemoveSendData(size_t size)
+{
+    buffer_.Remove(size);
+}
+
+bool SendDataCompressPipe::HasSendDataAwaiting() const
 {
     return !buffer_.IsEmpty() || prev_->HasSendDataAwaiting();
 }
 
-size_t SendDataZlibPipe::GetSendDataSize() const
+size_t SendDataCompressPipe::GetSendDataSize() const
 {
     return buffer_.GetSafeDataSize() + prev_->GetSendDataSize();
 }
 
-void SendDataZlibPipe::Compress()
+void SendDataCompressPipe::AccumulateStats(DataPipeStats &stats) const
 {
+    stats_.Accumulate(stats);
+    ISendDataPipe::AccumulateStats(stats);
+}
+
+void SendDataCompressPipe::Compress()
+{
+    CpuTimeCounter _(stats_.cpu_time_ns, false);
     while (IsActive() && !buffer_.IsFull()) {
         size_t inlen = 0;
         const char *in = prev_->GetSendDataBuffer(inlen);
         if (in != nullptr && inlen != 0) {
             size_t outlen = buffer_.GetContiguiousWritableSpace();
             char *out = buffer_.GetContiguiousWritableBuffer();
-            if (compress_.Deflate(in, inlen, out, outlen)) {
+            if (CompressData(in, inlen, out, outlen)) {
                 if (inlen != 0) {
                     prev_->RemoveSendData(inlen);
+                    DataPipeCounter::Add(stats_.bytes_in, inlen);
                 }
                 if (outlen != 0) {
                     buffer_.IncrementContiguiousWritten(outlen);
+                    DataPipeCounter::Add(stats_.bytes_out, outlen);
                 }
                 flush_ = false;
             } else {
@@ -133,9 +376,10 @@ void SendDataZlibPipe::Compress()
         size_t availen = buffer_.GetContiguiousWritableSpace();
         char *out = buffer_.GetContiguiousWritableBuffer();
         auto outlen = availen;
-        if (compress_.Flush(out, outlen)) {
+        if (FlushData(out, outlen)) {
             if (outlen != 0) {
                 buffer_.IncrementContiguiousWritten(outlen);
+                DataPipeCounter::Add(stats_.bytes_out, outlen);
             }
             if (outlen < availen) {
                 flush_ = true;
@@ -146,39 +390,119 @@ void SendDataZlibPipe::Compress()
     }
 }
 
+// every block is flushed, so the peer decodes it without the raw ones.
+void SendDataCompressPipe::CompressAdaptive()
+{
+    while (IsActive() && buffer_.GetWritableSpace() >= ADAPTIVE_BLOCK_SPACE) {
+        size_t inlen = 0;
+        const char *in = prev_->GetSendDataBuffer(inlen);
+        if (in == nullptr || inlen == 0) {
+            break;
+        }
+
+        inlen = std::min(inlen, size_t(ADAPTIVE_COMPRESS_BLOCK_SIZE));
+        uint8 type = ADAPTIVE_BLOCK_RAW;
+        const char *data = in;
+        size_t size = inlen;
+        if (IsCompressWorthy(inlen)) {
+            CpuTimeCounter _(stats_.cpu_time_ns, true);
+            size = CompressBlock(in, inlen, block_, ADAPTIVE_BLOCK_SPACE);
+            is_bypassing_ = size * 100 > inlen * ADAPTIVE_COMPRESS_MAX_RATIO;
+            type = ADAPTIVE_BLOCK_COMPRESSED, data = block_;
+        } else {
+            DataPipeCounter::Add(stats_.bypass_bytes, inlen);
+        }
+
+        TNetPacket<ADAPTIVE_BLOCK_HEADER_SIZE> header;
+        header << type << (uint16)size;
+        buffer_.Write(header.GetBuffer(), header.GetTotalSize());
+        buffer_.Write(data, size);
+        prev_->RemoveSendData(inlen);
+        DataPipeCounter::Add(stats_.bytes_in, inlen);
+        DataPipeCounter::Add(stats_.bytes_out, header.GetTotalSize() + size);
+    }
+}
 
-RecvDataZlibPipe::RecvDataZlibPipe()
-: buffer_(1 << 16)
+// incompressible data is bypassed, and probed again now and then.
+bool SendDataCompressPipe::IsCompressWorthy(size_t size)
 {
+    if (size < ADAPTIVE_COMPRESS_MIN_SIZE) {
+        return false;
+    }
+    if (is_bypassing_ && ++bypass_blocks_ < ADAPTIVE_COMPRESS_PROBE_INTERVAL) {
+        return false;
+    }
+    bypass_blocks_ = 0;
+    return true;
 }
 
-char *RecvDataZlibPipe::GetRecvDataBuffer(size_t &size)
+size_t SendDataCompressPipe::CompressBlock(const char *in, size_t inlen, char *out, size_t outlen)
+{
+    size_t digest = inlen, size = outlen;
+    if (!CompressData(in, digest, out, size) || digest != inlen) {
+        THROW_EXCEPTION(SendDataException());
+    }
+    size_t availen = outlen - size, flushlen = availen;
+    if (!FlushData(out + size, flushlen) || flushlen >= availen) {
+        THROW_EXCEPTION(SendDataException());
+    }
+    size += flushlen;
+    if (size > UINT16_MAX) {
+        THROW_EXCEPTION(SendDataException());
+    }
+    return size;
+}
+
+
+RecvDataDecompressPipe::RecvDataDecompressPipe(bool is_adaptive, bool is_mirrored)
+: buffer_(1 << 16, is_mirrored)
+, is_adaptive_(is_adaptive)
+, block_type_(ADAPTIVE_BLOCK_NONE)
+, block_remain_(0)
+{
+}
+
+char *RecvDataDecompressPipe::GetRecvDataBuffer(size_t &size)
 {
     size = buffer_.GetContiguiousWritableSpace();
     return buffer_.GetContiguiousWritableBuffer();
 }
 
-void RecvDataZlibPipe::IncrementRecvData(size_t size)
+void RecvDataDecompressPipe::IncrementRecvData(size_t size)
 {
     buffer_.IncrementContiguiousWritten(size);
-    Decompress();
+    DataPipeCounter::Add(stats_.bytes_in, size);
+    is_adaptive_ ? DecompressAdaptive() : Decompress();
+}
+
+void RecvDataDecompressPipe::AccumulateStats(DataPipeStats &stats) const
+{
+    stats_.Accumulate(stats);
+    IRecvDataPipe::AccumulateStats(stats);
 }
 
-void RecvDataZlibPipe::Decompress()
+// a codec filling the whole output may hold more back, it is asked again
+// even after the input is used up.
+void RecvDataDecompressPipe::Decompress()
 {
-    while (IsActive() && !buffer_.IsEmpty()) {
+    CpuTimeCounter _(stats_.cpu_time_ns, false);
+    bool is_drained = false;
+    while (IsActive() && !(is_drained && buffer_.IsEmpty())) {
         size_t outlen = 0;
         char *out = next_->GetRecvDataBuffer(outlen);
         if (out != nullptr && outlen != 0) {
             size_t inlen = buffer_.GetContiguiousReadableSpace();
             const char *in = buffer_.GetContiguiousReadableBuffer();
-            if (decompress_.Inflate(in, inlen, out, outlen)) {
+            const size_t availen = outlen;
+            if (DecompressData(in, inlen, out, outlen)) {
                 if (inlen != 0) {
                     buffer_.IncrementContiguiousRead(inlen);
                 }
                 if (outlen != 0) {
                     next_->IncrementRecvData(outlen);
+                    DataPipeCounter::Add(stats_.bytes_out, outlen);
                 }
+                is_drained = outlen < availen;
             } else {
                 THROW_EXCEPTION(RecvDataException());
             }
@@ -186,111 +510,354 @@ void RecvDataZlibPipe::Decompress()
     }
 }
 
-SendDataLz4Pipe::SendDataLz4Pipe()
-: buffer_(1 << 16)
-, flush_(true)
+// a compressed block is done once its input is consumed and the codec
+// stops filling the whole output, raw data must not overtake it.
+void RecvDataDecompressPipe::DecompressAdaptive()
+{
+    while (IsActive()) {
+        if (block_type_ == ADAPTIVE_BLOCK_NONE) {
+            if (buffer_.GetReadableSpace() < ADAPTIVE_BLOCK_HEADER_SIZE) {
+                break;
+            }
+            TNetPacket<ADAPTIVE_BLOCK_HEADER_SIZE> header;
+            header.Erlarge(ADAPTIVE_BLOCK_HEADER_SIZE);
+            buffer_.Read((char*)header.GetBuffer(), header.GetTotalSize());
+            block_type_ = header.Read<uint8>();
+            block_remain_ = header.Read<uint16>();
+            if (block_type_ != ADAPTIVE_BLOCK_RAW &&
+                block_type_ != ADAPTIVE_BLOCK_COMPRESSED) {
+                THROW_EXCEPTION(RecvDataException());
+            }
+        }
+
+        size_t outlen = 0;
+        char *out = next_->GetRecvDataBuffer(outlen);
+        if (out == nullptr || outlen == 0) {
+            break;
+        }
+
+        size_t inlen = std::min(block_remain_, buffer_.GetContiguiousReadableSpace());
+        const char *in = buffer_.GetContiguiousReadableBuffer();
+        if (block_type_ == ADAPTIVE_BLOCK_RAW) {
+            if (block_remain_ != 0 && inlen == 0) {
+                break;
+            }
+            outlen = std::min(outlen, inlen);
+            memcpy(out, in, outlen);
+            inlen = outlen;
+            DataPipeCounter::Add(stats_.bypass_bytes, outlen);
+        } else {
+            if (block_remain_ != 0 && inlen == 0) {
+                break;
+            }
+            const size_t availen = outlen;
+            CpuTimeCounter _(stats_.cpu_time_ns, true);
+            if (!DecompressData(in, inlen, out, outlen)) {
+                THROW_EXCEPTION(RecvDataException());
+            }
+            if (block_remain_ == inlen && outlen < availen) {
+                block_type_ = ADAPTIVE_BLOCK_NONE;
+            }
+        }
+
+        if (inlen != 0) {
+            buffer_.IncrementContiguiousRead(inlen);
+            block_remain_ -= inlen;
+        }
+        if (block_type_ == ADAPTIVE_BLOCK_RAW && block_remain_ == 0) {
+            block_type_ = ADAPTIVE_BLOCK_NONE;
+        }
+        if (outlen != 0) {
+            next_->IncrementRecvData(outlen);
+            DataPipeCounter::Add(stats_.bytes_out, outlen);
+        }
+    }
+}
+
+
+SendDataZlibPipe::SendDataZlibPipe(bool is_adaptive, bool is_mirrored)
+: SendDataCompressPipe(is_adaptive, is_mirrored)
+{
+}
+
+bool SendDataZlibPipe::CompressData(const char *in, size_t &inlen, char *out, size_t &outlen)
+{
+    return compress_.Deflate(in, inlen, out, outlen);
+}
+
+bool SendDataZlibPipe::FlushData(char *out, size_t &outlen)
+{
+    return compress_.Flush(out, outlen);
+}
+
+
+RecvDataZlibPipe::RecvDataZlibPipe(bool is_adaptive, bool is_mirrored)
+: RecvDataDecompressPipe(is_adaptive, is_mirrored)
+{
+}
+
+bool RecvDataZlibPipe::DecompressData(const char *in, size_t &inlen, char *out, size_t &outlen)
+{
+    return decompress_.Inflate(in, inlen, out, outlen);
+}
+
+
+SendDataLz4Pipe::SendDataLz4Pipe(bool is_adaptive,
+    std::shared_ptr<const lz4::Dictionary> dict, bool is_mirrored)
+: SendDataCompressPipe(is_adaptive, is_mirrored)
+, compress_(std::move(dict))
+{
+}
+
+bool SendDataLz4Pipe::CompressData(const char *in, size_t &inlen, char *out, size_t &outlen)
+{
+    return compress_.Compress(in, inlen, out, outlen);
+}
+
+bool SendDataLz4Pipe::FlushData(char *out, size_t &outlen)
+{
+    return compress_.Flush(out, outlen);
+}
+
+
+RecvDataLz4Pipe::RecvDataLz4Pipe(bool is_adaptive,
+    std::shared_ptr<const lz4::Dictionary> dict, bool is_mirrored)
+: RecvDataDecompressPipe(is_adaptive, is_mirrored)
+, decompress_(std::move(dict))
 {
 }
 
-const char *SendDataLz4Pipe::GetSendDataBuffer(size_t &size)
+bool RecvDataLz4Pipe::DecompressData(const char *in, size_t &inlen, char *out, size_t &outlen)
 {
-    Compress();
+    return decompress_.Decompress(in, inlen, out, outlen);
+}
+
+
+static const size_t CIPHER_HEADER_SIZE = 2;
+static const size_t CIPHER_RECORD_OVERHEAD = CIPHER_HEADER_SIZE + aead::TAG_SIZE;
+
+SendDataCipherPipe::SendDataCipherPipe(
+    std::shared_ptr<aead::Handshake> handshake, bool is_mirrored)
+: handshake_(std::move(handshake))
+, buffer_(1 << 16, is_mirrored)
+{
+}
+
+const char *SendDataCipherPipe::GetSendDataBuffer(size_t &size)
+{
+    Encrypt();
     size = buffer_.GetContiguiousReadableSpace();
     return buffer_.GetContiguiousReadableBuffer();
 }
 
-void SendDataLz4Pipe::RemoveSendData(size_t size)
+size_t SendDataCipherPipe::GetSendDataBuffers(SendDataSpan spans[], size_t count)
 {
-    buffer_.IncrementContiguiousRead(size);
+    Encrypt();
+    return GetReadableSpans(buffer_, spans, count);
 }
 
-bool SendDataLz4Pipe::HasSendDataAwaiting() const
+void SendDataCipherPipe::RemoveSendData(size_t size)
 {
-    return !buffer_.IsEmpty() || prev_->HasSendDataAwaiting();
+    buffer_.Remove(size);
 }
 
-size_t SendDataLz4Pipe::GetSendDataSize() const
+// application data is held back until the handshake has keyed us.
+bool SendDataCipherPipe::HasSendDataAwaiting() const
 {
-    return buffer_.GetSafeDataSize() + prev_->GetSendDataSize();
+    return !buffer_.IsEmpty() || handshake_->HasOutgoing() ||
+        (handshake_->IsDone() && prev_->HasSendDataAwaiting());
 }
 
-void SendDataLz4Pipe::Compress()
+size_t SendDataCipherPipe::GetSendDataSize() const
 {
-    while (IsActive() && !buffer_.IsFull()) {
-        size_t inlen = 0;
-        const char *in = prev_->GetSendDataBuffer(inlen);
-        if (in != nullptr && inlen != 0) {
-            size_t outlen = buffer_.GetContiguiousWritableSpace();
-            char *out = buffer_.GetContiguiousWritableBuffer();
-            if (compress_.Compress(in, inlen, out, outlen)) {
-                if (inlen != 0) {
-                    prev_->RemoveSendData(inlen);
-                }
-                if (outlen != 0) {
-                    buffer_.IncrementContiguiousWritten(outlen);
-                }
-                flush_ = false;
-            } else {
-                THROW_EXCEPTION(SendDataException());
-            }
-        } else {
+    return buffer_.GetSafeDataSize() +
+        (handshake_->IsDone() ? prev_->GetSendDataSize() : 0);
+}
+
+void SendDataCipherPipe::AccumulateStats(DataPipeStats &stats) const
+{
+    stats_.Accumulate(stats);
+    ISendDataPipe::AccumulateStats(stats);
+}
+
+void SendDataCipherPipe::Encrypt()
+{
+    if (handshake_->HasOutgoing()) {
+        const std::string message = handshake_->TakeOutgoing();
+        if (message.size() > CIPHER_HANDSHAKE_MAX_SIZE ||
+            buffer_.GetWritableSpace() < CIPHER_HEADER_SIZE + message.size()) {
+            THROW_EXCEPTION(SendDataException());
+        }
+        TNetPacket<CIPHER_HEADER_SIZE> header;
+        header << (uint16)message.size();
+        buffer_.Write(header.GetBuffer(), header.GetTotalSize());
+        buffer_.Write(message.data(), message.size());
+        DataPipeCounter::Add(stats_.bytes_out, header.GetTotalSize() + message.size());
+    }
+
+    if (!handshake_->IsDone()) {
+        return;
+    }
+
+    CpuTimeCounter _(stats_.cpu_time_ns, false);
+    while (IsActive() && buffer_.GetWritableSpace() > CIPHER_RECORD_OVERHEAD) {
+        SendDataSpan spans[MAX_SEND_DATA_SPANS];
+        const size_t count = prev_->GetSendDataBuffers(spans, ARRAY_SIZE(spans));
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size += spans[i].size;
+        }
+        size = std::min({size, size_t(CIPHER_RECORD_SIZE),
+                         buffer_.GetWritableSpace() - CIPHER_RECORD_OVERHEAD});
+        if (size == 0) {
             break;
         }
+        EncryptRecord(spans, size);
+        prev_->RemoveSendData(size);
+        DataPipeCounter::Add(stats_.bytes_in, size);
+        DataPipeCounter::Add(stats_.bytes_out, size + CIPHER_RECORD_OVERHEAD);
     }
+}
 
-    while (!flush_ && IsActive() && !buffer_.IsFull()) {
-        size_t availen = buffer_.GetContiguiousWritableSpace();
-        char *out = buffer_.GetContiguiousWritableBuffer();
-        auto outlen = availen;
-        if (compress_.Flush(out, outlen)) {
-            if (outlen != 0) {
-                buffer_.IncrementContiguiousWritten(outlen);
-            }
-            if (outlen < availen) {
-                flush_ = true;
+// spans are encrypted straight into the ring, split only where it wraps.
+void SendDataCipherPipe::EncryptRecord(const SendDataSpan spans[], size_t size)
+{
+    aead::Cipher &cipher = handshake_->GetSendCipher();
+    TNetPacket<CIPHER_HEADER_SIZE> header;
+    header << (uint16)size;
+    if (!cipher.Begin(header.GetBuffer(), header.GetTotalSize())) {
+        THROW_EXCEPTION(SendDataException());
+    }
+    buffer_.Write(header.GetBuffer(), header.GetTotalSize());
+
+    for (size_t i = 0; size != 0; ++i) {
+        const char *in = spans[i].data;
+        for (size_t n = std::min(size, spans[i].size); n != 0;) {
+            const size_t avail = std::min(n, buffer_.GetContiguiousWritableSpace());
+            if (!cipher.Update(in, buffer_.GetContiguiousWritableBuffer(), avail)) {
+                THROW_EXCEPTION(SendDataException());
             }
-        } else {
-            THROW_EXCEPTION(SendDataException());
+            buffer_.IncrementContiguiousWritten(avail);
+            in += avail, n -= avail, size -= avail;
         }
     }
+
+    char tag[aead::TAG_SIZE];
+    if (!cipher.Seal(tag)) {
+        THROW_EXCEPTION(SendDataException());
+    }
+    buffer_.Write(tag, sizeof(tag));
 }
 
 
-RecvDataLz4Pipe::RecvDataLz4Pipe()
-: buffer_(1 << 16)
+RecvDataCipherPipe::RecvDataCipherPipe(
+    std::shared_ptr<aead::Handshake> handshake, bool is_mirrored)
+: handshake_(std::move(handshake))
+, buffer_(1 << 16, is_mirrored)
+, plain_remain_(0)
 {
 }
 
-char *RecvDataLz4Pipe::GetRecvDataBuffer(size_t &size)
+char *RecvDataCipherPipe::GetRecvDataBuffer(size_t &size)
 {
     size = buffer_.GetContiguiousWritableSpace();
     return buffer_.GetContiguiousWritableBuffer();
 }
 
-void RecvDataLz4Pipe::IncrementRecvData(size_t size)
+void RecvDataCipherPipe::IncrementRecvData(size_t size)
 {
     buffer_.IncrementContiguiousWritten(size);
-    Decompress();
+    DataPipeCounter::Add(stats_.bytes_in, size);
+    Decrypt();
 }
 
-void RecvDataLz4Pipe::Decompress()
+void RecvDataCipherPipe::AccumulateStats(DataPipeStats &stats) const
 {
-    while (IsActive() && !buffer_.IsEmpty()) {
-        size_t outlen = 0;
-        char *out = next_->GetRecvDataBuffer(outlen);
-        if (out != nullptr && outlen != 0) {
-            size_t inlen = buffer_.GetContiguiousReadableSpace();
-            const char *in = buffer_.GetContiguiousReadableBuffer();
-            if (decompress_.Decompress(in, inlen, out, outlen)) {
-                if (inlen != 0) {
-                    buffer_.IncrementContiguiousRead(inlen);
-                }
-                if (outlen != 0) {
-                    next_->IncrementRecvData(outlen);
-                }
-            } else {
+    stats_.Accumulate(stats);
+    IRecvDataPipe::AccumulateStats(stats);
+}
+
+// a record is opened only once it has fully arrived, the plaintext is then
+// handed on from where it was decrypted, and its tag dropped last.
+void RecvDataCipherPipe::Decrypt()
+{
+    while (IsActive()) {
+        if (plain_remain_ != 0) {
+            size_t outlen = 0;
+            char *out = next_->GetRecvDataBuffer(outlen);
+            if (out == nullptr || outlen == 0) {
+                break;
+            }
+            outlen = buffer_.Read(out, std::min(outlen, plain_remain_));
+            plain_remain_ -= outlen;
+            if (plain_remain_ == 0) {
+                buffer_.Remove(aead::TAG_SIZE);
+            }
+            next_->IncrementRecvData(outlen);
+            DataPipeCounter::Add(stats_.bytes_out, outlen);
+            continue;
+        }
+
+        if (buffer_.GetReadableSpace() < CIPHER_HEADER_SIZE) {
+            break;
+        }
+        TNetPacket<CIPHER_HEADER_SIZE> header;
+        header.Erlarge(CIPHER_HEADER_SIZE);
+        buffer_.Peek((char*)header.GetBuffer(), header.GetTotalSize());
+        const size_t size = header.Read<uint16>();
+
+        if (!handshake_->IsDone()) {
+            if (size > CIPHER_HANDSHAKE_MAX_SIZE) {
                 THROW_EXCEPTION(RecvDataException());
             }
+            if (buffer_.GetReadableSpace() < CIPHER_HEADER_SIZE + size) {
+                break;
+            }
+            std::string message(size, '\0');
+            buffer_.Remove(CIPHER_HEADER_SIZE);
+            buffer_.Read(&message[0], size);
+            if (!handshake_->Feed(message.data(), message.size())) {
+                THROW_EXCEPTION(RecvDataException());
+            }
+            continue;
+        }
+
+        if (size == 0 || size > CIPHER_RECORD_SIZE) {
+            THROW_EXCEPTION(RecvDataException());
+        }
+        if (buffer_.GetReadableSpace() < size + CIPHER_RECORD_OVERHEAD) {
+            break;
+        }
+        DecryptRecord((const char *)header.GetBuffer(), size);
+        plain_remain_ = size;
+    }
+}
+
+// the ring owns its memory, so the record is decrypted in place.
+void RecvDataCipherPipe::DecryptRecord(const char *header, size_t size)
+{
+    CpuTimeCounter _(stats_.cpu_time_ns, false);
+    aead::Cipher &cipher = handshake_->GetRecvCipher();
+    if (!cipher.Begin(header, CIPHER_HEADER_SIZE)) {
+        THROW_EXCEPTION(RecvDataException());
+    }
+    buffer_.Remove(CIPHER_HEADER_SIZE);
+
+    char *data = const_cast<char*>(buffer_.GetContiguiousReadableBuffer());
+    const size_t n = std::min(size, buffer_.GetContiguiousReadableSpace());
+    if (!cipher.Update(data, data, n)) {
+        THROW_EXCEPTION(RecvDataException());
+    }
+    if (n < size) {
+        data = const_cast<char*>(buffer_.GetWrappedReadableBuffer());
+        if (!cipher.Update(data, data, size - n)) {
+            THROW_EXCEPTION(RecvDataException());
         }
     }
+
+    char tag[aead::TAG_SIZE];
+    buffer_.Peek(tag, sizeof(tag), size);
+    if (!cipher.Open(tag)) {
+        THROW_EXCEPTION(RecvDataException());
+    }
 }
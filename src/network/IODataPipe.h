@@ -4,6 +4,28 @@
 #include "CircularBuffer.h"
 #include "zlib/ZlibStream.h"
 #include "lz4/Lz4Stream.h"
+#include "openssl/CipherStream.h"
+
+struct DataPipeStats {
+    uint64 bytes_in = 0, bytes_out = 0;
+    uint64 bypass_bytes = 0, cpu_time_ns = 0;
+};
+
+// written by the io thread, read from anywhere.
+struct DataPipeCounter {
+    std::atomic<uint64> bytes_in{0}, bytes_out{0};
+    std::atomic<uint64> bypass_bytes{0}, cpu_time_ns{0};
+    void Accumulate(DataPipeStats &stats) const {
+        stats.bytes_in += bytes_in.load(std::memory_order_relaxed);
+        stats.bytes_out += bytes_out.load(std::memory_order_relaxed);
+        stats.bypass_bytes += bypass_bytes.load(std::memory_order_relaxed);
+        stats.cpu_time_ns += cpu_time_ns.load(std::memory_order_relaxed);
+    }
+    static void Add(std::atomic<uint64> &counter, uint64 value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+};
 
 class ISendDataPipe
 {
@@ -11,9 +33,13 @@ public:
     ISendDataPipe() : active_(nullptr), prev_(nullptr) {}
     virtual ~ISendDataPipe() { delete prev_; }
     virtual const char *GetSendDataBuffer(size_t &size) = 0;
+    virtual size_t GetSendDataBuffers(SendDataSpan spans[], size_t count) = 0;
     virtual void RemoveSendData(size_t size) = 0;
     virtual bool HasSendDataAwaiting() const = 0;
     virtual size_t GetSendDataSize() const = 0;
+    virtual void AccumulateStats(DataPipeStats &stats) const {
+        if (prev_ != nullptr) prev_->AccumulateStats(stats);
+    }
     bool IsActive() const { return *active_; }
     void Init(ISendDataPipe *prev) {
         prev_ = prev, active_ = prev->active_;
@@ -30,6 +56,11 @@ public:
     virtual ~IRecvDataPipe() { delete next_; }
     virtual char *GetRecvDataBuffer(size_t &size) = 0;
     virtual void IncrementRecvData(size_t size) = 0;
+    // the memory every recv data buffer lies in, if it never moves.
+    virtual bool GetRecvDataRegion(char *&data, size_t &size) const { return false; }
+    virtual void AccumulateStats(DataPipeStats &stats) const {
+        if (next_ != nullptr) next_->AccumulateStats(stats);
+    }
     bool IsActive() const { return *active_; }
     void Init(IRecvDataPipe *next) {
         next_ = next, active_ = next->active_;
@@ -45,6 +76,7 @@ class SendDataFirstPipe : public ISendDataPipe
 public:
     SendDataFirstPipe(const bool &active);
     virtual const char *GetSendDataBuffer(size_t &size);
+    virtual size_t GetSendDataBuffers(SendDataSpan spans[], size_t count);
     virtual void RemoveSendData(size_t size);
     virtual bool HasSendDataAwaiting() const;
     virtual size_t GetSendDataSize() const;
@@ -56,68 +88,191 @@ private:
 class RecvDataLastPipe : public IRecvDataPipe
 {
 public:
-    RecvDataLastPipe(
-        std::function<void(INetPacket*)> &&receiver, const bool &active);
+    RecvDataLastPipe(std::function<void(INetPacket*)> &&receiver,
+        const bool &active, bool is_mirrored = false);
     virtual char *GetRecvDataBuffer(size_t &size);
     virtual void IncrementRecvData(size_t size);
+    virtual bool GetRecvDataRegion(char *&data, size_t &size) const {
+        data = buffer_.GetBuffer(), size = buffer_.GetMappedSize();
+        return true;
+    }
 private:
     INetPacket *ReadPacketFromBuffer();
     const std::function<void(INetPacket*)> receiver_;
     CircularBuffer buffer_;
 };
 
+#define RECV_DATA_SLAB_SIZE (1 << 17)
+
+class RecvDataSlabPipe : public IRecvDataPipe
+{
+public:
+    RecvDataSlabPipe(
+        std::function<void(INetPacket*)> &&receiver, const bool &active);
+    virtual ~RecvDataSlabPipe();
+    virtual char *GetRecvDataBuffer(size_t &size);
+    virtual void IncrementRecvData(size_t size);
+    static void InitSlabPool();
+    static void ClearSlabPool();
+private:
+    struct DataSlab;
+    class SlabNetPacket;
+    INetPacket *ReadPacketFromSlab();
+    void RenewSlab();
+    const std::function<void(INetPacket*)> receiver_;
+    DataSlab *slab_;
+    size_t rpos_, wpos_;
+};
+
 
-class SendDataZlibPipe : public ISendDataPipe
+// adaptive framing: [type:1][len:2][data], raw blocks skip the codec.
+#define ADAPTIVE_COMPRESS_BLOCK_SIZE (16*1024)
+#define ADAPTIVE_COMPRESS_MIN_SIZE (256)
+#define ADAPTIVE_COMPRESS_MAX_RATIO (90)
+#define ADAPTIVE_COMPRESS_PROBE_INTERVAL (16)
+
+class SendDataCompressPipe : public ISendDataPipe
 {
 public:
-    SendDataZlibPipe();
+    SendDataCompressPipe(bool is_adaptive, bool is_mirrored);
+    virtual ~SendDataCompressPipe();
     virtual const char *GetSendDataBuffer(size_t &size);
+    virtual size_t GetSendDataBuffers(SendDataSpan spans[], size_t count);
     virtual void RemoveSendData(size_t size);
     virtual bool HasSendDataAwaiting() const;
     virtual size_t GetSendDataSize() const;
+    virtual void AccumulateStats(DataPipeStats &stats) const;
+protected:
+    virtual bool CompressData(const char *in, size_t &inlen, char *out, size_t &outlen) = 0;
+    virtual bool FlushData(char *out, size_t &outlen) = 0;
 private:
     void Compress();
-    zlib::DeflateStream compress_;
+    void CompressAdaptive();
+    bool IsCompressWorthy(size_t size);
+    size_t CompressBlock(const char *in, size_t inlen, char *out, size_t outlen);
     CircularBuffer buffer_;
     bool flush_;
+    const bool is_adaptive_;
+    bool is_bypassing_;
+    size_t bypass_blocks_;
+    char *block_;
+    DataPipeCounter stats_;
 };
 
-class RecvDataZlibPipe : public IRecvDataPipe
+class RecvDataDecompressPipe : public IRecvDataPipe
 {
 public:
-    RecvDataZlibPipe();
+    RecvDataDecompressPipe(bool is_adaptive, bool is_mirrored);
     virtual char *GetRecvDataBuffer(size_t &size);
     virtual void IncrementRecvData(size_t size);
+    virtual bool GetRecvDataRegion(char *&data, size_t &size) const {
+        data = buffer_.GetBuffer(), size = buffer_.GetMappedSize();
+        return true;
+    }
+    virtual void AccumulateStats(DataPipeStats &stats) const;
+protected:
+    virtual bool DecompressData(const char *in, size_t &inlen, char *out, size_t &outlen) = 0;
 private:
     void Decompress();
-    zlib::InflateStream decompress_;
+    void DecompressAdaptive();
     CircularBuffer buffer_;
+    const bool is_adaptive_;
+    int block_type_;
+    size_t block_remain_;
+    DataPipeCounter stats_;
 };
 
 
-class SendDataLz4Pipe : public ISendDataPipe
+class SendDataZlibPipe : public SendDataCompressPipe
 {
 public:
-    SendDataLz4Pipe();
+    SendDataZlibPipe(bool is_adaptive = false, bool is_mirrored = false);
+protected:
+    virtual bool CompressData(const char *in, size_t &inlen, char *out, size_t &outlen);
+    virtual bool FlushData(char *out, size_t &outlen);
+private:
+    zlib::DeflateStream compress_;
+};
+
+class RecvDataZlibPipe : public RecvDataDecompressPipe
+{
+public:
+    RecvDataZlibPipe(bool is_adaptive = false, bool is_mirrored = false);
+protected:
+    virtual bool DecompressData(const char *in, size_t &inlen, char *out, size_t &outlen);
+private:
+    zlib::InflateStream decompress_;
+};
+
+
+class SendDataLz4Pipe : public SendDataCompressPipe
+{
+public:
+    SendDataLz4Pipe(bool is_adaptive = false,
+        std::shared_ptr<const lz4::Dictionary> dict = nullptr,
+        bool is_mirrored = false);
+protected:
+    virtual bool CompressData(const char *in, size_t &inlen, char *out, size_t &outlen);
+    virtual bool FlushData(char *out, size_t &outlen);
+private:
+    lz4::CompressStream compress_;
+};
+
+class RecvDataLz4Pipe : public RecvDataDecompressPipe
+{
+public:
+    RecvDataLz4Pipe(bool is_adaptive = false,
+        std::shared_ptr<const lz4::Dictionary> dict = nullptr,
+        bool is_mirrored = false);
+protected:
+    virtual bool DecompressData(const char *in, size_t &inlen, char *out, size_t &outlen);
+private:
+    lz4::DecompressStream decompress_;
+};
+
+
+// add after the compression pipes, so records carry compressed data.
+// handshake messages are [len:2][data], then records [len:2][data][tag:16].
+#define CIPHER_RECORD_SIZE (16*1024)
+// bounds what an unauthenticated peer may make us buffer.
+#define CIPHER_HANDSHAKE_MAX_SIZE (4*1024)
+
+class SendDataCipherPipe : public ISendDataPipe
+{
+public:
+    SendDataCipherPipe(std::shared_ptr<aead::Handshake> handshake,
+        bool is_mirrored = false);
     virtual const char *GetSendDataBuffer(size_t &size);
+    virtual size_t GetSendDataBuffers(SendDataSpan spans[], size_t count);
     virtual void RemoveSendData(size_t size);
     virtual bool HasSendDataAwaiting() const;
     virtual size_t GetSendDataSize() const;
+    virtual void AccumulateStats(DataPipeStats &stats) const;
 private:
-    void Compress();
-    lz4::CompressStream compress_;
+    void Encrypt();
+    void EncryptRecord(const SendDataSpan spans[], size_t size);
+    const std::shared_ptr<aead::Handshake> handshake_;
     CircularBuffer buffer_;
-    bool flush_;
+    DataPipeCounter stats_;
 };
 
-class RecvDataLz4Pipe : public IRecvDataPipe
+class RecvDataCipherPipe : public IRecvDataPipe
 {
 public:
-    RecvDataLz4Pipe();
+    RecvDataCipherPipe(std::shared_ptr<aead::Handshake> handshake,
+        bool is_mirrored = false);
     virtual char *GetRecvDataBuffer(size_t &size);
     virtual void IncrementRecvData(size_t size);
+    virtual bool GetRecvDataRegion(char *&data, size_t &size) const {
+        data = buffer_.GetBuffer(), size = buffer_.GetMappedSize();
+        return true;
+    }
+    virtual void AccumulateStats(DataPipeStats &stats) const;
 private:
-    void Decompress();
-    lz4::DecompressStream decompress_;
+    void Decrypt();
+    void DecryptRecord(const char *header, size_t size);
+    const std::shared_ptr<aead::Handshake> handshake_;
     CircularBuffer buffer_;
+    size_t plain_remain_;
+    DataPipeCounter stats_;
 };
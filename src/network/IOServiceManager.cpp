@@ -1,8 +1,11 @@
 #include "IOServiceManager.h"
 #include "AsioWorkingThread.h"
+#include "UringService.h"
+#include "Logger.h"
 
 IOServiceManager::IOServiceManager()
 : worker_count_(1)
+, is_uring_enabled_(false)
 {
 }
 
@@ -18,11 +21,28 @@ bool IOServiceManager::Prepare()
         io_work_.push_back(new boost::asio::io_service::work(*io_service_[i]));
         PushThread(new AsioWorkingThread(*io_service_[i]));
     }
+    for (size_t i = 0; is_uring_enabled_ && i < worker_count_; ++i) {
+        boost::system::error_code ec;
+        uring_service_.push_back(new UringService(*io_service_[i]));
+        uring_service_.back()->Open(URING_DEFAULT_ENTRIES, ec);
+        if (ec) {
+            WLOG("io_uring unavailable, %s, fall back to asio.", ec.message().c_str());
+            for (auto uring_service : uring_service_) {
+                delete uring_service;
+            }
+            uring_service_.clear();
+            break;
+        }
+    }
     return true;
 }
 
 void IOServiceManager::Abort()
 {
+    // a waiting ring keeps its worker running, it is closed on its thread.
+    for (size_t i = 0; i < uring_service_.size(); ++i) {
+        io_service_[i]->post(std::bind(&UringService::Close, uring_service_[i]));
+    }
     for (auto io_work : io_work_) {
         delete io_work;
     }
@@ -31,6 +51,12 @@ void IOServiceManager::Abort()
 
 void IOServiceManager::Finish()
 {
+    // taken out first, connections closed from here on leave the rings be.
+    std::vector<UringService*> uring_services;
+    uring_services.swap(uring_service_);
+    for (auto uring_service : uring_services) {
+        delete uring_service;
+    }
     for (auto io_service : io_service_) {
         delete io_service;
     }
@@ -42,22 +68,25 @@ void IOServiceManager::Finish()
 }
 
 boost::asio::io_service &IOServiceManager::SelectWorkerLoadLowest() const
+{
+    return *io_service_[SelectWorkerIndexLoadLowest()];
+}
+
+size_t IOServiceManager::SelectWorkerIndexLoadLowest() const
 {
     auto itr = std::min_element(worker_load_.begin(), worker_load_.end(),
             [](const std::atomic_int *p1, const std::atomic_int *p2) {
         return p1->load() < p2->load();
     });
-    return *io_service_[itr - worker_load_.begin()];
+    return itr - worker_load_.begin();
 }
 
-void IOServiceManager::AddWorkerLoadValue(boost::asio::io_service &io_service, int value)
+void IOServiceManager::AddWorkerLoadValue(size_t index, int value)
 {
-    auto itr = std::find(io_service_.begin(), io_service_.end(), &io_service);
-    worker_load_[itr - io_service_.begin()]->fetch_add(value);
+    worker_load_[index]->fetch_add(value);
 }
 
-void IOServiceManager::SubWorkerLoadValue(boost::asio::io_service &io_service, int value)
+void IOServiceManager::SubWorkerLoadValue(size_t index, int value)
 {
-    auto itr = std::find(io_service_.begin(), io_service_.end(), &io_service);
-    worker_load_[itr - io_service_.begin()]->fetch_sub(value);
+    worker_load_[index]->fetch_sub(value);
 }
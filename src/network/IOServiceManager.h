@@ -5,6 +5,8 @@
 #include <atomic>
 #include "AsioHeader.h"
 
+class UringService;
+
 class IOServiceManager : public ThreadPool, public Singleton<IOServiceManager>
 {
 public:
@@ -12,10 +14,21 @@ public:
     virtual ~IOServiceManager();
 
     void SetWorkerCount(size_t count) { worker_count_ = count;}
+    // sockets read and write through io_uring, asio is kept where the
+    // kernel lacks it.
+    void SetUringEnabled(bool is_enabled) { is_uring_enabled_ = is_enabled; }
+    bool IsUringEnabled() const { return !uring_service_.empty(); }
+
+    size_t GetWorkerCount() const { return io_service_.size(); }
+    boost::asio::io_service &GetWorker(size_t index) const { return *io_service_[index]; }
+    UringService *GetUringService(size_t index) const {
+        return !uring_service_.empty() ? uring_service_[index] : nullptr;
+    }
 
     boost::asio::io_service &SelectWorkerLoadLowest() const;
-    void AddWorkerLoadValue(boost::asio::io_service &io_service, int value);
-    void SubWorkerLoadValue(boost::asio::io_service &io_service, int value);
+    size_t SelectWorkerIndexLoadLowest() const;
+    void AddWorkerLoadValue(size_t index, int value);
+    void SubWorkerLoadValue(size_t index, int value);
 
 private:
     virtual bool Prepare();
@@ -23,9 +36,11 @@ private:
     virtual void Finish();
 
     size_t worker_count_;
+    bool is_uring_enabled_;
     std::vector<std::atomic_int*> worker_load_;
     std::vector<boost::asio::io_service*> io_service_;
     std::vector<boost::asio::io_service::work*> io_work_;
+    std::vector<UringService*> uring_service_;
 };
 
 #define sIOServiceManager (*IOServiceManager::instance())
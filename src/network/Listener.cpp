@@ -1,11 +1,79 @@
 #include "Listener.h"
 #include "ConnectionManager.h"
 #include "SessionManager.h"
+#include "IOServiceManager.h"
 #include "Logger.h"
 #include "OS.h"
+#include <mutex>
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+// the descriptor belongs to its io thread, so it is closed there, but the
+// listener is let go at once, it may be gone by the time the close runs.
+class Listener::ReusePortAcceptor :
+    public std::enable_shared_from_this<ReusePortAcceptor>
+{
+public:
+    ReusePortAcceptor(Listener &listener, size_t worker_index, SOCKET sockfd)
+    : listener_(&listener)
+    , worker_index_(worker_index)
+    , io_service_(sIOServiceManager.GetWorker(worker_index))
+    , sockfd_(sockfd)
+    , descriptor_(io_service_, sockfd)
+    {}
+
+    void PostWaitRequest() {
+        descriptor_.async_read_some(boost::asio::null_buffers(),
+            std::bind(&ReusePortAcceptor::OnAcceptReady,
+                      shared_from_this(), std::placeholders::_1));
+    }
+    // waits for an accept running meanwhile.
+    void PostCloseRequest() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listener_ = nullptr;
+        io_service_.post(
+            std::bind(&ReusePortAcceptor::Close, shared_from_this()));
+    }
+
+private:
+    void OnAcceptReady(const boost::system::error_code &ec) {
+        if (ec || !descriptor_.is_open()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (listener_ == nullptr) {
+            return;
+        }
+        listener_->AcceptConnections(sockfd_, int(worker_index_));
+        PostWaitRequest();
+    }
+    void Close() {
+        boost::system::error_code ec;
+        descriptor_.close(ec);
+    }
+
+    std::mutex mutex_;
+    Listener *listener_;
+    const size_t worker_index_;
+    boost::asio::io_service &io_service_;
+    const SOCKET sockfd_;
+    boost::asio::posix::stream_descriptor descriptor_;
+};
+#else
+class Listener::ReusePortAcceptor
+{
+public:
+    void PostCloseRequest() {}
+};
+#endif
 
 Listener::Listener()
 : sockfd_(INVALID_SOCKET)
+, accept_mode_(AcceptLoadBalance)
+, is_shm_(false)
 {
 }
 
@@ -17,11 +85,22 @@ bool Listener::Prepare()
 {
     addr_ = GetBindAddress();
     port_ = GetBindPort();
+    accept_mode_ = GetAcceptMode();
     return true;
 }
 
 bool Listener::Initialize()
 {
+    if (Connection::IsUnixAddress(addr_) || Connection::IsShmAddress(addr_)) {
+        if (accept_mode_ == AcceptReusePort) {
+            WLOG("SO_REUSEPORT acceptors unsupported, fall back to load balance.");
+            accept_mode_ = AcceptLoadBalance;
+        }
+        is_shm_ = Connection::IsShmAddress(addr_);
+        sockfd_ = OpenUnixSocket(addr_.substr(addr_.find(':') + 1));
+        return sockfd_ != INVALID_SOCKET;
+    }
+
     struct addrinfo hints, *res;
     memset(&hints, 0, sizeof(hints));
     hints.ai_flags = 0;
@@ -35,58 +114,203 @@ bool Listener::Initialize()
     }
 
     std::unique_ptr<addrinfo, decltype(freeaddrinfo)*> _(res, freeaddrinfo);
-    sockfd_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sockfd_ == INVALID_SOCKET) {
+    if (accept_mode_ == AcceptReusePort) {
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+        for (size_t i = 0, n = sIOServiceManager.GetWorkerCount(); i < n; ++i) {
+            SOCKET sockfd = OpenSocket(res, true);
+            if (sockfd == INVALID_SOCKET) {
+                Finish();
+                return false;
+            }
+            acceptors_.push_back(
+                std::make_shared<ReusePortAcceptor>(*this, i, sockfd));
+        }
+        for (auto &acceptor : acceptors_) {
+            acceptor->PostWaitRequest();
+        }
+        return true;
+#else
+        WLOG("SO_REUSEPORT acceptors unsupported, fall back to load balance.");
+        accept_mode_ = AcceptLoadBalance;
+#endif
+    }
+
+    sockfd_ = OpenSocket(res, false);
+    return sockfd_ != INVALID_SOCKET;
+}
+
+void Listener::Kernel()
+{
+    if (accept_mode_ == AcceptReusePort) {
+        OS::SleepMS(100);
+        return;
+    }
+
+    struct pollfd sockfd;
+    sockfd.fd = sockfd_;
+    sockfd.events = POLLRDNORM;
+    int ret = poll(&sockfd, 1, 100);
+    if (ret == SOCKET_ERROR) {
+        ELOG("poll(), errno: %d.", GET_SOCKET_ERROR());
+        return;
+    }
+
+    if (ret == 0 || (sockfd.revents & POLLRDNORM) == 0) {
+        return;
+    }
+
+    AcceptConnections(sockfd_, -1);
+}
+
+void Listener::Finish()
+{
+    if (sockfd_ != INVALID_SOCKET) {
+        closesocket(sockfd_);
+        sockfd_ = INVALID_SOCKET;
+    }
+    for (auto &acceptor : acceptors_) {
+        acceptor->PostCloseRequest();
+    }
+    acceptors_.clear();
+    if (!unix_path_.empty()) {
+        unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+}
+
+SOCKET Listener::OpenSocket(const struct addrinfo *res, bool is_reuse_port)
+{
+    SOCKET sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sockfd == INVALID_SOCKET) {
         ELOG("socket(), errno: %d.", GET_SOCKET_ERROR());
-        return false;
+        return INVALID_SOCKET;
     }
 
-    if (!OS::non_blocking(sockfd_)) {
+    _defer_r(if (sockfd != INVALID_SOCKET) closesocket(sockfd));
+
+    if (!OS::non_blocking(sockfd)) {
         ELOG("non_blocking(), errno: %d.", GET_SOCKET_ERROR());
-        return false;
+        return INVALID_SOCKET;
     }
 
-    if (!OS::reuse_address(sockfd_)) {
+    if (!OS::reuse_address(sockfd)) {
         ELOG("reuse_address(), errno: %d.", GET_SOCKET_ERROR());
-        return false;
+        return INVALID_SOCKET;
+    }
+
+    if (is_reuse_port && !OS::reuse_port(sockfd)) {
+        ELOG("reuse_port(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
     }
 
-    ret = bind(sockfd_, res->ai_addr, res->ai_addrlen);
+    int ret = bind(sockfd, res->ai_addr, res->ai_addrlen);
     if (ret != 0) {
         ELOG("bind(), errno: %d.", GET_SOCKET_ERROR());
-        return false;
+        return INVALID_SOCKET;
     }
 
-    ret = listen(sockfd_, 5);
+    ret = listen(sockfd, 5);
     if (ret != 0) {
         ELOG("listen(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    SOCKET listenfd = sockfd;
+    sockfd = INVALID_SOCKET;
+    return listenfd;
+}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+// a socket file left by an instance gone refuses connections, only then is
+// it removed, anything else at the path is left alone.
+static bool RemoveStaleUnixSocket(const struct sockaddr_un &addr)
+{
+    struct stat st;
+    if (lstat(addr.sun_path, &st) != 0) {
+        return true;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        ELOG("unix socket path `%s` taken by a file.", addr.sun_path);
         return false;
     }
 
+    SOCKET sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd == INVALID_SOCKET) {
+        ELOG("socket(), errno: %d.", GET_SOCKET_ERROR());
+        return false;
+    }
+    OS::non_blocking(sockfd);
+    const int ret = connect(sockfd, (const struct sockaddr *)&addr, sizeof(addr));
+    const int error = ret != 0 ? GET_SOCKET_ERROR() : 0;
+    closesocket(sockfd);
+    if (error != ECONNREFUSED) {
+        ELOG("unix socket path `%s` in use, errno: %d.", addr.sun_path, error);
+        return false;
+    }
+
+    unlink(addr.sun_path);
     return true;
 }
+#endif
 
-void Listener::Kernel()
+SOCKET Listener::OpenUnixSocket(const std::string &path)
 {
-    struct pollfd sockfd;
-    sockfd.fd = sockfd_;
-    sockfd.events = POLLRDNORM;
-    int ret = poll(&sockfd, 1, 100);
-    if (ret == SOCKET_ERROR) {
-        ELOG("poll(), errno: %d.", GET_SOCKET_ERROR());
-        return;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        ELOG("unix socket path `%s` invalid.", path.c_str());
+        return INVALID_SOCKET;
     }
+    memcpy(addr.sun_path, path.data(), path.size());
 
-    if (ret == 0 || (sockfd.revents & POLLRDNORM) == 0) {
-        return;
+    SOCKET sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd == INVALID_SOCKET) {
+        ELOG("socket(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    _defer_r(if (sockfd != INVALID_SOCKET) closesocket(sockfd));
+
+    if (!OS::non_blocking(sockfd)) {
+        ELOG("non_blocking(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    if (!RemoveStaleUnixSocket(addr)) {
+        return INVALID_SOCKET;
+    }
+    int ret = bind(sockfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret != 0) {
+        ELOG("bind(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+    unix_path_ = path;
+
+    ret = listen(sockfd, 5);
+    if (ret != 0) {
+        ELOG("listen(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
     }
 
+    SOCKET listenfd = sockfd;
+    sockfd = INVALID_SOCKET;
+    return listenfd;
+#else
+    ELOG("unix domain sockets unsupported.");
+    return INVALID_SOCKET;
+#endif
+}
+
+void Listener::AcceptConnections(SOCKET listenfd, int worker_index)
+{
     while (true) {
         struct sockaddr_storage addr;
         socklen_t addrlen = sizeof(addr);
-        SOCKET sockfd = accept(sockfd_, (struct sockaddr *)&addr, &addrlen);
+        SOCKET sockfd = accept(listenfd, (struct sockaddr *)&addr, &addrlen);
         if (sockfd != INVALID_SOCKET) {
-            OnAcceptComplete(addr.ss_family, sockfd);
+            OnAcceptComplete(addr.ss_family, sockfd, worker_index);
         } else {
             if (GET_SOCKET_ERROR() != ERROR_WOULDBLOCK) {
                 ELOG("accept(), errno: %d.", GET_SOCKET_ERROR());
@@ -96,24 +320,27 @@ void Listener::Kernel()
     }
 }
 
-void Listener::Finish()
-{
-    if (sockfd_ != INVALID_SOCKET) {
-        closesocket(sockfd_);
-        sockfd_ = INVALID_SOCKET;
-    }
-}
-
-void Listener::OnAcceptComplete(int family, SOCKET sockfd)
+void Listener::OnAcceptComplete(int family, SOCKET sockfd, int worker_index)
 {
     Session *session = NewSessionObject();
-    std::shared_ptr<Connection> connPtr = sConnectionManager.NewConnection(*session);
+    std::shared_ptr<Connection> connPtr = worker_index >= 0 ?
+        sConnectionManager.NewConnection(*session, worker_index) :
+        sConnectionManager.NewConnection(*session);
     AddDataPipes(session);
 
-    const boost::asio::ip::tcp::socket::protocol_type protocol =
-        family == AF_INET ? boost::asio::ip::tcp::v4() : boost::asio::ip::tcp::v6();
-    connPtr->SetSocket(protocol, sockfd);
+    if (is_shm_) {
+        connPtr->SetShmSocket(sockfd, unix_path_);
+    } else if (!unix_path_.empty()) {
+        connPtr->SetUnixSocket(sockfd, unix_path_);
+    } else {
+        const boost::asio::ip::tcp::socket::protocol_type protocol =
+            family == AF_INET ? boost::asio::ip::tcp::v4() : boost::asio::ip::tcp::v6();
+        connPtr->SetSocket(protocol, sockfd);
+    }
 
     sSessionManager.AddSession(session);
     connPtr->PostReadRequest();
+    if (connPtr->HasSendDataAwaiting()) {
+        connPtr->PostWriteRequest();
+    }
 }
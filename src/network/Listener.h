@@ -2,6 +2,8 @@
 
 #include "Thread.h"
 #include "Macro.h"
+#include <memory>
+#include <vector>
 
 class ConnectionManager;
 class SessionManager;
@@ -12,6 +14,13 @@ class Listener : public Thread
 public:
     THREAD_RUNTIME(Listener)
 
+    enum AcceptMode {
+        // one acceptor, connections spread by worker load.
+        AcceptLoadBalance,
+        // one SO_REUSEPORT acceptor per io worker, spread by the kernel.
+        AcceptReusePort,
+    };
+
     Listener();
     virtual ~Listener();
 
@@ -21,17 +30,30 @@ protected:
     virtual void Kernel();
     virtual void Finish();
 
+    // "unix:/path" listens on a unix domain socket, "shm:/path" on one that
+    // pairs every connection through shared memory, the port is ignored then.
     virtual std::string GetBindAddress() = 0;
     virtual std::string GetBindPort() = 0;
+    virtual AcceptMode GetAcceptMode() { return AcceptLoadBalance; }
 
     virtual Session *NewSessionObject() = 0;
     virtual void AddDataPipes(Session *session) {}
 
 private:
-    void OnAcceptComplete(int family, SOCKET sockfd);
+    class ReusePortAcceptor;
+
+    SOCKET OpenSocket(const struct addrinfo *res, bool is_reuse_port);
+    SOCKET OpenUnixSocket(const std::string &path);
+    // a negative worker index selects the least loaded worker.
+    void AcceptConnections(SOCKET listenfd, int worker_index);
+    void OnAcceptComplete(int family, SOCKET sockfd, int worker_index);
 
     SOCKET sockfd_;
+    AcceptMode accept_mode_;
+    std::vector<std::shared_ptr<ReusePortAcceptor>> acceptors_;
 
     std::string addr_;
     std::string port_;
+    std::string unix_path_;
+    bool is_shm_;
 };
@@ -0,0 +1,126 @@
+#include "NetworkStats.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "System.h"
+#include "Logger.h"
+
+double ConnectionStats::GetSendCompressRatio() const
+{
+    return send_pipe.bytes_in != 0 ? double(send_pipe.bytes_out) / send_pipe.bytes_in : 1;
+}
+
+void ConnectionCounter::Snapshot(ConnectionStats &stats) const
+{
+    stats.bytes_recv = bytes_recv.load(std::memory_order_relaxed);
+    stats.bytes_sent = bytes_sent.load(std::memory_order_relaxed);
+    stats.packets_recv = packets_recv.load(std::memory_order_relaxed);
+    stats.packets_sent = packets_sent.load(std::memory_order_relaxed);
+    stats.writes = writes.load(std::memory_order_relaxed);
+    stats.partial_writes = partial_writes.load(std::memory_order_relaxed);
+    stats.send_queue_peak = send_queue_peak.load(std::memory_order_relaxed);
+}
+
+void OpcodeStats::Merge(const OpcodeStats &other)
+{
+    recv_count += other.recv_count, recv_bytes += other.recv_bytes;
+    send_count += other.send_count, send_bytes += other.send_bytes;
+    handle_time_ns += other.handle_time_ns;
+    for (size_t i = 0; i < NETWORK_STATS_TIME_BUCKETS; ++i) {
+        handle_time_hist[i] += other.handle_time_hist[i];
+    }
+}
+
+std::atomic<bool> NetworkStats::is_enabled_{false};
+
+static std::mutex s_opcode_mutex;
+static std::unordered_map<uint32, OpcodeStats> s_opcode_stats;
+
+struct ThreadOpcodeStats {
+    std::unordered_map<uint32, OpcodeStats> table;
+    uint64 merge_time = 0;
+    ~ThreadOpcodeStats() { Merge(); }
+    void Merge() {
+        if (!table.empty()) {
+            std::lock_guard<std::mutex> lock(s_opcode_mutex);
+            for (auto &pair : table) {
+                s_opcode_stats[pair.first].Merge(pair.second);
+            }
+        }
+        table.clear();
+        merge_time = GET_SYS_TIME;
+    }
+    OpcodeStats &Get(uint32 opcode) {
+        if (merge_time + NETWORK_STATS_MERGE_INTERVAL < GET_SYS_TIME) {
+            Merge();
+        }
+        return table[opcode];
+    }
+};
+
+static thread_local ThreadOpcodeStats t_opcode_stats;
+
+void NetworkStats::SetEnabled(bool is_enabled)
+{
+    is_enabled_.store(is_enabled, std::memory_order_relaxed);
+}
+
+uint64 NetworkStats::GetTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void NetworkStats::RecordRecvPacket(uint32 opcode, size_t size, uint64 handle_time_ns)
+{
+    OpcodeStats &stats = t_opcode_stats.Get(opcode);
+    stats.recv_count += 1, stats.recv_bytes += size;
+    stats.handle_time_ns += handle_time_ns;
+    size_t bucket = 0;
+    for (uint64 us = handle_time_ns / 1000; us != 0; us >>= 1) {
+        ++bucket;
+    }
+    stats.handle_time_hist[std::min(bucket, size_t(NETWORK_STATS_TIME_BUCKETS - 1))] += 1;
+}
+
+void NetworkStats::RecordSendPacket(uint32 opcode, size_t size)
+{
+    OpcodeStats &stats = t_opcode_stats.Get(opcode);
+    stats.send_count += 1, stats.send_bytes += size;
+}
+
+void NetworkStats::MergeThreadStats()
+{
+    t_opcode_stats.Merge();
+}
+
+std::unordered_map<uint32, OpcodeStats> NetworkStats::GetOpcodeStats()
+{
+    std::lock_guard<std::mutex> lock(s_opcode_mutex);
+    return s_opcode_stats;
+}
+
+void NetworkStats::ResetOpcodeStats()
+{
+    std::lock_guard<std::mutex> lock(s_opcode_mutex);
+    s_opcode_stats.clear();
+}
+
+void NetworkStats::LogOpcodeStats(size_t count)
+{
+    std::vector<std::pair<uint32, OpcodeStats>> stats;
+    for (auto &pair : GetOpcodeStats()) {
+        stats.push_back(pair);
+    }
+    std::sort(stats.begin(), stats.end(), [](
+        const std::pair<uint32, OpcodeStats> &a, const std::pair<uint32, OpcodeStats> &b) {
+        return a.second.recv_bytes + a.second.send_bytes > b.second.recv_bytes + b.second.send_bytes;
+    });
+    for (size_t i = 0, n = std::min(count, stats.size()); i < n; ++i) {
+        const OpcodeStats &s = stats[i].second;
+        NLOG("Opcode[%u] recv %llu/%llu bytes, send %llu/%llu bytes, handle %.3f ms avg %.1f us.",
+             stats[i].first, s.recv_count, s.recv_bytes, s.send_count, s.send_bytes,
+             s.handle_time_ns / 1e6, s.recv_count != 0 ? s.handle_time_ns / 1e3 / s.recv_count : 0.0);
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <unordered_map>
+#include "IODataPipe.h"
+
+#define NETWORK_STATS_TIME_BUCKETS (16)
+#define NETWORK_STATS_MERGE_INTERVAL (1000)
+
+struct ConnectionStats {
+    uint64 bytes_recv = 0, bytes_sent = 0;
+    uint64 packets_recv = 0, packets_sent = 0;
+    uint64 writes = 0, partial_writes = 0;
+    uint64 send_queue_peak = 0;
+    DataPipeStats send_pipe, recv_pipe;
+    // pipe output per pipe input on the send side, 1 without pipes.
+    double GetSendCompressRatio() const;
+};
+
+// written by the io thread, except packets_sent by whoever sends.
+struct ConnectionCounter {
+    std::atomic<uint64> bytes_recv{0}, bytes_sent{0};
+    std::atomic<uint64> packets_recv{0}, packets_sent{0};
+    std::atomic<uint64> writes{0}, partial_writes{0};
+    std::atomic<uint64> send_queue_peak{0};
+    void Snapshot(ConnectionStats &stats) const;
+    static void Max(std::atomic<uint64> &counter, uint64 value) {
+        if (value > counter.load(std::memory_order_relaxed)) {
+            counter.store(value, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct OpcodeStats {
+    uint64 recv_count = 0, recv_bytes = 0;
+    uint64 send_count = 0, send_bytes = 0;
+    uint64 handle_time_ns = 0;
+    // log2 buckets of handler microseconds, the last one is open ended.
+    uint64 handle_time_hist[NETWORK_STATS_TIME_BUCKETS] = {};
+    void Merge(const OpcodeStats &other);
+};
+
+// opcode stats gather in thread local tables, each thread merges its own
+// into the global table at most once per merge interval.
+class NetworkStats
+{
+public:
+    static void SetEnabled(bool is_enabled);
+    static bool IsEnabled() { return is_enabled_.load(std::memory_order_relaxed); }
+
+    static uint64 GetTimeNs();
+    static void RecordRecvPacket(uint32 opcode, size_t size, uint64 handle_time_ns);
+    static void RecordSendPacket(uint32 opcode, size_t size);
+    static void MergeThreadStats();
+
+    static std::unordered_map<uint32, OpcodeStats> GetOpcodeStats();
+    static void ResetOpcodeStats();
+    static void LogOpcodeStats(size_t count);
+
+private:
+    static std::atomic<bool> is_enabled_;
+};
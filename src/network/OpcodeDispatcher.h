@@ -0,0 +1,113 @@
+#pragma once
+
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "Exception.h"
+#include "Session.h"
+#include "NetworkStats.h"
+
+// maps opcodes to session member handlers, built once and shared by every
+// session of a class.  opcodes inside the dense range are an array index,
+// the rest go through a hash map.  handlers take the raw packet, or typed
+// arguments read from it in order, a short packet throws as usual:
+//   int HandleLogin(INetPacket *pck);
+//   int HandleMove(float x, float y, const std::string &map);
+// registering an opcode twice throws InternalException.
+template <typename S>
+class OpcodeDispatcher
+{
+public:
+    typedef std::function<void(uint32 opcode, const char *name, uint64 time_ns)> TimingHook;
+
+    OpcodeDispatcher(uint32 dense_first = 0, uint32 dense_count = 0)
+        : dense_first_(dense_first), dense_(dense_count) {}
+
+    void Register(uint32 opcode, int (S::*handler)(INetPacket*), const char *name = "") {
+        AddEntry(opcode, Entry{&InvokeRaw, reinterpret_cast<RawHandler>(handler), name});
+    }
+    template <typename... Args>
+    void Register(uint32 opcode, int (S::*handler)(Args...), const char *name = "") {
+        AddEntry(opcode, Entry{&InvokeTyped<Args...>, reinterpret_cast<RawHandler>(handler), name});
+    }
+
+    // called after every handler with its wall time, set before dispatching.
+    void SetTimingHook(const TimingHook &hook) { timing_hook_ = hook; }
+
+    int Dispatch(S *session, INetPacket *pck) const {
+        const uint32 opcode = pck->GetOpcode();
+        const Entry *entry = FindEntry(opcode);
+        if (entry == nullptr) {
+            return SessionHandleUnhandle;
+        }
+        if (!timing_hook_) {
+            return entry->invoke(session, pck, entry->handler);
+        }
+        const uint64 start_time = NetworkStats::GetTimeNs();
+        const int status = entry->invoke(session, pck, entry->handler);
+        timing_hook_(opcode, entry->name, NetworkStats::GetTimeNs() - start_time);
+        return status;
+    }
+
+    bool IsRegistered(uint32 opcode) const { return FindEntry(opcode) != nullptr; }
+    const char *GetHandlerName(uint32 opcode) const {
+        const Entry *entry = FindEntry(opcode);
+        return entry != nullptr ? entry->name : "";
+    }
+
+private:
+    typedef int (S::*RawHandler)(INetPacket*);
+    struct Entry {
+        int (*invoke)(S*, INetPacket*, RawHandler);
+        RawHandler handler;
+        const char *name;
+    };
+
+    template <size_t... I> struct Indices {};
+    template <size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+    template <size_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+    static int InvokeRaw(S *session, INetPacket *pck, RawHandler handler) {
+        return (session->*handler)(pck);
+    }
+
+    // braced initializers are evaluated in order, so fields read in order.
+    template <typename... Args>
+    static int InvokeTyped(S *session, INetPacket *pck, RawHandler handler) {
+        std::tuple<typename std::decay<Args>::type...> args{
+            pck->Read<typename std::decay<Args>::type>()...};
+        return Apply(session, reinterpret_cast<int (S::*)(Args...)>(handler),
+                     args, typename MakeIndices<sizeof...(Args)>::type());
+    }
+    template <typename Handler, typename Tuple, size_t... I>
+    static int Apply(S *session, Handler handler, Tuple &args, Indices<I...>) {
+        return (session->*handler)(std::move(std::get<I>(args))...);
+    }
+
+    void AddEntry(uint32 opcode, const Entry &entry) {
+        if (IsRegistered(opcode)) {
+            THROW_EXCEPTION(InternalException());
+        }
+        const uint32 index = opcode - dense_first_;
+        if (index < dense_.size()) {
+            dense_[index] = entry;
+        } else {
+            sparse_[opcode] = entry;
+        }
+    }
+    const Entry *FindEntry(uint32 opcode) const {
+        const uint32 index = opcode - dense_first_;
+        if (index < dense_.size()) {
+            return dense_[index].invoke != nullptr ? &dense_[index] : nullptr;
+        }
+        auto itr = sparse_.find(opcode);
+        return itr != sparse_.end() ? &itr->second : nullptr;
+    }
+
+    const uint32 dense_first_;
+    std::vector<Entry> dense_;
+    std::unordered_map<uint32, Entry> sparse_;
+    TimingHook timing_hook_;
+};
@@ -0,0 +1,499 @@
+#include "ReliableUdp.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    RUDP_CMD_PUSH = 81,
+    RUDP_CMD_ACK = 82,
+    RUDP_CMD_WASK = 83,
+    RUDP_CMD_WINS = 84,
+};
+
+enum {
+    RUDP_ASK_SEND = 1,
+    RUDP_ASK_TELL = 2,
+};
+
+#define RUDP_RTO_NDL (30)
+#define RUDP_RTO_MIN (100)
+#define RUDP_RTO_DEF (200)
+#define RUDP_RTO_MAX (60000)
+#define RUDP_THRESH_MIN (2)
+#define RUDP_PROBE_INIT (7000)
+#define RUDP_PROBE_LIMIT (120000)
+#define RUDP_FAST_LIMIT (5)
+
+static inline int32 Diff(uint32 later, uint32 earlier)
+{
+    return (int32)(later - earlier);
+}
+
+static inline void Encode16(char *p, uint16 v)
+{
+    p[0] = char(v), p[1] = char(v >> 8);
+}
+
+static inline void Encode32(char *p, uint32 v)
+{
+    p[0] = char(v), p[1] = char(v >> 8), p[2] = char(v >> 16), p[3] = char(v >> 24);
+}
+
+static inline uint16 Decode16(const char *p)
+{
+    const uint8 *u = (const uint8 *)p;
+    return uint16(u[0] | u[1] << 8);
+}
+
+static inline uint32 Decode32(const char *p)
+{
+    const uint8 *u = (const uint8 *)p;
+    return uint32(u[0]) | uint32(u[1]) << 8 | uint32(u[2]) << 16 | uint32(u[3]) << 24;
+}
+
+ReliableUdp::ReliableUdp(uint32 conv, const Output &output)
+: conv_(conv)
+, output_(output)
+, mtu_(RUDP_DEFAULT_MTU)
+, mss_(RUDP_DEFAULT_MTU - RUDP_HEADER_SIZE)
+, snd_una_(0)
+, snd_nxt_(0)
+, rcv_nxt_(0)
+, snd_wnd_(32)
+, rcv_wnd_(128)
+, rmt_wnd_(128)
+, cwnd_(1)
+, ssthresh_(RUDP_THRESH_MIN)
+, incr_(0)
+, rx_srtt_(0)
+, rx_rttval_(0)
+, rx_rto_(RUDP_RTO_DEF)
+, rx_minrto_(RUDP_RTO_MIN)
+, current_(0)
+, interval_(100)
+, ts_flush_(0)
+, ts_probe_(0)
+, probe_wait_(0)
+, probe_(0)
+, dead_link_(20)
+, fastresend_(0)
+, nodelay_(false)
+, nocwnd_(false)
+, updated_(false)
+, is_dead_link_(false)
+, rcv_offset_(0)
+, rcv_size_(0)
+{
+}
+
+ReliableUdp::~ReliableUdp()
+{
+}
+
+void ReliableUdp::SetMtu(size_t mtu)
+{
+    if (mtu > RUDP_HEADER_SIZE && mtu <= RUDP_MAX_DATAGRAM_SIZE) {
+        mtu_ = mtu;
+        mss_ = mtu - RUDP_HEADER_SIZE;
+    }
+}
+
+void ReliableUdp::SetWindowSize(uint32 send_window, uint32 recv_window)
+{
+    if (send_window != 0) {
+        snd_wnd_ = send_window;
+    }
+    if (recv_window != 0) {
+        rcv_wnd_ = recv_window;
+    }
+}
+
+void ReliableUdp::SetNoDelay(bool nodelay, uint32 interval, uint32 resend, bool no_cwnd)
+{
+    nodelay_ = nodelay;
+    rx_minrto_ = nodelay ? RUDP_RTO_NDL : RUDP_RTO_MIN;
+    interval_ = std::min(std::max(interval, 1u), 5000u);
+    fastresend_ = resend;
+    nocwnd_ = no_cwnd;
+}
+
+// stream mode, the last queued segment is topped up before a new one.
+size_t ReliableUdp::Send(const char *data, size_t size)
+{
+    size_t sent = 0;
+    if (!snd_queue_.empty() && snd_queue_.back().data.size() < mss_) {
+        std::string &last = snd_queue_.back().data;
+        sent = std::min(mss_ - last.size(), size);
+        last.append(data, sent);
+    }
+    while (sent < size && !IsSendWindowFull()) {
+        const size_t n = std::min(mss_, size - sent);
+        snd_queue_.emplace_back();
+        snd_queue_.back().data.assign(data + sent, n);
+        sent += n;
+    }
+    return sent;
+}
+
+bool ReliableUdp::Input(const char *data, size_t size, uint32 now)
+{
+    if (size < RUDP_HEADER_SIZE) {
+        return false;
+    }
+
+    current_ = now;
+    const uint32 prev_una = snd_una_;
+    uint32 maxack = 0, maxack_ts = 0;
+    bool has_maxack = false;
+    while (size >= RUDP_HEADER_SIZE) {
+        const uint32 conv = Decode32(data);
+        const uint8 cmd = data[4];
+        const uint16 wnd = Decode16(data + 5);
+        const uint32 ts = Decode32(data + 7);
+        const uint32 sn = Decode32(data + 11);
+        const uint32 una = Decode32(data + 15);
+        const size_t len = Decode16(data + 19);
+        data += RUDP_HEADER_SIZE, size -= RUDP_HEADER_SIZE;
+        if (conv != conv_ || len > size ||
+            cmd < RUDP_CMD_PUSH || cmd > RUDP_CMD_WINS) {
+            return false;
+        }
+
+        rmt_wnd_ = wnd;
+        ParseUna(una);
+        ShrinkBuf();
+
+        switch (cmd) {
+        case RUDP_CMD_ACK:
+            if (Diff(current_, ts) >= 0) {
+                UpdateAck(Diff(current_, ts));
+            }
+            ParseAck(sn);
+            ShrinkBuf();
+            if (!has_maxack || Diff(sn, maxack) > 0) {
+                maxack = sn, maxack_ts = ts, has_maxack = true;
+            }
+            break;
+        case RUDP_CMD_PUSH:
+            stats_.segments_recv += 1;
+            if (Diff(sn, rcv_nxt_ + rcv_wnd_) < 0) {
+                acklist_.emplace_back(sn, ts);
+                if (Diff(sn, rcv_nxt_) >= 0) {
+                    ParseData(sn, data, len);
+                }
+            }
+            break;
+        case RUDP_CMD_WASK:
+            probe_ |= RUDP_ASK_TELL;
+            break;
+        case RUDP_CMD_WINS:
+            break;
+        }
+
+        data += len, size -= len;
+    }
+
+    if (has_maxack) {
+        ParseFastack(maxack, maxack_ts);
+    }
+
+    if (Diff(snd_una_, prev_una) > 0 && cwnd_ < rmt_wnd_) {
+        const uint32 mss = uint32(mss_);
+        if (cwnd_ < ssthresh_) {
+            cwnd_ += 1;
+            incr_ += mss;
+        } else {
+            incr_ = std::max(incr_, mss);
+            incr_ += (mss * mss) / incr_ + (mss / 16);
+            if ((cwnd_ + 1) * mss <= incr_) {
+                cwnd_ = (incr_ + mss - 1) / mss;
+            }
+        }
+        if (cwnd_ > rmt_wnd_) {
+            cwnd_ = rmt_wnd_;
+            incr_ = rmt_wnd_ * mss;
+        }
+    }
+
+    return true;
+}
+
+size_t ReliableUdp::Recv(char *data, size_t size)
+{
+    const bool is_full = rcv_queue_.size() >= rcv_wnd_;
+    size_t total = 0;
+    while (total < size && !rcv_queue_.empty()) {
+        const std::string &front = rcv_queue_.front();
+        const size_t n = std::min(front.size() - rcv_offset_, size - total);
+        memcpy(data + total, front.data() + rcv_offset_, n);
+        total += n, rcv_offset_ += n;
+        if (rcv_offset_ == front.size()) {
+            rcv_queue_.pop_front();
+            rcv_offset_ = 0;
+        }
+    }
+    rcv_size_ -= total;
+
+    MoveRecvData();
+
+    // tell a peer that saw a zero window it may send again.
+    if (is_full && rcv_queue_.size() < rcv_wnd_) {
+        probe_ |= RUDP_ASK_TELL;
+    }
+
+    return total;
+}
+
+void ReliableUdp::Update(uint32 now)
+{
+    current_ = now;
+    if (!updated_) {
+        updated_ = true;
+        ts_flush_ = current_;
+    }
+
+    int32 slap = Diff(current_, ts_flush_);
+    if (slap >= 10000 || slap < -10000) {
+        ts_flush_ = current_;
+        slap = 0;
+    }
+
+    if (slap >= 0) {
+        ts_flush_ += interval_;
+        if (Diff(current_, ts_flush_) >= 0) {
+            ts_flush_ = current_ + interval_;
+        }
+        Flush(now);
+    }
+}
+
+void ReliableUdp::Flush(uint32 now)
+{
+    current_ = now;
+    const uint16 wnd = GetWndUnused();
+    static const std::string empty;
+
+    for (auto &ack : acklist_) {
+        WriteSegment(RUDP_CMD_ACK, wnd, ack.second, ack.first, empty);
+    }
+    acklist_.clear();
+
+    if (rmt_wnd_ == 0) {
+        if (probe_wait_ == 0) {
+            probe_wait_ = RUDP_PROBE_INIT;
+            ts_probe_ = current_ + probe_wait_;
+        } else if (Diff(current_, ts_probe_) >= 0) {
+            probe_wait_ = std::min(probe_wait_ + probe_wait_ / 2, uint32(RUDP_PROBE_LIMIT));
+            ts_probe_ = current_ + probe_wait_;
+            probe_ |= RUDP_ASK_SEND;
+        }
+    } else {
+        ts_probe_ = probe_wait_ = 0;
+    }
+    if ((probe_ & RUDP_ASK_SEND) != 0) {
+        WriteSegment(RUDP_CMD_WASK, wnd, current_, 0, empty);
+    }
+    if ((probe_ & RUDP_ASK_TELL) != 0) {
+        WriteSegment(RUDP_CMD_WINS, wnd, current_, 0, empty);
+    }
+    probe_ = 0;
+
+    uint32 cwnd = std::min(snd_wnd_, rmt_wnd_);
+    if (!nocwnd_) {
+        cwnd = std::min(cwnd_, cwnd);
+    }
+    while (Diff(snd_nxt_, snd_una_ + cwnd) < 0 && !snd_queue_.empty()) {
+        snd_buf_.push_back(std::move(snd_queue_.front()));
+        snd_queue_.pop_front();
+        Segment &seg = snd_buf_.back();
+        seg.sn = snd_nxt_++;
+        seg.ts = seg.resendts = current_;
+        seg.rto = rx_rto_;
+        seg.fastack = seg.xmit = 0;
+    }
+
+    const uint32 resent = fastresend_ != 0 ? fastresend_ : UINT32_MAX;
+    const uint32 rtomin = nodelay_ ? 0 : (rx_rto_ >> 3);
+    bool is_lost = false, is_change = false;
+    for (auto &seg : snd_buf_) {
+        bool is_send = false;
+        if (seg.xmit == 0) {
+            is_send = true;
+            seg.rto = rx_rto_;
+            seg.resendts = current_ + seg.rto + rtomin;
+        } else if (Diff(current_, seg.resendts) >= 0) {
+            is_send = is_lost = true;
+            seg.rto += nodelay_ ? seg.rto / 2 : std::max(seg.rto, rx_rto_);
+            seg.resendts = current_ + seg.rto;
+            stats_.retransmits += 1;
+        } else if (seg.fastack >= resent && seg.xmit <= RUDP_FAST_LIMIT) {
+            is_send = is_change = true;
+            seg.fastack = 0;
+            seg.resendts = current_ + seg.rto;
+            stats_.fast_retransmits += 1;
+        }
+        if (is_send) {
+            seg.xmit += 1;
+            seg.ts = current_;
+            WriteSegment(RUDP_CMD_PUSH, wnd, seg.ts, seg.sn, seg.data);
+            stats_.segments_sent += 1;
+            if (seg.xmit >= dead_link_) {
+                is_dead_link_ = true;
+            }
+        }
+    }
+    FlushBuffer();
+
+    if (is_change) {
+        ssthresh_ = std::max((snd_nxt_ - snd_una_) / 2, uint32(RUDP_THRESH_MIN));
+        cwnd_ = ssthresh_ + resent;
+        incr_ = cwnd_ * uint32(mss_);
+    }
+    if (is_lost) {
+        ssthresh_ = std::max(cwnd / 2, uint32(RUDP_THRESH_MIN));
+        cwnd_ = 1;
+        incr_ = uint32(mss_);
+    }
+}
+
+bool ReliableUdp::PeekHello(const char *data, size_t size, uint32 &conv)
+{
+    if (size < RUDP_HEADER_SIZE || data[4] != RUDP_CMD_PUSH ||
+        Decode32(data + 11) != 0 || Decode32(data + 15) != 0) {
+        return false;
+    }
+    conv = Decode32(data);
+    while (size >= RUDP_HEADER_SIZE) {
+        const uint8 cmd = data[4];
+        const size_t len = Decode16(data + 19);
+        data += RUDP_HEADER_SIZE, size -= RUDP_HEADER_SIZE;
+        if (Decode32(data - RUDP_HEADER_SIZE) != conv || len > size ||
+            cmd < RUDP_CMD_PUSH || cmd > RUDP_CMD_WINS) {
+            return false;
+        }
+        data += len, size -= len;
+    }
+    return conv != 0 && size == 0;
+}
+
+void ReliableUdp::ParseUna(uint32 una)
+{
+    while (!snd_buf_.empty() && Diff(una, snd_buf_.front().sn) > 0) {
+        snd_buf_.pop_front();
+    }
+}
+
+void ReliableUdp::ParseAck(uint32 sn)
+{
+    if (Diff(sn, snd_una_) < 0 || Diff(sn, snd_nxt_) >= 0) {
+        return;
+    }
+    for (auto itr = snd_buf_.begin(); itr != snd_buf_.end(); ++itr) {
+        if (itr->sn == sn) {
+            snd_buf_.erase(itr);
+            break;
+        }
+        if (Diff(sn, itr->sn) < 0) {
+            break;
+        }
+    }
+}
+
+// only acks of segments sent after a copy count against it, so a copy
+// in flight is not sent again by acks that could not have seen it.
+void ReliableUdp::ParseFastack(uint32 sn, uint32 ts)
+{
+    if (Diff(sn, snd_una_) < 0 || Diff(sn, snd_nxt_) >= 0) {
+        return;
+    }
+    for (auto &seg : snd_buf_) {
+        if (Diff(sn, seg.sn) <= 0) {
+            break;
+        }
+        if (Diff(ts, seg.ts) >= 0) {
+            seg.fastack += 1;
+        }
+    }
+}
+
+// segments arrive out of order, they wait sorted until the gap is filled.
+void ReliableUdp::ParseData(uint32 sn, const char *data, size_t size)
+{
+    auto itr = rcv_buf_.end();
+    while (itr != rcv_buf_.begin()) {
+        auto prev = itr - 1;
+        if (prev->sn == sn) {
+            return;
+        }
+        if (Diff(sn, prev->sn) > 0) {
+            break;
+        }
+        itr = prev;
+    }
+    Segment seg;
+    seg.sn = sn;
+    seg.data.assign(data, size);
+    rcv_buf_.insert(itr, std::move(seg));
+    MoveRecvData();
+}
+
+void ReliableUdp::MoveRecvData()
+{
+    while (!rcv_buf_.empty() && rcv_buf_.front().sn == rcv_nxt_ &&
+           rcv_queue_.size() < rcv_wnd_) {
+        rcv_size_ += rcv_buf_.front().data.size();
+        rcv_queue_.push_back(std::move(rcv_buf_.front().data));
+        rcv_buf_.pop_front();
+        rcv_nxt_ += 1;
+    }
+}
+
+void ReliableUdp::UpdateAck(int32 rtt)
+{
+    if (rx_srtt_ == 0) {
+        rx_srtt_ = rtt;
+        rx_rttval_ = rtt / 2;
+    } else {
+        const int32 delta = abs(rtt - rx_srtt_);
+        rx_rttval_ = (3 * rx_rttval_ + delta) / 4;
+        rx_srtt_ = std::max((7 * rx_srtt_ + rtt) / 8, 1);
+    }
+    const uint32 rto = rx_srtt_ + std::max(interval_, uint32(4 * rx_rttval_));
+    rx_rto_ = std::min(std::max(rto, rx_minrto_), uint32(RUDP_RTO_MAX));
+    stats_.srtt = rx_srtt_;
+    stats_.rto = rx_rto_;
+}
+
+void ReliableUdp::ShrinkBuf()
+{
+    snd_una_ = !snd_buf_.empty() ? snd_buf_.front().sn : snd_nxt_;
+}
+
+void ReliableUdp::WriteSegment(uint8 cmd, uint16 wnd, uint32 ts, uint32 sn, const std::string &data)
+{
+    if (buffer_.size() + RUDP_HEADER_SIZE + data.size() > mtu_) {
+        FlushBuffer();
+    }
+    char header[RUDP_HEADER_SIZE];
+    Encode32(header, conv_);
+    header[4] = char(cmd);
+    Encode16(header + 5, wnd);
+    Encode32(header + 7, ts);
+    Encode32(header + 11, sn);
+    Encode32(header + 15, rcv_nxt_);
+    Encode16(header + 19, uint16(data.size()));
+    buffer_.append(header, RUDP_HEADER_SIZE).append(data);
+}
+
+void ReliableUdp::FlushBuffer()
+{
+    if (!buffer_.empty()) {
+        output_(buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+}
+
+uint16 ReliableUdp::GetWndUnused() const
+{
+    return rcv_queue_.size() < rcv_wnd_ ? uint16(rcv_wnd_ - rcv_queue_.size()) : 0;
+}
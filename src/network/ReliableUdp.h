@@ -0,0 +1,106 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Base.h"
+
+#define RUDP_HEADER_SIZE (21)
+#define RUDP_DEFAULT_MTU (1400)
+#define RUDP_MAX_DATAGRAM_SIZE (4096)
+
+// an arq byte stream over datagrams.  every segment is acked on its own so
+// a hole is repaired alone, a segment skipped by enough later acks is sent
+// again at once, and the retransmit timeout and congestion window can be
+// relaxed for latency.  it is driven from one thread, times are in ms.
+class ReliableUdp
+{
+public:
+    typedef std::function<void(const char *data, size_t size)> Output;
+
+    struct Stats {
+        uint64 segments_sent = 0, segments_recv = 0;
+        uint64 retransmits = 0, fast_retransmits = 0;
+        uint32 srtt = 0, rto = 0;
+    };
+
+    ReliableUdp(uint32 conv, const Output &output);
+    ~ReliableUdp();
+
+    void SetMtu(size_t mtu);
+    void SetWindowSize(uint32 send_window, uint32 recv_window);
+    // nodelay grows a timeout by half instead of doubling it, interval is
+    // the flush period, resend is the number of later acks that retransmits
+    // a segment at once, 0 disables, no_cwnd leaves only the peer window.
+    void SetNoDelay(bool nodelay, uint32 interval, uint32 resend, bool no_cwnd);
+    void SetMinRto(uint32 rto) { rx_minrto_ = rto; }
+    // the link is dead once a segment was sent this many times.
+    void SetDeadLink(uint32 xmit) { dead_link_ = xmit; }
+
+    // takes as much as the send window allows, returns the bytes taken.
+    size_t Send(const char *data, size_t size);
+    // false for a datagram of another conversation or a malformed one.
+    bool Input(const char *data, size_t size, uint32 now);
+    size_t Recv(char *data, size_t size);
+
+    // flushes every interval, Flush sends acks and new data right away.
+    void Update(uint32 now);
+    void Flush(uint32 now);
+
+    size_t GetRecvSize() const { return rcv_size_; }
+    size_t GetWaitSend() const { return snd_queue_.size() + snd_buf_.size(); }
+    bool IsSendWindowFull() const { return GetWaitSend() >= snd_wnd_ * 2; }
+    bool IsDeadLink() const { return is_dead_link_; }
+
+    uint32 GetConv() const { return conv_; }
+    uint32 GetInterval() const { return interval_; }
+    const Stats &GetStats() const { return stats_; }
+
+    // true for the first datagram of a peer, well formed segments of one
+    // conversation led by the push of sn 0.
+    static bool PeekHello(const char *data, size_t size, uint32 &conv);
+
+private:
+    struct Segment {
+        uint32 sn = 0, ts = 0;
+        uint32 resendts = 0, rto = 0;
+        uint32 fastack = 0, xmit = 0;
+        std::string data;
+    };
+
+    void ParseUna(uint32 una);
+    void ParseAck(uint32 sn);
+    void ParseFastack(uint32 sn, uint32 ts);
+    void ParseData(uint32 sn, const char *data, size_t size);
+    void UpdateAck(int32 rtt);
+    void ShrinkBuf();
+    void MoveRecvData();
+
+    void WriteSegment(uint8 cmd, uint16 wnd, uint32 ts, uint32 sn, const std::string &data);
+    void FlushBuffer();
+    uint16 GetWndUnused() const;
+
+    const uint32 conv_;
+    const Output output_;
+
+    size_t mtu_, mss_;
+    uint32 snd_una_, snd_nxt_, rcv_nxt_;
+    uint32 snd_wnd_, rcv_wnd_, rmt_wnd_;
+    uint32 cwnd_, ssthresh_, incr_;
+    int32 rx_srtt_, rx_rttval_;
+    uint32 rx_rto_, rx_minrto_;
+    uint32 current_, interval_, ts_flush_;
+    uint32 ts_probe_, probe_wait_, probe_;
+    uint32 dead_link_, fastresend_;
+    bool nodelay_, nocwnd_, updated_, is_dead_link_;
+
+    std::deque<Segment> snd_queue_, snd_buf_;
+    std::deque<Segment> rcv_buf_;
+    std::deque<std::string> rcv_queue_;
+    size_t rcv_offset_, rcv_size_;
+    std::vector<std::pair<uint32, uint32>> acklist_;
+    std::string buffer_;
+
+    Stats stats_;
+};
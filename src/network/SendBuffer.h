@@ -3,6 +3,7 @@
 #include "Debugger.h"
 #include "InlineFuncs.h"
 #include "NetPacket.h"
+#include <atomic>
 
 // be useful for:
 // multi producer, single consumer.
@@ -12,12 +13,31 @@
 #define S_MAX_SEND_BUFFER_POOL_COUNT(N) \
     MAX(MIN(MAX_SEND_BUFFER_POOL_MEMORY/N, MAX_SEND_BUFFER_POOL_COUNT), 1)
 
+// shared packets below this size are cheaper to copy than to reference.
+#define SEND_BUFFER_SHARED_REF_MIN_SIZE (1024)
+
+// asio never hands more than 64 buffers to one writev call.
+#define MAX_SEND_DATA_SPANS (64)
+
+struct SendDataSpan {
+    const char *data;
+    size_t size;
+};
+
 template <size_t N>
 class TSendBuffer
 {
-    struct DataBuffer {
-        DataBuffer *next = nullptr;
-        size_t rpos = 0, wpos = 0;
+    // writers agree on limit under the lock, and only the flush that
+    // publishes a node copies it to end, the consumer frees by end.
+    struct DataNode {
+        DataNode *next = nullptr;
+        size_t rpos = 0, limit = N;
+        std::atomic<size_t> wpos{0}, end{N};
+        const char *data = nullptr;
+        SharedNetPacket *shared = nullptr;
+    };
+    struct DataBuffer : public DataNode {
+        DataBuffer() { this->data = buffer; }
         char buffer[N];
     };
     struct DataWriter {
@@ -45,33 +65,86 @@ class TSendBuffer
     };
 
 public:
-    TSendBuffer() : head_(AllocBuffer()), size_(0) {
-        pending_.buffer = tail_ = head_;
+    TSendBuffer() : tail_(AllocBuffer()), size_(0) {
+        head_ = pending_.buffer = tail_;
     }
     ~TSendBuffer() {
         do {
             auto next = head_->next;
-            FreeBuffer(head_);
+            FreeNode(head_);
             head_ = next;
         } while (head_ != nullptr);
     }
 
     const char *GetSendDataBuffer(size_t &size) {
-        if (head_->wpos > head_->rpos) {
-            size = head_->wpos - head_->rpos;
-            return head_->buffer + head_->rpos;
+        SkipDrainedNodes();
+        const size_t wpos = head_->wpos;
+        if (wpos > head_->rpos) {
+            size = wpos - head_->rpos;
+            return head_->data + head_->rpos;
         } else {
             return nullptr;
         }
     }
+    size_t GetSendDataBuffers(SendDataSpan spans[], size_t count) {
+        SkipDrainedNodes();
+        size_t n = 0;
+        for (auto node = head_; node != nullptr && n < count;) {
+            const size_t wpos = node->wpos;
+            if (wpos > node->rpos) {
+                spans[n].data = node->data + node->rpos;
+                spans[n++].size = wpos - node->rpos;
+            }
+            if (wpos < node->end) {
+                break;
+            }
+            node = node->next;
+        }
+        return n;
+    }
     void RemoveSendData(size_t size) {
-        DBGASSERT(head_->rpos + size <= head_->wpos);
-        head_->rpos += size, size_.fetch_sub(size);
-        if (head_->rpos >= N) {
-            auto next = head_->next;
-            FreeBuffer(head_);
-            head_ = next;
+        while (size > 0) {
+            SkipDrainedNodes();
+            const size_t avail = std::min(size, head_->wpos - head_->rpos);
+            DBGASSERT(avail != 0);
+            if (avail == 0) {
+                break;
+            }
+            head_->rpos += avail, size_.fetch_sub(avail);
+            size -= avail;
+        }
+        SkipDrainedNodes();
+    }
+
+    // the packet is referenced rather than copied, it's released once
+    // the connection has written all of it.
+    void WritePacket(const SharedNetPacket &pck) {
+        if (pck.GetSize() < SEND_BUFFER_SHARED_REF_MIN_SIZE) {
+            WritePacket(pck.GetBuffer(), pck.GetSize());
+            return;
         }
+        DataNode *node = AllocNode(pck);
+        DataBuffer *buffer = AllocBuffer();
+        DataWriter w;
+        w.n = 0;
+        do {
+            std::lock_guard<spinlock> lock(spin_);
+            if (pending_.writer != nullptr) {
+                pending_.writer->next = &w;
+            }
+            w.prev = pending_.writer;
+            w.ptr[0] = pending_.buffer;
+            w.pos[0] = pending_.epos;
+            w.ptr[0]->limit = pending_.epos;
+            w.ptr[1] = buffer;
+            w.pos[1] = 0;
+            pending_.writer = &w;
+            pending_.buffer = buffer;
+            pending_.epos = 0;
+        } while (0);
+        w.ptr[0]->next = node, node->next = buffer;
+        size_.fetch_add(node->limit);
+        Flush(w);
     }
 
     void WritePacket(const INetPacket &pck) {
@@ -101,6 +174,18 @@ public:
         Append(data, size, _.w);
     }
 
+    void WritePacket(uint32 opcode, const SendDataSpan spans[], size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size += spans[i].size;
+        }
+        DataWriterHelper _(*this, INetPacket::Header::SIZE + size);
+        Header(opcode, _.w.n, _.w);
+        for (size_t i = 0; i < count; ++i) {
+            Append(spans[i].data, spans[i].size, _.w);
+        }
+    }
+
     bool HasDataAwaiting() const { return size_.load() != 0; }
     size_t GetDataSize() const { return size_.load(); }
 
@@ -118,8 +203,9 @@ private:
             w.n -= avail, size_.fetch_add(avail);
             w.pos[0] += avail, data += avail, size -= avail;
             if (w.pos[0] >= N) {
-                w.ptr[0]->next = w.n < N ? w.ptr[1] : AllocBuffer();
-                w.ptr[0] = w.ptr[0]->next;
+                DataBuffer *next = w.n < N ? w.ptr[1] : AllocBuffer();
+                w.ptr[0]->next = next;
+                w.ptr[0] = next;
                 w.pos[0] = 0;
             }
         }
@@ -189,15 +275,26 @@ mark:       buffer = AllocBuffer();
             }
         } while (0);
         if (w.prev == nullptr) {
-            for (auto ptr = w.ptr[0]; ptr != w.ptr[1];) {
+            for (DataNode *ptr = w.ptr[0]; ptr != w.ptr[1];) {
                 auto next = ptr->next;
-                ptr->wpos = N;
+                ptr->wpos = ptr->limit;
+                ptr->end = ptr->limit;
                 ptr = next;
             }
         }
     }
 
-    DataBuffer *head_, *tail_;
+    void SkipDrainedNodes() {
+        while (head_->rpos >= head_->end &&
+               head_->wpos >= head_->end && head_->next != nullptr) {
+            auto next = head_->next;
+            FreeNode(head_);
+            head_ = next;
+        }
+    }
+
+    DataNode *head_;
+    DataBuffer *tail_;
     DataPending pending_;
     spinlock spin_;
     std::atomic<size_t> size_;
@@ -210,6 +307,10 @@ public:
         while ((buffer = buffer_pool_.Get()) != nullptr) {
             delete buffer;
         }
+        DataNode *node = nullptr;
+        while ((node = node_pool_.Get()) != nullptr) {
+            delete node;
+        }
     }
 
 private:
@@ -227,8 +328,34 @@ private:
         }
     }
 
+    static DataNode *AllocNode(const SharedNetPacket &pck) {
+        DataNode *node = nullptr;
+        if ((node = node_pool_.Get()) != nullptr) {
+            REINIT_OBJECT(node);
+        } else {
+            node = new DataNode;
+        }
+        node->shared = const_cast<SharedNetPacket*>(&pck);
+        node->shared->AddRef();
+        node->data = pck.GetBuffer();
+        node->limit = node->end = pck.GetSize();
+        return node;
+    }
+    static void FreeNode(DataNode *node) {
+        if (node->shared == nullptr) {
+            FreeBuffer(static_cast<DataBuffer*>(node));
+            return;
+        }
+        node->shared->Release();
+        if (!node_pool_.Put(node)) {
+            delete node;
+        }
+    }
+
     static ThreadSafePool<DataBuffer, S_MAX_SEND_BUFFER_POOL_COUNT(N)>
         buffer_pool_;
+    static ThreadSafePool<DataNode, MAX_SEND_BUFFER_POOL_COUNT>
+        node_pool_;
 };
 
 template <size_t N>
@@ -236,5 +363,10 @@ ThreadSafePool<
     typename TSendBuffer<N>::DataBuffer,
     S_MAX_SEND_BUFFER_POOL_COUNT(N)
 > TSendBuffer<N>::buffer_pool_;
+template <size_t N>
+ThreadSafePool<
+    typename TSendBuffer<N>::DataNode,
+    MAX_SEND_BUFFER_POOL_COUNT
+> TSendBuffer<N>::node_pool_;
 
 typedef TSendBuffer<65536> SendBuffer;
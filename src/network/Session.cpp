@@ -1,12 +1,16 @@
 #include "Session.h"
 #include "SessionManager.h"
 #include "ConnectionManager.h"
+#include "FragmentAssembler.h"
+#include "NetworkStats.h"
+#include "ReliableUdp.h"
 #include "System.h"
 #include "Logger.h"
 
 Session::Session()
 : status_(Idle)
 , manager_(nullptr)
+, expiry_timer_(nullptr)
 , event_observer_(nullptr)
 , is_overstocked_packet_(false)
 , overflow_packet_count_(0)
@@ -14,6 +18,8 @@ Session::Session()
 , shutdown_time_(-1)
 , last_recv_pck_time_(GET_APP_TIME)
 , last_send_pck_time_(GET_APP_TIME)
+, recv_packet_count_(0)
+, handled_packet_count_(0)
 {
 }
 
@@ -22,14 +28,32 @@ Session::~Session()
     ClearRecvPacket();
 }
 
-void Session::Update()
+// packets past the quota stay in recv_batch_ for the next call, ahead of
+// anything received meanwhile.
+bool Session::Update(size_t max_packets, uint64 max_time_ns)
 {
     uint32 opcode = 0;
     INetPacket *pck = nullptr;
+    const bool is_stats = NetworkStats::IsEnabled();
+    const uint64 deadline = max_time_ns != 0 ? NetworkStats::GetTimeNs() + max_time_ns : 0;
+    size_t count = 0;
     TRY_BEGIN {
 
-        while (IsActive() && recv_queue_.Dequeue(pck)) {
+        while (IsActive()) {
+            if (count >= max_packets ||
+                (deadline != 0 && count != 0 && NetworkStats::GetTimeNs() >= deadline)) {
+                return true;
+            }
+            if (!recv_batch_.Dequeue(pck)) {
+                recv_queue_.Detach(recv_batch_);
+                if (!recv_batch_.Dequeue(pck)) {
+                    break;
+                }
+            }
+            ++count, ++handled_packet_count_;
             opcode = pck->GetOpcode();
+            const size_t size = INetPacket::Header::SIZE + pck->GetReadableSize();
+            const uint64 start_time = is_stats ? NetworkStats::GetTimeNs() : 0;
             switch (HandlePacket(pck)) {
             case SessionHandleSuccess:
                 break;
@@ -52,6 +76,10 @@ void Session::Update()
                 ShutdownSession();
                 break;
             }
+            if (is_stats) {
+                NetworkStats::RecordRecvPacket(
+                    opcode, size, NetworkStats::GetTimeNs() - start_time);
+            }
             SAFE_DELETE(pck);
         }
 
@@ -67,6 +95,16 @@ void Session::Update()
     } CATCH_END
 
     SAFE_DELETE(pck);
+    while (recv_batch_.Dequeue(pck)) {
+        SAFE_DELETE(pck);
+        ++handled_packet_count_;
+    }
+    return false;
+}
+
+size_t Session::GetRecvBacklog() const
+{
+    return recv_packet_count_.load(std::memory_order_relaxed) - handled_packet_count_;
 }
 
 void Session::ConnectServer(const std::string &address, const std::string &port)
@@ -76,11 +114,25 @@ void Session::ConnectServer(const std::string &address, const std::string &port)
     sSessionManager.AddSession(this);
 }
 
+void Session::ConnectServerUdp(const std::string &address, const std::string &port)
+{
+    std::shared_ptr<Connection> connPtr = sConnectionManager.NewConnection(*this);
+    connPtr->AsyncConnectUdp(address, port);
+    sSessionManager.AddSession(this);
+}
+
 void Session::SetConnection(std::shared_ptr<Connection> &&conn)
 {
     connection_ = std::move(conn);
 }
 
+void Session::SetFlushPolicy(size_t bytes, uint64 delay_us)
+{
+    if (connection_) {
+        connection_->SetFlushPolicy(bytes, delay_us);
+    }
+}
+
 const std::shared_ptr<Connection> &Session::GetConnection() const
 {
     return connection_;
@@ -118,6 +170,27 @@ int Session::GetConnectionLoadValue() const
     return 1;
 }
 
+bool Session::IsZeroCopyRecvPacket() const
+{
+    return false;
+}
+
+bool Session::IsChunkedLargePacket() const
+{
+    return false;
+}
+
+bool Session::IsMirroredRecvBuffer() const
+{
+    return false;
+}
+
+void Session::ConfigReliableUdp(ReliableUdp &rudp) const
+{
+    rudp.SetNoDelay(true, 10, 2, false);
+    rudp.SetWindowSize(128, 128);
+}
+
 const std::string &Session::GetHost() const
 {
     return connection_->addr();
@@ -125,6 +198,9 @@ const std::string &Session::GetHost() const
 
 unsigned long Session::GetIPv4() const
 {
+    if (connection_->IsUnixSocket()) {
+        return 0;
+    }
     boost::asio::ip::address addr;
     addr.from_string(connection_->addr().c_str());
     return addr.is_v4() ? addr.to_v4().to_ulong() : 0;
@@ -163,15 +239,17 @@ void Session::ClearPacketOverstockFlag()
 
 void Session::KillSession()
 {
-    if (manager_ != nullptr) {
-        manager_->KillSession(this);
+    SessionShard *manager = GetManager();
+    if (manager != nullptr) {
+        manager->KillSession(this);
     }
 }
 
 void Session::ShutdownSession()
 {
-    if (manager_ != nullptr) {
-        manager_->ShutdownSession(this);
+    SessionShard *manager = GetManager();
+    if (manager != nullptr) {
+        manager->ShutdownSession(this);
     }
 }
 
@@ -195,11 +273,8 @@ void Session::OnRecvPacket(INetPacket *pck)
 void Session::PushRecvPacket(INetPacket *pck)
 {
     if (IsActive()) {
-        if (pck->GetOpcode() == OPCODE_LARGE_PACKET) {
-            PushRecvFragmentPacket(pck);
-        } else {
-            OnRecvPacket(pck);
-        }
+        recv_packet_count_.fetch_add(1, std::memory_order_relaxed);
+        OnRecvPacket(pck);
         last_recv_pck_time_ = GET_APP_TIME;
     } else {
         delete pck;
@@ -214,6 +289,7 @@ void Session::PushSendPacket(const INetPacket &pck)
         } else {
             connection_->GetSendBuffer().WritePacket(pck);
         }
+        OnSendPacket(pck.GetOpcode(), INetPacket::Header::SIZE + pck.GetReadableSize());
         connection_->PostWriteRequest();
         last_send_pck_time_ = GET_APP_TIME;
     }
@@ -237,6 +313,8 @@ void Session::PushSendPacket(const INetPacket &pck, const INetPacket &data)
         } else {
             connection_->GetSendBuffer().WritePacket(pck, data);
         }
+        OnSendPacket(pck.GetOpcode(), INetPacket::Header::SIZE * 2 +
+                     pck.GetReadableSize() + data.GetReadableSize());
         connection_->PostWriteRequest();
         last_send_pck_time_ = GET_APP_TIME;
     }
@@ -250,48 +328,20 @@ void Session::PushSendPacket(const INetPacket &pck, const char *data, size_t siz
         } else {
             connection_->GetSendBuffer().WritePacket(pck, data, size);
         }
+        OnSendPacket(pck.GetOpcode(), INetPacket::Header::SIZE + pck.GetReadableSize() + size);
         connection_->PostWriteRequest();
         last_send_pck_time_ = GET_APP_TIME;
     }
 }
 
-class Session::LargePacketHelper {
-public:
-    static INetPacket &UnpackPacket(INetPacket &pck) {
-        const uint32 len = pck.Read<uint32>();
-        pck.SetOpcode(pck.Read<uint16>());
-        if (len != pck.GetReadableSize() + LARGE_PACKET_HEADER_SIZE) {
-            THROW_EXCEPTION(NetStreamException());
-        }
-        return pck;
-    }
-    static void WritePacketHeader(INetPacket &pck, size_t size, uint32 opcode) {
-        pck.Write<uint32>(size + LARGE_PACKET_HEADER_SIZE);
-        pck.Write<uint16>(opcode);
-    }
-    static const size_t LARGE_PACKET_HEADER_SIZE = 4 + 2;
-};
-
-void Session::PushRecvFragmentPacket(INetPacket *pck)
+void Session::PushSendPacket(const SharedNetPacket &pck)
 {
-    const size_t packet_total_size = pck->GetTotalSize();
-    const uint32 number = pck->Read<uint32>();
-    do {
-        std::lock_guard<std::mutex> lock(fragment_mutex_);
-        INetPacket *&packet = fragment_packets_[number];
-        if (packet == nullptr) {
-            packet = pck;
-        } else {
-            packet->Append(pck->GetReadableBuffer(), pck->GetReadableSize());
-            delete pck;
-        }
-        if (packet_total_size < INetPacket::MAX_BUFFER_SIZE) {
-            OnRecvPacket(&LargePacketHelper::UnpackPacket(*packet));
-            fragment_packets_.erase(number);
-        } else if (packet->GetTotalSize() > overflow_packet_max_size_) {
-            THROW_EXCEPTION(NetStreamException());
-        }
-    } while (0);
+    if (IsActive() && connection_) {
+        connection_->GetSendBuffer().WritePacket(pck);
+        OnSendPacket(pck.GetOpcode(), pck.GetSize());
+        connection_->PostWriteRequest();
+        last_send_pck_time_ = GET_APP_TIME;
+    }
 }
 
 void Session::PushSendOverflowPacket(const INetPacket &pck)
@@ -327,53 +377,64 @@ void Session::PushSendOverflowPacket(const INetPacket &pck, const char *data, si
 
 void Session::PushSendFragmentPacket(uint32 opcode, ConstNetBuffer datas[], size_t count)
 {
+    DBGASSERT(count < MAX_SEND_DATA_SPANS);
     size_t data_total_size = 0;
     for (size_t i = 0; i < count; ++i) {
         data_total_size += datas[i].GetTotalSize();
     }
 
-    NetPacket packet(OPCODE_LARGE_PACKET);
+    TNetPacket<32> packet(OPCODE_LARGE_PACKET);
     packet << (uint32)overflow_packet_count_.fetch_add(1);
     const size_t packet_prefix_size = packet.GetTotalSize();
-    LargePacketHelper::WritePacketHeader(packet, data_total_size, opcode);
+    FragmentAssembler::WritePacketHeader(packet, data_total_size, opcode);
 
-    bool is_residual_data = true;
-    for (size_t i = 0; i < count; ++i) {
-        auto &data = datas[i];
-        while (!data.IsReadableEmpty()) {
-            const char *data_buffer = data.GetReadableBuffer();
-            const size_t packet_space_size = INetPacket::MAX_BUFFER_SIZE - packet.GetTotalSize();
-            const size_t data_avail_size = std::min(data.GetReadableSize(), packet_space_size);
-            if (data_avail_size < packet_space_size && data_avail_size < data_total_size) {
-                packet.Append(data_buffer, data_avail_size);
-            } else {
-                connection_->GetSendBuffer().WritePacket(packet, data_buffer, data_avail_size);
-                is_residual_data = data_avail_size >= packet_space_size;
-                packet.Shrink(packet_prefix_size);
+    // a full fragment is always followed by another, the short one ends it.
+    SendDataSpan spans[MAX_SEND_DATA_SPANS];
+    size_t index = 0, packet_space_size = 0;
+    do {
+        size_t n = 0;
+        spans[n].data = packet.GetBuffer();
+        spans[n++].size = packet.GetTotalSize();
+        packet_space_size = INetPacket::MAX_BUFFER_SIZE - packet.GetTotalSize();
+        for (; index < count && packet_space_size > 0; ++index) {
+            auto &data = datas[index];
+            const size_t data_avail_size =
+                std::min(data.GetReadableSize(), packet_space_size);
+            if (data_avail_size != 0) {
+                spans[n].data = data.GetReadableBuffer();
+                spans[n++].size = data_avail_size;
+                data.AdjustReadPos(data_avail_size);
+                packet_space_size -= data_avail_size;
+                data_total_size -= data_avail_size;
+            }
+            if (!data.IsReadableEmpty()) {
+                break;
             }
-            data.AdjustReadPos(data_avail_size);
-            data_total_size -= data_avail_size;
         }
-    }
-
-    if (is_residual_data) {
-        connection_->GetSendBuffer().WritePacket(packet);
-    }
+        connection_->GetSendBuffer().WritePacket(OPCODE_LARGE_PACKET, spans, n);
+        packet.Shrink(packet_prefix_size);
+    } while (packet_space_size == 0);
 
     DBGASSERT(data_total_size == 0);
 }
 
+void Session::OnSendPacket(uint32 opcode, size_t size)
+{
+    if (NetworkStats::IsEnabled()) {
+        connection_->GetCounter().packets_sent.fetch_add(1, std::memory_order_relaxed);
+        NetworkStats::RecordSendPacket(opcode, size);
+    }
+}
+
 void Session::ClearRecvPacket()
 {
     INetPacket *pck = nullptr;
+    while (recv_batch_.Dequeue(pck)) {
+        delete pck;
+        ++handled_packet_count_;
+    }
     while (recv_queue_.Dequeue(pck)) {
         delete pck;
+        ++handled_packet_count_;
     }
-    do {
-        std::lock_guard<std::mutex> lock(fragment_mutex_);
-        for (auto &pair : fragment_packets_) {
-            delete pair.second;
-        }
-        fragment_packets_.clear();
-    } while (0);
 }
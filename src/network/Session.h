@@ -1,13 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
-#include <unordered_map>
 #include "NetBuffer.h"
 #include "NetPacket.h"
-#include "MultiBufferQueue.h"
+#include "LockFreeBufferQueue.h"
 
-class SessionManager;
+class SessionShard;
 class Connection;
+class ReliableUdp;
+class ShmChannel;
+class WheelTimer;
 
 enum SessionHandleStatus {
     SessionHandleSuccess,
@@ -36,26 +39,35 @@ public:
     Session();
     virtual ~Session();
 
+    // an address of "unix:/path" connects to a unix domain socket, and one
+    // of "shm:/path" to shared memory set up over such a socket.
     void ConnectServer(const std::string &address, const std::string &port);
+    void ConnectServerUdp(const std::string &address, const std::string &port);
 
     void SetConnection(std::shared_ptr<Connection> &&conn);
     const std::shared_ptr<Connection> &GetConnection() const;
 
     void SetEventObserver(IEventObserver *observer);
+    void SetFlushPolicy(size_t bytes, uint64 delay_us);
     void ClearPacketOverstockFlag();
 
     bool GrabShutdownFlag();
+    void ClearShutdownFlag();
     bool IsShutdownExpired() const;
 
-    void Update();
+    // returns true when packets were left over by the quota, 0 time is unlimited.
+    bool Update(size_t max_packets = SIZE_MAX, uint64 max_time_ns = 0);
     virtual int HandlePacket(INetPacket *pck) = 0;
 
+    size_t GetRecvBacklog() const;
+
     virtual void PushRecvPacket(INetPacket *pck);
 
     virtual void PushSendPacket(const INetPacket &pck);
     virtual void PushSendPacket(const char *data, size_t size);
     virtual void PushSendPacket(const INetPacket &pck, const INetPacket &data);
     virtual void PushSendPacket(const INetPacket &pck, const char *data, size_t size);
+    virtual void PushSendPacket(const SharedNetPacket &pck);
 
     virtual void KillSession();
     virtual void ShutdownSession();
@@ -72,13 +84,31 @@ public:
     virtual size_t GetSendDataSize() const;
 
     virtual int GetConnectionLoadValue() const;
+    virtual bool IsZeroCopyRecvPacket() const;
+    // large packets arrive as ChunkNetPacket instead of being flattened.
+    virtual bool IsChunkedLargePacket() const;
+    // packets are parsed in place from a mirrored buffer, see CircularBuffer.
+    virtual bool IsMirroredRecvBuffer() const;
+    // tunes a reliable udp connection, the default favours latency.
+    virtual void ConfigReliableUdp(ReliableUdp &rudp) const;
+    // tunes a shared memory connection, the ring size of the accepting side.
+    virtual void ConfigShmChannel(ShmChannel &shm) const {}
 
     const std::string &GetHost() const;
     unsigned long GetIPv4() const;
     unsigned short GetPort() const;
 
-    void SetManager(SessionManager *manager) { manager_ = manager;}
-    SessionManager *GetManager() const { return manager_; }
+    // a move to another shard sets it on the old shard's thread, while any
+    // thread may read it to shut the session down.
+    void SetManager(SessionShard *manager) {
+        manager_.store(manager, std::memory_order_release);
+    }
+    SessionShard *GetManager() const {
+        return manager_.load(std::memory_order_acquire);
+    }
+    // owned by the wheel of the manager, for idle and shutdown expiry.
+    void SetExpiryTimer(WheelTimer *timer) { expiry_timer_ = timer; }
+    WheelTimer *GetExpiryTimer() const { return expiry_timer_; }
 
     void SetStatus(Status status) { status_ = status; }
     bool IsStatus(Status status) const { return status_ == status; }
@@ -87,11 +117,11 @@ public:
 
     uint64 last_recv_pck_time() const { return last_recv_pck_time_; }
     uint64 last_send_pck_time() const { return last_send_pck_time_; }
+    size_t overflow_packet_max_size() const { return overflow_packet_max_size_; }
 
 protected:
     virtual void OnRecvPacket(INetPacket *pck);
 
-    void ClearShutdownFlag();
     void ClearRecvPacket();
 
     void set_overflow_packet_max_size(size_t size) {
@@ -99,27 +129,29 @@ protected:
     }
 
 private:
-    class LargePacketHelper;
-    void PushRecvFragmentPacket(INetPacket *pck);
     void PushSendOverflowPacket(const INetPacket &pck);
     void PushSendOverflowPacket(const INetPacket &pck, const INetPacket &data);
     void PushSendOverflowPacket(const INetPacket &pck, const char *data, size_t size);
     void PushSendFragmentPacket(uint32 opcode, ConstNetBuffer datas[], size_t count);
+    void OnSendPacket(uint32 opcode, size_t size);
 
     Status status_;
-    SessionManager *manager_;
+    std::atomic<SessionShard*> manager_;
+    WheelTimer *expiry_timer_;
 
     std::shared_ptr<Connection> connection_;
-    MultiBufferQueue<INetPacket*> recv_queue_;
+    LockFreeBufferQueue<INetPacket*> recv_queue_;
+    LockFreeBufferQueue<INetPacket*>::Batch recv_batch_;
 
     IEventObserver *event_observer_;
     bool is_overstocked_packet_;
 
-    std::mutex fragment_mutex_;
-    std::unordered_map<uint32, INetPacket*> fragment_packets_;
     std::atomic<uint32> overflow_packet_count_;
     size_t overflow_packet_max_size_;
 
     std::atomic<time_t> shutdown_time_;
     uint64 last_recv_pck_time_, last_send_pck_time_;
+
+    std::atomic<size_t> recv_packet_count_;
+    size_t handled_packet_count_;
 };
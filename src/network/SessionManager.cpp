@@ -1,120 +1,147 @@
 #include "SessionManager.h"
+#include "Thread.h"
 #include "System.h"
 #include "OS.h"
 
-SessionManager::SessionManager()
+class SessionManager::ShardThread : public Thread
 {
-}
+public:
+    THREAD_RUNTIME(SessionShardThread)
 
-SessionManager::~SessionManager()
+    ShardThread() : tick_time_(0) {}
+
+    SessionShard &GetShard() { return shard_; }
+
+private:
+    virtual void Kernel() {
+        shard_.Update();
+        if (tick_time_ + SESSION_SHARD_TICK_INTERVAL <= GET_SYS_TIME) {
+            tick_time_ = GET_SYS_TIME;
+            shard_.Tick();
+        }
+        OS::SleepMS(1);
+    }
+
+    SessionShard shard_;
+    uint64 tick_time_;
+};
+
+SessionManager::SessionManager()
+: shard_count_(0)
+, next_shard_(0)
 {
 }
 
-void SessionManager::Update()
+SessionManager::~SessionManager()
 {
-    CheckSessions();
-    UpdateSessions();
+    for (auto shard : shards_) {
+        delete shard;
+    }
 }
 
-void SessionManager::Tick()
+bool SessionManager::StartShards()
 {
-    TickSessions();
+    for (size_t i = shards_.size(); i < shard_count_; ++i) {
+        ShardThread *shard = new ShardThread();
+        SessionShard &session_shard = shard->GetShard();
+        session_shard.session_packet_quota_ = session_packet_quota_;
+        session_shard.session_time_quota_ns_ = session_time_quota_ns_;
+        session_shard.frame_time_budget_ns_ = frame_time_budget_ns_;
+        session_shard.idle_timeout_ = idle_timeout_;
+        session_shard.external_cleanup_ = external_cleanup_;
+        if (!shard_affinity_.empty()) {
+            shard->SetAffinity(shard_affinity_[i % shard_affinity_.size()]);
+        }
+        shards_.push_back(shard);
+        if (!shard->Start()) {
+            return false;
+        }
+    }
+    return true;
 }
 
+// shard threads stop first, their sessions are then drained here.
 void SessionManager::Stop()
 {
-    while (true) {
-        ShutdownAll();
-        if (!sessions_.empty() ||
-            !waiting_room_.IsEmpty() ||
-            !recycle_bin_.IsEmpty())
-        {
-            if (external_cleanup_) {
-                external_cleanup_();
-            }
-            Update();
-            OS::SleepMS(1);
-            System::Update();
-        } else {
-            break;
-        }
+    for (auto shard : shards_) {
+        shard->Stop();
     }
+    for (auto shard : shards_) {
+        shard->GetShard().Stop();
+        delete shard;
+    }
+    shards_.clear();
+    SessionShard::Stop();
 }
 
-void SessionManager::CheckSessions()
+void SessionManager::SetUpdateBudget(size_t session_packets, uint64 session_time_us, uint64 frame_time_us)
 {
-    Session *session = nullptr;
-    while (waiting_room_.Dequeue(session)) {
-        if (session->IsActive()) {
-            session->OnManaged();
-            session->SetStatus(Session::Running);
-        }
-        sessions_.insert(session);
+    SessionShard::SetUpdateBudget(session_packets, session_time_us, frame_time_us);
+    for (auto shard : shards_) {
+        SessionShard *session_shard = &shard->GetShard();
+        session_shard->Post([=]() {
+            session_shard->SetUpdateBudget(session_packets, session_time_us, frame_time_us);
+        });
     }
+}
 
-    const size_t size = recycle_bin_.GetSize();
-    for (size_t i = 0; i < size && recycle_bin_.Dequeue(session); ++i) {
-        if (sessions_.erase(session) != 0) {
-            session->OnShutdownSession();
-        }
-        if (session->IsIndependent()) {
-            session->DeleteObject();
-            continue;
-        }
-        if (!session->HasSendDataAwaiting() || session->IsShutdownExpired()) {
-            session->Disconnect();
-        }
-        recycle_bin_.Enqueue(session);
+void SessionManager::SetIdleTimeout(uint64 ms)
+{
+    SessionShard::SetIdleTimeout(ms);
+    for (auto shard : shards_) {
+        SessionShard *session_shard = &shard->GetShard();
+        session_shard->Post([=]() {
+            session_shard->SetIdleTimeout(ms);
+        });
     }
 }
 
-void SessionManager::UpdateSessions()
+SessionShard *SessionManager::GetShard(size_t index) const
 {
-    for (auto session : sessions_) {
-        session->Update();
-    }
+    return index < shards_.size() ? &shards_[index]->GetShard() : nullptr;
 }
 
-void SessionManager::TickSessions()
+SessionShard *SessionManager::SelectShard(uint64 key)
 {
-    for (auto session : sessions_) {
-        session->OnTick();
+    if (shards_.empty()) {
+        return this;
     }
+    return &shards_[key % shards_.size()]->GetShard();
 }
 
 void SessionManager::AddSession(Session *session)
 {
-    waiting_room_.Enqueue(session);
-    session->SetManager(this);
+    if (shards_.empty()) {
+        SessionShard::AddSession(session);
+    } else {
+        SelectShard(next_shard_.fetch_add(1))->AddSession(session);
+    }
 }
 
-void SessionManager::RemoveSession(Session *session)
+void SessionManager::AddSession(Session *session, uint64 key)
 {
-    recycle_bin_.Enqueue(session);
-    session->SetManager(nullptr);
+    SelectShard(key)->AddSession(session);
 }
 
-void SessionManager::KillSession(Session *session)
+void SessionManager::MoveSession(Session *session, uint64 key)
 {
-    if (session->IsActive()) {
-        session->Disconnect();
-        session->ShutdownSession();
+    SessionShard *shard = session->GetManager();
+    if (shard != nullptr) {
+        shard->MoveSession(session, SelectShard(key));
     }
 }
 
-void SessionManager::ShutdownSession(Session *session)
+void SessionManager::PostToShard(uint64 key, const std::function<void()> &task)
 {
-    if (session->IsActive()) {
-        session->Disable();
-        if (session->GrabShutdownFlag()) {
-            RemoveSession(session);
-        }
-    }
+    SelectShard(key)->Post(task);
 }
 
-void SessionManager::ShutdownAll()
+void SessionManager::PostToAllShards(const std::function<void()> &task)
 {
-    for (auto session : sessions_) {
-        session->ShutdownSession();
+    if (shards_.empty()) {
+        Post(task);
+    }
+    for (auto shard : shards_) {
+        shard->GetShard().Post(task);
     }
 }
@@ -1,42 +1,49 @@
 #pragma once
 
 #include "Singleton.h"
-#include <unordered_set>
-#include "Session.h"
-#include "ThreadSafeQueue.h"
+#include <atomic>
+#include "SessionShard.h"
 
-class SessionManager : public Singleton<SessionManager>
+#define SESSION_SHARD_TICK_INTERVAL (1000)
+
+// without shards every session lives on the thread calling Update.  with
+// shards each one runs Update and Tick on its own thread, sessions are
+// placed by key, or round-robin when none is given.
+class SessionManager : public SessionShard, public Singleton<SessionManager>
 {
 public:
     SessionManager();
     virtual ~SessionManager();
 
-    void Update();
-    void Tick();
+    void SetShardCount(size_t count) { shard_count_ = count; }
+    void SetShardAffinity(const std::vector<int> &cpus) { shard_affinity_ = cpus; }
+    bool StartShards();
     void Stop();
 
-    void AddSession(Session *session);
-    void KillSession(Session *session);
-    void ShutdownSession(Session *session);
-
-    void SetExternalCleanup(const std::function<void()> &func) {
-        external_cleanup_ = func;
-    }
+    // applies to every shard, see SessionShard::SetUpdateBudget.
+    void SetUpdateBudget(size_t session_packets, uint64 session_time_us, uint64 frame_time_us);
+    // applies to every shard, see SessionShard::SetIdleTimeout.
+    void SetIdleTimeout(uint64 ms);
 
-private:
-    void RemoveSession(Session *session);
+    size_t GetShardCount() const { return shards_.size(); }
+    SessionShard *GetShard(size_t index) const;
+    SessionShard *SelectShard(uint64 key);
 
-    void CheckSessions();
-    void UpdateSessions();
-    void TickSessions();
+    void AddSession(Session *session);
+    void AddSession(Session *session, uint64 key);
+    // call it from the thread that updates the session, such as a handler.
+    void MoveSession(Session *session, uint64 key);
 
-    void ShutdownAll();
+    void PostToShard(uint64 key, const std::function<void()> &task);
+    void PostToAllShards(const std::function<void()> &task);
 
-    std::unordered_set<Session*> sessions_;
-    ThreadSafeQueue<Session*> waiting_room_;
-    ThreadSafeQueue<Session*> recycle_bin_;
+private:
+    class ShardThread;
 
-    std::function<void()> external_cleanup_;
+    size_t shard_count_;
+    std::vector<int> shard_affinity_;
+    std::vector<ShardThread*> shards_;
+    std::atomic<size_t> next_shard_;
 };
 
 #define sSessionManager (*SessionManager::instance())
@@ -0,0 +1,284 @@
+#include "SessionShard.h"
+#include "NetworkStats.h"
+#include "timer/WheelTimer.h"
+#include "System.h"
+#include "OS.h"
+
+class SessionShard::ExpiryTimer : public WheelTimer
+{
+public:
+    ExpiryTimer(SessionShard *shard, Session *session)
+        : WheelTimer(SESSION_EXPIRY_RECHECK_INTERVAL)
+        , shard_(shard)
+        , session_(session)
+    {
+    }
+
+protected:
+    virtual void OnActivate()
+    {
+        shard_->OnSessionExpiry(session_);
+    }
+
+private:
+    SessionShard * const shard_;
+    Session * const session_;
+};
+
+
+SessionShard::SessionShard()
+: update_cursor_(0)
+, is_update_order_dirty_(false)
+, session_packet_quota_(SIZE_MAX)
+, session_time_quota_ns_(0)
+, frame_time_budget_ns_(0)
+, idle_timeout_(0)
+, expiry_timers_(SESSION_EXPIRY_TIMER_PARTICLE, GET_APP_TIME)
+{
+}
+
+SessionShard::~SessionShard()
+{
+}
+
+void SessionShard::Update()
+{
+    expiry_timers_.Update(GET_APP_TIME);
+    RunTasks();
+    CheckSessions();
+    UpdateSessions();
+}
+
+void SessionShard::Tick()
+{
+    TickSessions();
+}
+
+void SessionShard::Stop()
+{
+    while (true) {
+        ShutdownAll();
+        if (!sessions_.empty() ||
+            !waiting_room_.IsEmpty() ||
+            !recycle_bin_.IsEmpty() ||
+            !tasks_.IsEmpty())
+        {
+            if (external_cleanup_) {
+                external_cleanup_();
+            }
+            Update();
+            OS::SleepMS(1);
+            System::Update();
+        } else {
+            break;
+        }
+    }
+}
+
+void SessionShard::RunTasks()
+{
+    std::function<void()> task;
+    const size_t size = tasks_.GetSize();
+    for (size_t i = 0; i < size && tasks_.Dequeue(task); ++i) {
+        task();
+    }
+}
+
+void SessionShard::CheckSessions()
+{
+    Session *session = nullptr;
+    MultiBufferQueue<Session*>::Batch batch;
+    waiting_room_.Detach(batch);
+    while (batch.Dequeue(session)) {
+        // a session moved in from another shard is already running.
+        if (session->IsActive() && session->IsStatus(Session::Idle)) {
+            session->OnManaged();
+            session->SetStatus(Session::Running);
+        }
+        sessions_.insert(session);
+        is_update_order_dirty_ = true;
+        if (idle_timeout_ != 0) {
+            ArmExpiryTimer(session, session->last_recv_pck_time() + idle_timeout_);
+        }
+    }
+
+    const size_t size = recycle_bin_.GetSize();
+    for (size_t i = 0; i < size && recycle_bin_.Dequeue(session); ++i) {
+        if (sessions_.erase(session) != 0) {
+            session->OnShutdownSession();
+            is_update_order_dirty_ = true;
+            ArmExpiryTimer(session, GET_APP_TIME + SESSION_SHUTDOWN_GRACE_TIME);
+        }
+        if (session->IsIndependent()) {
+            DisarmExpiryTimer(session);
+            session->DeleteObject();
+            continue;
+        }
+        if (!session->HasSendDataAwaiting()) {
+            session->Disconnect();
+        }
+        recycle_bin_.Enqueue(session);
+    }
+}
+
+// a tick that runs out of frame budget resumes from the first session it
+// skipped, so every session is served in turn.
+void SessionShard::UpdateSessions()
+{
+    if (is_update_order_dirty_) {
+        update_order_.assign(sessions_.begin(), sessions_.end());
+        is_update_order_dirty_ = false;
+    }
+
+    SessionUpdateStats stats;
+    const size_t n = stats.sessions = update_order_.size();
+    const uint64 start_time = NetworkStats::GetTimeNs();
+    const uint64 deadline = frame_time_budget_ns_ != 0 ? start_time + frame_time_budget_ns_ : 0;
+    size_t i = 0;
+    for (; i < n; ++i) {
+        if (deadline != 0 && i != 0 && NetworkStats::GetTimeNs() >= deadline) {
+            break;
+        }
+        Session *session = update_order_[(update_cursor_ + i) % n];
+        const size_t backlog = session->GetRecvBacklog();
+        if (session->Update(session_packet_quota_, session_time_quota_ns_)) {
+            stats.deferred_sessions += 1;
+        }
+        const size_t remain = session->GetRecvBacklog();
+        stats.handled_packets += backlog > remain ? backlog - remain : 0;
+        stats.backlog_packets += remain;
+    }
+    for (size_t j = i; j < n; ++j) {
+        stats.backlog_packets += update_order_[(update_cursor_ + j) % n]->GetRecvBacklog();
+    }
+    stats.skipped_sessions = n - i;
+    stats.update_time_ns = NetworkStats::GetTimeNs() - start_time;
+    update_cursor_ = n != 0 ? (update_cursor_ + i) % n : 0;
+    update_stats_ = stats;
+}
+
+void SessionShard::TickSessions()
+{
+    for (auto session : sessions_) {
+        session->OnTick();
+    }
+}
+
+void SessionShard::AddSession(Session *session)
+{
+    session->SetManager(this);
+    waiting_room_.Enqueue(session);
+}
+
+void SessionShard::RemoveSession(Session *session)
+{
+    session->SetManager(nullptr);
+    recycle_bin_.Enqueue(session);
+}
+
+void SessionShard::KillSession(Session *session)
+{
+    if (session->IsActive()) {
+        session->Disconnect();
+        session->ShutdownSession();
+    }
+}
+
+void SessionShard::ShutdownSession(Session *session)
+{
+    if (session->IsActive()) {
+        session->Disable();
+        if (session->GrabShutdownFlag()) {
+            // the session may have moved to another shard meanwhile.
+            session->GetManager()->RemoveSession(session);
+        }
+    }
+}
+
+// the shutdown flag is held while the session changes hands, a shutdown
+// racing with it either keeps the session here or finds the new shard.
+void SessionShard::MoveSession(Session *session, SessionShard *shard)
+{
+    Post([=]() {
+        if (shard == this || !session->IsActive() || !session->GrabShutdownFlag()) {
+            return;
+        }
+        if (sessions_.erase(session) != 0) {
+            is_update_order_dirty_ = true;
+            DisarmExpiryTimer(session);
+            shard->AddSession(session);
+        }
+        session->ClearShutdownFlag();
+        if (!session->IsActive() && session->GrabShutdownFlag()) {
+            session->GetManager()->RemoveSession(session);
+        }
+    });
+}
+
+void SessionShard::SetIdleTimeout(uint64 ms)
+{
+    const bool is_enabling = idle_timeout_ == 0 && ms != 0;
+    idle_timeout_ = ms;
+    if (is_enabling) {
+        for (auto session : sessions_) {
+            ArmExpiryTimer(session, session->last_recv_pck_time() + idle_timeout_);
+        }
+    }
+}
+
+void SessionShard::ArmExpiryTimer(Session *session, uint64 deadline)
+{
+    WheelTimer *timer = session->GetExpiryTimer();
+    if (timer != nullptr) {
+        timer->RePush(deadline);
+    } else {
+        timer = new ExpiryTimer(this, session);
+        session->SetExpiryTimer(timer);
+        expiry_timers_.Push(timer, deadline);
+    }
+}
+
+void SessionShard::DisarmExpiryTimer(Session *session)
+{
+    WheelTimer *timer = session->GetExpiryTimer();
+    if (timer != nullptr) {
+        session->SetExpiryTimer(nullptr);
+        expiry_timers_.Pop(timer);
+    }
+}
+
+// traffic only moves last_recv_pck_time, a timer coming due early is
+// pushed on to the real deadline.  a session shutting down gets its send
+// data out until the grace time is over.
+void SessionShard::OnSessionExpiry(Session *session)
+{
+    WheelTimer *timer = session->GetExpiryTimer();
+    if (!session->IsActive()) {
+        if (session->IsShutdownExpired()) {
+            session->Disconnect();
+        }
+        return;
+    }
+    if (idle_timeout_ == 0) {
+        DisarmExpiryTimer(session);
+        return;
+    }
+    const uint64 deadline = session->last_recv_pck_time() + idle_timeout_;
+    if (deadline <= GET_APP_TIME) {
+        session->ShutdownSession();
+    } else {
+        timer->RePush(deadline);
+    }
+}
+
+void SessionShard::Post(const std::function<void()> &task)
+{
+    tasks_.Enqueue(task);
+}
+
+void SessionShard::ShutdownAll()
+{
+    for (auto session : sessions_) {
+        session->ShutdownSession();
+    }
+}
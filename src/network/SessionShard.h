@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <unordered_set>
+#include <vector>
+#include "Session.h"
+#include "ThreadSafeQueue.h"
+#include "MultiBufferQueue.h"
+#include "timer/WheelTimerMgr.h"
+
+#define SESSION_EXPIRY_TIMER_PARTICLE (100)
+#define SESSION_EXPIRY_RECHECK_INTERVAL (1000)
+#define SESSION_SHUTDOWN_GRACE_TIME (30*1000)
+
+struct SessionUpdateStats {
+    size_t sessions = 0;
+    size_t deferred_sessions = 0, skipped_sessions = 0;
+    uint64 handled_packets = 0, backlog_packets = 0;
+    uint64 update_time_ns = 0;
+};
+
+// owns a set of sessions and updates them on one thread, the plain
+// SessionManager is one shard and sharded mode runs more on their own threads.
+class SessionShard
+{
+public:
+    SessionShard();
+    virtual ~SessionShard();
+
+    void Update();
+    void Tick();
+    void Stop();
+
+    void AddSession(Session *session);
+    void KillSession(Session *session);
+    void ShutdownSession(Session *session);
+
+    // hands a session over to another shard after its current update,
+    // call it from the thread that updates this shard.
+    void MoveSession(Session *session, SessionShard *shard);
+
+    // runs the task on the updating thread before its next update.
+    void Post(const std::function<void()> &task);
+
+    void SetExternalCleanup(const std::function<void()> &func) {
+        external_cleanup_ = func;
+    }
+
+    // per session packets and time, and time for all sessions in a tick,
+    // 0 means unlimited.  sessions left over go first next tick.
+    void SetUpdateBudget(size_t session_packets, uint64 session_time_us, uint64 frame_time_us) {
+        session_packet_quota_ = session_packets != 0 ? session_packets : SIZE_MAX;
+        session_time_quota_ns_ = session_time_us * 1000;
+        frame_time_budget_ns_ = frame_time_us * 1000;
+    }
+    // sessions receiving nothing this many milliseconds are shut down, 0
+    // disables it.  call it from the updating thread.
+    void SetIdleTimeout(uint64 ms);
+    uint64 GetIdleTimeout() const { return idle_timeout_; }
+    // stats of the last UpdateSessions, read by the updating thread.
+    const SessionUpdateStats &GetUpdateStats() const { return update_stats_; }
+
+private:
+    friend class SessionManager;
+    class ExpiryTimer;
+
+    void RemoveSession(Session *session);
+
+    void ArmExpiryTimer(Session *session, uint64 deadline);
+    void DisarmExpiryTimer(Session *session);
+    void OnSessionExpiry(Session *session);
+
+    void RunTasks();
+    void CheckSessions();
+    void UpdateSessions();
+    void TickSessions();
+
+    void ShutdownAll();
+
+    std::unordered_set<Session*> sessions_;
+    std::vector<Session*> update_order_;
+    size_t update_cursor_;
+    bool is_update_order_dirty_;
+
+    size_t session_packet_quota_;
+    uint64 session_time_quota_ns_, frame_time_budget_ns_;
+    SessionUpdateStats update_stats_;
+
+    // a deadline is re-armed when it comes due rather than on every
+    // packet, so a tick only touches sessions whose time is up.
+    uint64 idle_timeout_;
+    WheelTimerMgr expiry_timers_;
+
+    MultiBufferQueue<Session*> waiting_room_;
+    ThreadSafeQueue<Session*> recycle_bin_;
+    ThreadSafeQueue<std::function<void()>> tasks_;
+
+    std::function<void()> external_cleanup_;
+};
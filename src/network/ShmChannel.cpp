@@ -0,0 +1,392 @@
+#include "ShmChannel.h"
+#include "Macro.h"
+#include "Exception.h"
+#include <atomic>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define SHM_CACHE_LINE (64)
+#define SHM_HANDSHAKE_MAGIC (0x46534852)
+#define SHM_HANDSHAKE_FDS (5)
+
+// each index on a cache line of its own, the other side only reads it.
+struct ShmChannel::RingHeader {
+    std::atomic<uint64> head;
+    char pad0[SHM_CACHE_LINE - sizeof(std::atomic<uint64>)];
+    std::atomic<uint64> tail;
+    char pad1[SHM_CACHE_LINE - sizeof(std::atomic<uint64>)];
+    std::atomic<uint32> reader_parked, writer_parked;
+    char pad2[SHM_CACHE_LINE - sizeof(std::atomic<uint32>) * 2];
+};
+
+struct ShmHandshake {
+    uint32 magic;
+    uint32 reserved;
+    uint64 ring_size;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared rings need lock free atomics");
+
+ShmChannel::ShmChannel(boost::asio::io_service &io_service)
+: io_service_(io_service)
+, ring_size_(SHM_DEFAULT_RING_SIZE)
+, spin_time_us_(SHM_DEFAULT_SPIN_TIME)
+, memory_(nullptr)
+, memory_size_(0)
+, events_{-1, -1, -1, -1}
+, send_ring_()
+, recv_ring_()
+, read_event_value_(0)
+, write_event_value_(0)
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+, read_waiter_(io_service)
+, write_waiter_(io_service)
+#endif
+{
+}
+
+ShmChannel::~ShmChannel()
+{
+    Close();
+}
+
+void ShmChannel::SetRingSize(size_t size)
+{
+    ring_size_ = 4096;
+    while (ring_size_ < size) {
+        ring_size_ <<= 1;
+    }
+}
+
+#if defined(__linux__)
+// ring 0 runs from the creating side to the attaching side.
+void ShmChannel::Create(SOCKET socket, boost::system::error_code &ec)
+{
+    int memfd = syscall(SYS_memfd_create, "fusion-shm", MFD_CLOEXEC);
+    if (memfd == -1) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        return;
+    }
+    _defer(close(memfd));
+
+    const size_t ring_size = ring_size_;
+    if (ftruncate(memfd, (sizeof(RingHeader) + ring_size) * 2) != 0) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        return;
+    }
+    for (auto &event : events_) {
+        event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event == -1) {
+            ec.assign(errno, boost::asio::error::get_system_category());
+            Close();
+            return;
+        }
+    }
+
+    MapMemory(memfd, ring_size, ec);
+    if (ec) {
+        Close();
+        return;
+    }
+    send_ring_.data_event = events_[0], send_ring_.space_event = events_[1];
+    recv_ring_.data_event = events_[2], recv_ring_.space_event = events_[3];
+
+    ShmHandshake handshake = {SHM_HANDSHAKE_MAGIC, 0, ring_size};
+    struct iovec iov = {&handshake, sizeof(handshake)};
+    char control[CMSG_SPACE(sizeof(int) * SHM_HANDSHAKE_FDS)];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * SHM_HANDSHAKE_FDS);
+    const int fds[SHM_HANDSHAKE_FDS] = {memfd, events_[0], events_[1], events_[2], events_[3]};
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(socket, &msg, MSG_NOSIGNAL) != sizeof(handshake)) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        Close();
+        return;
+    }
+
+    OpenEvents(ec);
+}
+
+void ShmChannel::Attach(SOCKET socket, boost::system::error_code &ec)
+{
+    ShmHandshake handshake;
+    struct iovec iov = {&handshake, sizeof(handshake)};
+    char control[CMSG_SPACE(sizeof(int) * SHM_HANDSHAKE_FDS)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    const ssize_t bytes = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (bytes == -1) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        return;
+    }
+
+    int fds[SHM_HANDSHAKE_FDS] = {-1, -1, -1, -1, -1};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(fds, CMSG_DATA(cmsg), std::min(sizeof(fds), size_t(cmsg->cmsg_len - CMSG_LEN(0))));
+    }
+    _defer(if (fds[0] != -1) close(fds[0]));
+    for (int i = 0; i < 4; ++i) {
+        events_[i] = fds[i + 1];
+    }
+
+    struct stat st;
+    if (bytes != sizeof(handshake) || handshake.magic != SHM_HANDSHAKE_MAGIC ||
+        IS_ARRAY_CONTAIN_VALUE(fds, -1) || handshake.ring_size == 0 ||
+        (handshake.ring_size & (handshake.ring_size - 1)) != 0 ||
+        fstat(fds[0], &st) != 0 ||
+        size_t(st.st_size) != (sizeof(RingHeader) + handshake.ring_size) * 2) {
+        ec = boost::asio::error::invalid_argument;
+        Close();
+        return;
+    }
+
+    MapMemory(fds[0], handshake.ring_size, ec);
+    if (ec) {
+        Close();
+        return;
+    }
+    std::swap(send_ring_, recv_ring_);
+    send_ring_.data_event = events_[2], send_ring_.space_event = events_[3];
+    recv_ring_.data_event = events_[0], recv_ring_.space_event = events_[1];
+
+    OpenEvents(ec);
+}
+
+void ShmChannel::MapMemory(int memfd, size_t ring_size, boost::system::error_code &ec)
+{
+    const size_t size = (sizeof(RingHeader) + ring_size) * 2;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (memory == MAP_FAILED) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        return;
+    }
+    memory_ = memory;
+    memory_size_ = size;
+
+    char *ptr = static_cast<char*>(memory);
+    for (Ring *ring : {&send_ring_, &recv_ring_}) {
+        ring->header = reinterpret_cast<RingHeader*>(ptr);
+        ring->data = ptr + sizeof(RingHeader);
+        ring->mask = ring_size - 1;
+        ptr += sizeof(RingHeader) + ring_size;
+    }
+}
+
+// the waiters own duplicates, the originals are kept for notifying.
+void ShmChannel::OpenEvents(boost::system::error_code &ec)
+{
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    const std::pair<boost::asio::posix::stream_descriptor*, int> waiters[] = {
+        {&read_waiter_, recv_ring_.data_event}, {&write_waiter_, send_ring_.space_event}};
+    for (auto &waiter : waiters) {
+        const int event = dup(waiter.second);
+        if (event == -1) {
+            ec.assign(errno, boost::asio::error::get_system_category());
+            break;
+        }
+        waiter.first->assign(event, ec);
+        if (ec) {
+            close(event);
+            break;
+        }
+    }
+    if (ec) {
+        Close();
+    }
+#else
+    ec = boost::asio::error::operation_not_supported;
+    Close();
+#endif
+}
+
+void ShmChannel::Close()
+{
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    boost::system::error_code ec;
+    read_waiter_.close(ec);
+    write_waiter_.close(ec);
+#endif
+    for (auto &event : events_) {
+        if (event != -1) {
+            close(event);
+            event = -1;
+        }
+    }
+    if (memory_ != nullptr) {
+        munmap(memory_, memory_size_);
+        memory_ = nullptr;
+        memory_size_ = 0;
+    }
+    send_ring_ = recv_ring_ = Ring();
+}
+
+void ShmChannel::Notify(int event)
+{
+    eventfd_write(event, 1);
+}
+#else
+void ShmChannel::Create(SOCKET socket, boost::system::error_code &ec)
+{
+    ec = boost::asio::error::operation_not_supported;
+}
+
+void ShmChannel::Attach(SOCKET socket, boost::system::error_code &ec)
+{
+    ec = boost::asio::error::operation_not_supported;
+}
+
+void ShmChannel::MapMemory(int memfd, size_t ring_size, boost::system::error_code &ec)
+{
+}
+
+void ShmChannel::OpenEvents(boost::system::error_code &ec)
+{
+}
+
+void ShmChannel::Close()
+{
+}
+
+void ShmChannel::Notify(int event)
+{
+}
+#endif
+
+// the fence pairs with the one in ParkReader, one of both sees the other.
+size_t ShmChannel::Write(const char *data, size_t size)
+{
+    RingHeader &header = *send_ring_.header;
+    const uint64 head = header.head.load(std::memory_order_relaxed);
+    const uint64 tail = header.tail.load(std::memory_order_acquire);
+    const size_t bytes = std::min(size, send_ring_.mask + 1 - GetUsedSize(send_ring_, head, tail));
+    if (bytes == 0) {
+        return 0;
+    }
+
+    const size_t offset = head & send_ring_.mask;
+    const size_t first = std::min(bytes, send_ring_.mask + 1 - offset);
+    memcpy(send_ring_.data + offset, data, first);
+    memcpy(send_ring_.data, data + first, bytes - first);
+    header.head.store(head + bytes, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header.reader_parked.load(std::memory_order_relaxed) != 0 &&
+        header.reader_parked.exchange(0) != 0) {
+        Notify(send_ring_.data_event);
+    }
+    return bytes;
+}
+
+size_t ShmChannel::Read(char *data, size_t size)
+{
+    RingHeader &header = *recv_ring_.header;
+    const uint64 tail = header.tail.load(std::memory_order_relaxed);
+    const uint64 head = header.head.load(std::memory_order_acquire);
+    const size_t bytes = std::min(size, GetUsedSize(recv_ring_, head, tail));
+    if (bytes == 0) {
+        return 0;
+    }
+
+    const size_t offset = tail & recv_ring_.mask;
+    const size_t first = std::min(bytes, recv_ring_.mask + 1 - offset);
+    memcpy(data, recv_ring_.data + offset, first);
+    memcpy(data + first, recv_ring_.data, bytes - first);
+    header.tail.store(tail + bytes, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header.writer_parked.load(std::memory_order_relaxed) != 0 &&
+        header.writer_parked.exchange(0) != 0) {
+        Notify(recv_ring_.space_event);
+    }
+    return bytes;
+}
+
+size_t ShmChannel::GetReadableSize() const
+{
+    const RingHeader &header = *recv_ring_.header;
+    return GetUsedSize(recv_ring_, header.head.load(std::memory_order_acquire),
+                       header.tail.load(std::memory_order_relaxed));
+}
+
+size_t ShmChannel::GetWritableSize() const
+{
+    const RingHeader &header = *send_ring_.header;
+    return send_ring_.mask + 1 - GetUsedSize(send_ring_,
+        header.head.load(std::memory_order_relaxed),
+        header.tail.load(std::memory_order_acquire));
+}
+
+size_t ShmChannel::GetUsedSize(const Ring &ring, uint64 head, uint64 tail)
+{
+    if (head - tail > ring.mask + 1) {
+        THROW_EXCEPTION(NetStreamException());
+    }
+    return size_t(head - tail);
+}
+
+bool ShmChannel::ParkReader()
+{
+    RingHeader &header = *recv_ring_.header;
+    header.reader_parked.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (GetReadableSize() != 0) {
+        header.reader_parked.store(0);
+        return false;
+    }
+    return true;
+}
+
+bool ShmChannel::ParkWriter()
+{
+    RingHeader &header = *send_ring_.header;
+    header.writer_parked.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (GetWritableSize() != 0) {
+        header.writer_parked.store(0);
+        return false;
+    }
+    return true;
+}
+
+// reading an eventfd resets it, a stale wakeup finds the ring empty again.
+void ShmChannel::AsyncWaitReadable(const WaitHandler &handler)
+{
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    read_waiter_.async_read_some(
+        boost::asio::buffer(&read_event_value_, sizeof(read_event_value_)),
+        std::bind(handler, std::placeholders::_1));
+#else
+    io_service_.post(std::bind(handler, boost::asio::error::operation_not_supported));
+#endif
+}
+
+void ShmChannel::AsyncWaitWritable(const WaitHandler &handler)
+{
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    write_waiter_.async_read_some(
+        boost::asio::buffer(&write_event_value_, sizeof(write_event_value_)),
+        std::bind(handler, std::placeholders::_1));
+#else
+    io_service_.post(std::bind(handler, boost::asio::error::operation_not_supported));
+#endif
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "AsioHeader.h"
+#include "Base.h"
+#include "Macro.h"
+#include <functional>
+
+#define SHM_DEFAULT_RING_SIZE (1024*1024)
+#define SHM_DEFAULT_SPIN_TIME (0)
+
+// a byte stream between two local processes through a pair of single
+// producer single consumer rings in a memfd.  the accepting side creates
+// the memory and passes it with the eventfds over a unix domain socket,
+// which stays open to notice the peer going away.  a side only waits on
+// an eventfd after it marked itself parked, so a busy link makes no calls.
+class ShmChannel
+{
+public:
+    typedef std::function<void(const boost::system::error_code &ec)> WaitHandler;
+
+    ShmChannel(boost::asio::io_service &io_service);
+    ~ShmChannel();
+
+    // rounded up to a power of two, only the creating side decides.
+    void SetRingSize(size_t size);
+    // polls an empty ring this long before parking, 0 parks at once.  it
+    // pays off only while the worker and the peer have cores of their own.
+    void SetSpinTime(uint64 us) { spin_time_us_ = us; }
+    uint64 GetSpinTime() const { return spin_time_us_; }
+
+    void Create(SOCKET socket, boost::system::error_code &ec);
+    void Attach(SOCKET socket, boost::system::error_code &ec);
+    void Close();
+    bool IsOpen() const { return memory_ != nullptr; }
+
+    // the peer may scribble on the indexes, a ring that claims more than
+    // it holds throws NetStreamException, and the connection closes.
+    size_t Write(const char *data, size_t size);
+    size_t Read(char *data, size_t size);
+    size_t GetReadableSize() const;
+    size_t GetWritableSize() const;
+
+    // false if the ring changed meanwhile, try again instead of waiting.
+    bool ParkReader();
+    bool ParkWriter();
+    void AsyncWaitReadable(const WaitHandler &handler);
+    void AsyncWaitWritable(const WaitHandler &handler);
+
+private:
+    struct RingHeader;
+    struct Ring {
+        RingHeader *header;
+        char *data;
+        size_t mask;
+        int data_event, space_event;
+    };
+
+    void MapMemory(int memfd, size_t ring_size, boost::system::error_code &ec);
+    void OpenEvents(boost::system::error_code &ec);
+    static void Notify(int event);
+    static size_t GetUsedSize(const Ring &ring, uint64 head, uint64 tail);
+
+    boost::asio::io_service &io_service_;
+    size_t ring_size_;
+    uint64 spin_time_us_;
+
+    void *memory_;
+    size_t memory_size_;
+    int events_[4];
+    Ring send_ring_, recv_ring_;
+    uint64 read_event_value_, write_event_value_;
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    boost::asio::posix::stream_descriptor read_waiter_, write_waiter_;
+#endif
+};
@@ -0,0 +1,261 @@
+#include "ShmTransport.h"
+#include "Session.h"
+#include "System.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+ShmTransport::ShmTransport(Connection &connection)
+: UnixTransport(connection)
+, shm_(connection.get_io_service())
+, spin_start_(0)
+, peer_probe_(0)
+{
+    connection.session_.ConfigShmChannel(shm_);
+}
+
+ShmTransport::~ShmTransport()
+{
+}
+
+void ShmTransport::Assign(SOCKET socket)
+{
+    UnixTransport::Assign(socket);
+
+    boost::system::error_code ec;
+    shm_.Create(sock_.native_handle(), ec);
+    if (ec) {
+        WLOG("Create shared memory[%s], %s.", connection_.addr_.c_str(), ec.message().c_str());
+    }
+}
+
+void ShmTransport::StartNextRead()
+{
+    if (!shm_.IsOpen()) {
+        connection_.Close();
+        return;
+    }
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    sock_.async_read_some(boost::asio::buffer(&peer_probe_, 1),
+        [this, self](const boost::system::error_code &ec, std::size_t) {
+            OnPeerClosed(ec);
+        });
+    StartNextRingRead();
+}
+
+void ShmTransport::StartNextWrite()
+{
+    if (shm_.IsOpen()) {
+        StartNextRingWrite();
+    }
+}
+
+void ShmTransport::Close()
+{
+    UnixTransport::Close();
+    shm_.Close();
+}
+
+void ShmTransport::OnStreamConnected()
+{
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    sock_.async_read_some(boost::asio::null_buffers(),
+        [this, self](const boost::system::error_code &ec, std::size_t) {
+            OnHandshake(ec);
+        });
+}
+
+// an empty ring is polled again through the io service for the spin time,
+// so other connections of the worker keep running, then it parks.
+void ShmTransport::StartNextRingRead()
+{
+    size_t total = 0;
+    while (shm_.GetReadableSize() != 0) {
+        size_t size = 0;
+        char *buffer = connection_.recv_pipe_->GetRecvDataBuffer(size);
+        if (buffer == nullptr || size == 0) {
+            break;
+        }
+        const size_t bytes = shm_.Read(buffer, size);
+        total += bytes;
+        connection_.OnRecvDataCallback(buffer, bytes);
+    }
+
+    const uint64 now = NetworkStats::GetTimeNs();
+    if (total != 0) {
+        connection_.last_recv_data_time_ = GET_APP_TIME;
+        if (NetworkStats::IsEnabled()) {
+            DataPipeCounter::Add(connection_.counter_.bytes_recv, total);
+        }
+        spin_start_ = now;
+    }
+
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    if (now - spin_start_ < shm_.GetSpinTime() * 1000 || !shm_.ParkReader()) {
+        connection_.get_io_service().post([this, self]() {
+            OnReadable(boost::system::error_code());
+        });
+        return;
+    }
+    shm_.AsyncWaitReadable([this, self](const boost::system::error_code &ec) {
+        OnReadable(ec);
+    });
+}
+
+void ShmTransport::StartNextRingWrite()
+{
+    size_t total = 0;
+    while (true) {
+        size_t size = 0;
+        const char *buffer = connection_.send_pipe_->GetSendDataBuffer(size);
+        if (buffer == nullptr || size == 0) {
+            break;
+        }
+        const size_t bytes = shm_.Write(buffer, size);
+        if (bytes != 0) {
+            connection_.send_pipe_->RemoveSendData(bytes);
+            total += bytes;
+        }
+        if (bytes < size) {
+            break;
+        }
+    }
+
+    if (total != 0) {
+        connection_.last_send_data_time_ = GET_APP_TIME;
+        if (NetworkStats::IsEnabled()) {
+            DataPipeCounter::Add(connection_.counter_.writes, 1);
+            DataPipeCounter::Add(connection_.counter_.bytes_sent, total);
+        }
+    }
+
+    // a full ring waits for the peer to read, writing stays claimed.
+    if (connection_.HasSendDataAwaiting() && shm_.GetWritableSize() == 0) {
+        std::shared_ptr<Connection> self = connection_.shared_from_this();
+        if (shm_.ParkWriter()) {
+            shm_.AsyncWaitWritable([this, self](const boost::system::error_code &ec) {
+                OnWritable(ec);
+            });
+        } else {
+            connection_.get_io_service().post([this, self]() {
+                OnWritable(boost::system::error_code());
+            });
+        }
+        return;
+    }
+
+    // as for tcp, a producer may be amid its write, come back later.
+    connection_.is_writing_.clear();
+    connection_.PostNextWrite();
+}
+
+void ShmTransport::OnHandshake(const boost::system::error_code &ec)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        boost::system::error_code error = ec;
+        if (!error) {
+            shm_.Attach(sock_.native_handle(), error);
+        }
+        if (error) {
+            WLOG("Attach shared memory[%s], %s.", connection_.addr_.c_str(), error.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        connection_.OnConnected();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnHandshake[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnHandshake[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnHandshake[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+void ShmTransport::OnReadable(const boost::system::error_code &ec)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        if (ec) {
+            WLOG("Read shared memory[%s], %s.", connection_.addr_.c_str(), ec.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        StartNextRingRead();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnReadable[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnReadable[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnReadable[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+void ShmTransport::OnWritable(const boost::system::error_code &ec)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        if (ec) {
+            WLOG("Write shared memory[%s], %s.", connection_.addr_.c_str(), ec.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        StartNextRingWrite();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnWritable[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnWritable[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnWritable[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+// the peer never writes to the socket once the channel is up.
+void ShmTransport::OnPeerClosed(const boost::system::error_code &ec)
+{
+    if (connection_.IsActive()) {
+        WLOG("Shared memory peer[%s] closed, %s.", connection_.addr_.c_str(),
+             ec ? ec.message().c_str() : "unexpected data");
+        connection_.Close();
+    }
+}
+
+#endif
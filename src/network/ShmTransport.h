@@ -0,0 +1,40 @@
+#pragma once
+
+#include "UnixTransport.h"
+#include "ShmChannel.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+// shared memory rings set up over a unix domain socket, the accepting side
+// creates them.  the socket carries no data after that, its close tells of
+// the peer going away.
+class ShmTransport : public UnixTransport
+{
+public:
+    ShmTransport(Connection &connection);
+    virtual ~ShmTransport();
+
+    // a channel failing to set up closes the connection on its first read.
+    void Assign(SOCKET socket);
+
+    virtual void StartNextRead();
+    virtual void StartNextWrite();
+    virtual void Close();
+
+protected:
+    virtual void OnStreamConnected();
+
+private:
+    void StartNextRingRead();
+    void StartNextRingWrite();
+    void OnHandshake(const boost::system::error_code &ec);
+    void OnReadable(const boost::system::error_code &ec);
+    void OnWritable(const boost::system::error_code &ec);
+    void OnPeerClosed(const boost::system::error_code &ec);
+
+    ShmChannel shm_;
+    uint64 spin_start_;
+    char peer_probe_;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Connection.h"
+#include "Logger.h"
+
+// a byte stream socket, reads land in the recv pipe and writes leave the
+// send pipe in place, gathered from its spans if the connection asks.
+template <typename Protocol>
+class StreamTransport : public ConnectionTransport
+{
+public:
+    StreamTransport(Connection &connection);
+    virtual ~StreamTransport() {}
+
+    virtual void StartNextRead();
+    virtual void StartNextWrite();
+    virtual void Close();
+
+protected:
+    // the io_uring transport takes over the socket calls.
+    virtual void AsyncRead(char *buffer, size_t size);
+    virtual void AsyncWrite(const SendDataSpan spans[], size_t count);
+
+    void OnConnectComplete(const boost::system::error_code &ec);
+    // the socket is connected and non blocking.
+    virtual void OnStreamConnected() { connection_.OnConnected(); }
+
+    typename Protocol::socket sock_;
+
+private:
+    class GatherBuffers {
+    public:
+        typedef boost::asio::const_buffer value_type;
+        typedef const boost::asio::const_buffer *const_iterator;
+        GatherBuffers(const_iterator first, const_iterator last)
+            : first_(first), last_(last) {}
+        const_iterator begin() const { return first_; }
+        const_iterator end() const { return last_; }
+    private:
+        const_iterator first_, last_;
+    };
+
+    boost::asio::const_buffer gather_buffers_[MAX_SEND_DATA_SPANS];
+};
+
+template <typename Protocol>
+StreamTransport<Protocol>::StreamTransport(Connection &connection)
+: ConnectionTransport(connection)
+, sock_(connection.get_io_service())
+{
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::StartNextRead()
+{
+    // a full buffer the pipes could not drain never will, and a read
+    // of nothing would complete at once, again and again.
+    size_t size = 0;
+    char *buffer = connection_.recv_pipe_->GetRecvDataBuffer(size);
+    if (size == 0) {
+        THROW_EXCEPTION(RecvDataException());
+    }
+    AsyncRead(buffer, size);
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::StartNextWrite()
+{
+    SendDataSpan spans[MAX_SEND_DATA_SPANS];
+    size_t count = 0;
+    if (connection_.is_gather_write_) {
+        count = connection_.send_pipe_->GetSendDataBuffers(spans, ARRAY_SIZE(spans));
+    } else {
+        spans[0].data = connection_.send_pipe_->GetSendDataBuffer(spans[0].size);
+        count = spans[0].data != nullptr && spans[0].size != 0 ? 1 : 0;
+    }
+    if (count == 0) {
+        // a producer may be amid its write, come back after the others
+        // instead of spinning here, it posts a write request itself.
+        connection_.is_writing_.clear();
+        connection_.PostNextWrite();
+        return;
+    }
+
+    connection_.write_size_ = 0;
+    for (size_t i = 0; i < count; ++i) {
+        connection_.write_size_ += spans[i].size;
+    }
+    if (NetworkStats::IsEnabled()) {
+        ConnectionCounter::Max(connection_.counter_.send_queue_peak, connection_.GetSendDataSize());
+    }
+    AsyncWrite(spans, count);
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::Close()
+{
+    boost::system::error_code ec;
+    sock_.close(ec);
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::AsyncRead(char *buffer, size_t size)
+{
+    sock_.async_read_some(boost::asio::buffer(buffer, size),
+        std::bind(&Connection::OnReadComplete, connection_.shared_from_this(),
+                  std::placeholders::_1, buffer, std::placeholders::_2));
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::AsyncWrite(const SendDataSpan spans[], size_t count)
+{
+    if (count == 1) {
+        sock_.async_write_some(boost::asio::buffer(spans[0].data, spans[0].size),
+            std::bind(&Connection::OnWriteComplete, connection_.shared_from_this(),
+                      std::placeholders::_1, spans[0].data, std::placeholders::_2));
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        gather_buffers_[i] = boost::asio::buffer(spans[i].data, spans[i].size);
+    }
+    sock_.async_write_some(GatherBuffers(gather_buffers_, gather_buffers_ + count),
+        std::bind(&Connection::OnWriteComplete, connection_.shared_from_this(),
+                  std::placeholders::_1, spans[0].data, std::placeholders::_2));
+}
+
+template <typename Protocol>
+void StreamTransport<Protocol>::OnConnectComplete(const boost::system::error_code &ec)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        if (ec) {
+            WLOG("Connect connection[%s:%hu], %s.", connection_.addr_.c_str(), connection_.port_, ec.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        sock_.non_blocking(true);
+        OnStreamConnected();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnConnectComplete[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnConnectComplete[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnConnectComplete[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
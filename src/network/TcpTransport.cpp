@@ -0,0 +1,86 @@
+#include "TcpTransport.h"
+
+TcpTransport::TcpTransport(Connection &connection)
+: StreamTransport(connection)
+, resolver_(connection.get_io_service())
+{
+}
+
+TcpTransport::~TcpTransport()
+{
+}
+
+void TcpTransport::Assign(const boost::asio::ip::tcp::socket::protocol_type &protocol, SOCKET socket)
+{
+    sock_.assign(protocol, socket);
+    sock_.non_blocking(true);
+    sock_.set_option(boost::asio::ip::tcp::no_delay(true));
+    RenewRemoteEndpoint();
+}
+
+void TcpTransport::AsyncConnect(const std::string &address, const std::string &port)
+{
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    boost::asio::ip::tcp::resolver::query query(address, port);
+    resolver_.async_resolve(query,
+        [this, self](const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator itr) {
+            OnResolveComplete(ec, itr);
+        });
+}
+
+void TcpTransport::Close()
+{
+    resolver_.cancel();
+    StreamTransport::Close();
+}
+
+void TcpTransport::OnStreamConnected()
+{
+    sock_.set_option(boost::asio::ip::tcp::no_delay(true));
+    StreamTransport::OnStreamConnected();
+}
+
+void TcpTransport::OnResolveComplete(const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator itr)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        if (ec) {
+            WLOG("Resolve connection[%s:%hu], %s.", connection_.addr_.c_str(), connection_.port_, ec.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        std::shared_ptr<Connection> self = connection_.shared_from_this();
+        sock_.async_connect(*itr, [this, self](const boost::system::error_code &ec) {
+            OnConnectComplete(ec);
+        });
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnResolveComplete[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnResolveComplete[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnResolveComplete[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+void TcpTransport::RenewRemoteEndpoint()
+{
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::endpoint endpoint = sock_.remote_endpoint(ec);
+    if (!ec) {
+        connection_.addr_ = endpoint.address().to_string();
+        connection_.port_ = endpoint.port();
+    }
+}
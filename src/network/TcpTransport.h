@@ -0,0 +1,25 @@
+#pragma once
+
+#include "StreamTransport.h"
+
+// tcp with nagle off, the peer address is what the socket reports.
+class TcpTransport : public StreamTransport<boost::asio::ip::tcp>
+{
+public:
+    TcpTransport(Connection &connection);
+    virtual ~TcpTransport();
+
+    void Assign(const boost::asio::ip::tcp::socket::protocol_type &protocol, SOCKET socket);
+
+    virtual void AsyncConnect(const std::string &address, const std::string &port);
+    virtual void Close();
+
+protected:
+    virtual void OnStreamConnected();
+
+private:
+    void OnResolveComplete(const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator itr);
+    void RenewRemoteEndpoint();
+
+    boost::asio::ip::tcp::resolver resolver_;
+};
@@ -0,0 +1,222 @@
+#include "UdpListener.h"
+#include "ConnectionManager.h"
+#include "SessionManager.h"
+#include "ReliableUdp.h"
+#include "Logger.h"
+#include "System.h"
+#include "OS.h"
+
+#define UDP_RECENT_PEER_TIMEOUT (10)
+#define UDP_MAX_RECENT_PEERS (4096)
+#define UDP_MAX_NEW_PEERS_PER_SECOND (256)
+
+UdpListener::UdpListener()
+: sockfd_(INVALID_SOCKET)
+, expire_time_(0)
+, new_peer_time_(0)
+, new_peer_count_(0)
+{
+}
+
+UdpListener::~UdpListener()
+{
+}
+
+bool UdpListener::Prepare()
+{
+    addr_ = GetBindAddress();
+    port_ = GetBindPort();
+    return true;
+}
+
+bool UdpListener::Initialize()
+{
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = 0;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = 0;
+    int ret = getaddrinfo(addr_.c_str(), port_.c_str(), &hints, &res);
+    if (ret != 0) {
+        ELOG("getaddrinfo(), error: %s.", gai_strerror(ret));
+        return false;
+    }
+
+    std::unique_ptr<addrinfo, decltype(freeaddrinfo)*> _(res, freeaddrinfo);
+    bind_addr_.assign((const char *)res->ai_addr, res->ai_addrlen);
+
+    sockfd_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sockfd_ == INVALID_SOCKET) {
+        ELOG("socket(), errno: %d.", GET_SOCKET_ERROR());
+        return false;
+    }
+
+    if (!OS::non_blocking(sockfd_)) {
+        ELOG("non_blocking(), errno: %d.", GET_SOCKET_ERROR());
+        return false;
+    }
+
+    if (!OS::reuse_address(sockfd_)) {
+        ELOG("reuse_address(), errno: %d.", GET_SOCKET_ERROR());
+        return false;
+    }
+
+    ret = bind(sockfd_, res->ai_addr, res->ai_addrlen);
+    if (ret != 0) {
+        ELOG("bind(), errno: %d.", GET_SOCKET_ERROR());
+        return false;
+    }
+
+    return true;
+}
+
+void UdpListener::Kernel()
+{
+    struct pollfd sockfd;
+    sockfd.fd = sockfd_;
+    sockfd.events = POLLRDNORM;
+    int ret = poll(&sockfd, 1, 100);
+    if (ret == SOCKET_ERROR) {
+        ELOG("poll(), errno: %d.", GET_SOCKET_ERROR());
+        return;
+    }
+
+    ExpireRecentPeers();
+
+    if (ret == 0 || (sockfd.revents & POLLRDNORM) == 0) {
+        return;
+    }
+
+    ReceiveDatagrams();
+}
+
+void UdpListener::Finish()
+{
+    if (sockfd_ != INVALID_SOCKET) {
+        closesocket(sockfd_);
+        sockfd_ = INVALID_SOCKET;
+    }
+}
+
+void UdpListener::ReceiveDatagrams()
+{
+    char buffer[RUDP_MAX_DATAGRAM_SIZE];
+    while (true) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        ssize_t size = recvfrom(sockfd_, buffer, sizeof(buffer), 0,
+            (struct sockaddr *)&addr, &addrlen);
+        if (size == SOCKET_ERROR) {
+            if (GET_SOCKET_ERROR() != ERROR_WOULDBLOCK) {
+                ELOG("recvfrom(), errno: %d.", GET_SOCKET_ERROR());
+            }
+            break;
+        }
+
+        uint32 conv = 0;
+        if (!ReliableUdp::PeekHello(buffer, size, conv)) {
+            continue;
+        }
+
+        const std::string peer((const char *)&addr, addrlen);
+        if (recent_peers_.count(peer) != 0) {
+            continue;
+        }
+
+        // sources are easily forged, a flood is shed here and the real
+        // peers retransmit their hello later.
+        if (new_peer_time_ != GET_UNIX_TIME) {
+            new_peer_time_ = GET_UNIX_TIME;
+            new_peer_count_ = 0;
+        }
+        if (new_peer_count_ >= UDP_MAX_NEW_PEERS_PER_SECOND ||
+            recent_peers_.size() >= UDP_MAX_RECENT_PEERS) {
+            continue;
+        }
+        new_peer_count_ += 1;
+
+        recent_peers_.emplace(peer, GET_UNIX_TIME);
+        OnNewPeer(peer, conv, buffer, size);
+    }
+}
+
+void UdpListener::OnNewPeer(const std::string &peer, uint32 conv, const char *hello, size_t size)
+{
+    SOCKET sockfd = OpenPeerSocket(peer);
+    if (sockfd == INVALID_SOCKET) {
+        return;
+    }
+
+    Session *session = NewSessionObject();
+    std::shared_ptr<Connection> connPtr = sConnectionManager.NewConnection(*session);
+    AddDataPipes(session);
+
+    const boost::asio::ip::udp::socket::protocol_type protocol =
+        ((const struct sockaddr *)peer.data())->sa_family == AF_INET ?
+        boost::asio::ip::udp::v4() : boost::asio::ip::udp::v6();
+    const bool is_valid = connPtr->SetUdpSocket(protocol, sockfd, conv, hello, size);
+
+    sSessionManager.AddSession(session);
+    if (!is_valid) {
+        connPtr->PostCloseRequest();
+        return;
+    }
+    connPtr->PostReadRequest();
+    if (connPtr->HasSendDataAwaiting()) {
+        connPtr->PostWriteRequest();
+    }
+}
+
+SOCKET UdpListener::OpenPeerSocket(const std::string &peer)
+{
+    const struct sockaddr *addr = (const struct sockaddr *)peer.data();
+    SOCKET sockfd = socket(addr->sa_family, SOCK_DGRAM, 0);
+    if (sockfd == INVALID_SOCKET) {
+        ELOG("socket(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    _defer_r(if (sockfd != INVALID_SOCKET) closesocket(sockfd));
+
+    if (!OS::non_blocking(sockfd)) {
+        ELOG("non_blocking(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    if (!OS::reuse_address(sockfd)) {
+        ELOG("reuse_address(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    int ret = bind(sockfd, (const struct sockaddr *)bind_addr_.data(), bind_addr_.size());
+    if (ret != 0) {
+        ELOG("bind(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    ret = connect(sockfd, addr, peer.size());
+    if (ret != 0) {
+        ELOG("connect(), errno: %d.", GET_SOCKET_ERROR());
+        return INVALID_SOCKET;
+    }
+
+    SOCKET peerfd = sockfd;
+    sockfd = INVALID_SOCKET;
+    return peerfd;
+}
+
+void UdpListener::ExpireRecentPeers()
+{
+    if (expire_time_ + UDP_RECENT_PEER_TIMEOUT > GET_UNIX_TIME) {
+        return;
+    }
+    expire_time_ = GET_UNIX_TIME;
+    for (auto itr = recent_peers_.begin(); itr != recent_peers_.end();) {
+        if (itr->second + UDP_RECENT_PEER_TIMEOUT <= GET_UNIX_TIME) {
+            itr = recent_peers_.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
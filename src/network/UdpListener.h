@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Thread.h"
+#include "Macro.h"
+#include "Base.h"
+#include <string>
+#include <unordered_map>
+
+class Session;
+
+// accepts reliable udp peers on one port.  the first datagram of a new peer
+// opens a socket bound to the same address and connected to that peer, so
+// the kernel delivers the rest of its datagrams there, on its io worker.
+class UdpListener : public Thread
+{
+public:
+    THREAD_RUNTIME(UdpListener)
+
+    UdpListener();
+    virtual ~UdpListener();
+
+protected:
+    virtual bool Prepare();
+    virtual bool Initialize();
+    virtual void Kernel();
+    virtual void Finish();
+
+    virtual std::string GetBindAddress() = 0;
+    virtual std::string GetBindPort() = 0;
+
+    virtual Session *NewSessionObject() = 0;
+    virtual void AddDataPipes(Session *session) {}
+
+private:
+    void ReceiveDatagrams();
+    // peers and the bind address are raw sockaddr bytes.
+    void OnNewPeer(const std::string &peer, uint32 conv, const char *hello, size_t size);
+    SOCKET OpenPeerSocket(const std::string &peer);
+    void ExpireRecentPeers();
+
+    SOCKET sockfd_;
+    std::string bind_addr_;
+
+    // datagrams queued here before a peer socket was connected are dropped.
+    std::unordered_map<std::string, time_t> recent_peers_;
+    time_t expire_time_;
+
+    time_t new_peer_time_;
+    size_t new_peer_count_;
+
+    std::string addr_;
+    std::string port_;
+};
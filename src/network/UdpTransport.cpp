@@ -0,0 +1,249 @@
+#include "UdpTransport.h"
+#include "Connection.h"
+#include "Session.h"
+#include "System.h"
+#include "Logger.h"
+
+UdpTransport::UdpTransport(Connection &connection, uint32 conv)
+: ConnectionTransport(connection)
+, resolver_(connection.get_io_service())
+, sock_(connection.get_io_service())
+, timer_(connection.get_io_service())
+, rudp_(conv, std::bind(&UdpTransport::SendDatagram,
+    this, std::placeholders::_1, std::placeholders::_2))
+, datagram_(new char[RUDP_MAX_DATAGRAM_SIZE])
+{
+    connection.session_.ConfigReliableUdp(rudp_);
+}
+
+UdpTransport::~UdpTransport()
+{
+}
+
+bool UdpTransport::Assign(const boost::asio::ip::udp::socket::protocol_type &protocol,
+    SOCKET socket, const char *hello, size_t size)
+{
+    sock_.assign(protocol, socket);
+    sock_.non_blocking(true);
+
+    boost::system::error_code ec;
+    boost::asio::ip::udp::endpoint endpoint = sock_.remote_endpoint(ec);
+    if (!ec) {
+        connection_.addr_ = endpoint.address().to_string();
+        connection_.port_ = endpoint.port();
+    }
+
+    return rudp_.Input(hello, size, uint32(System::GetRealSysTime()));
+}
+
+void UdpTransport::AsyncConnect(const std::string &address, const std::string &port)
+{
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    boost::asio::ip::udp::resolver::query query(address, port);
+    resolver_.async_resolve(query,
+        [this, self](const boost::system::error_code &ec, boost::asio::ip::udp::resolver::iterator itr) {
+            OnResolveComplete(ec, itr);
+        });
+}
+
+void UdpTransport::StartNextRead()
+{
+    FlushRecvData();
+    StartTimer();
+    StartNextReceive();
+}
+
+// the arq takes what its window allows, the rest waits in the pipes for acks.
+void UdpTransport::StartNextWrite()
+{
+    size_t total = 0;
+    while (!rudp_.IsSendWindowFull()) {
+        size_t size = 0;
+        const char *buffer = connection_.send_pipe_->GetSendDataBuffer(size);
+        if (buffer == nullptr || size == 0) {
+            break;
+        }
+        const size_t bytes = rudp_.Send(buffer, size);
+        connection_.send_pipe_->RemoveSendData(bytes);
+        total += bytes;
+    }
+
+    if (total != 0) {
+        connection_.last_send_data_time_ = GET_APP_TIME;
+        if (NetworkStats::IsEnabled()) {
+            DataPipeCounter::Add(connection_.counter_.writes, 1);
+            DataPipeCounter::Add(connection_.counter_.bytes_sent, total);
+        }
+        rudp_.Flush(uint32(System::GetRealSysTime()));
+    }
+
+    // as for tcp, a producer may be amid its write, come back later.
+    connection_.is_writing_.clear();
+    if (!rudp_.IsSendWindowFull()) {
+        connection_.PostNextWrite();
+    }
+}
+
+void UdpTransport::Close()
+{
+    boost::system::error_code ec;
+    resolver_.cancel();
+    timer_.cancel(ec);
+    sock_.close(ec);
+}
+
+void UdpTransport::StartNextReceive()
+{
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    sock_.async_receive(boost::asio::buffer(datagram_.get(), RUDP_MAX_DATAGRAM_SIZE),
+        [this, self](const boost::system::error_code &ec, std::size_t bytes) {
+            OnReceiveComplete(ec, bytes);
+        });
+}
+
+void UdpTransport::StartTimer()
+{
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    timer_.expires_from_now(std::chrono::milliseconds(rudp_.GetInterval()));
+    timer_.async_wait([this, self](const boost::system::error_code &ec) {
+        OnTimeout(ec);
+    });
+}
+
+void UdpTransport::OnResolveComplete(const boost::system::error_code &ec, boost::asio::ip::udp::resolver::iterator itr)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        if (ec) {
+            WLOG("Resolve udp connection[%s:%hu], %s.", connection_.addr_.c_str(), connection_.port_, ec.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        // the server only learns of the client from its first datagram.
+        const boost::asio::ip::udp::endpoint peer = *itr;
+        sock_.open(peer.protocol());
+        sock_.connect(peer);
+        sock_.non_blocking(true);
+        connection_.OnConnected();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnResolveComplete[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnResolveComplete[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnResolveComplete[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+void UdpTransport::OnReceiveComplete(const boost::system::error_code &ec, std::size_t bytes)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive()) {
+            return;
+        }
+
+        if (ec) {
+            WLOG("Read udp connection[%s:%hu], %s.", connection_.addr_.c_str(), connection_.port_, ec.message().c_str());
+            connection_.Close();
+            return;
+        }
+
+        // stray datagrams are dropped, as the network might have done.
+        if (rudp_.Input(datagram_.get(), bytes, uint32(System::GetRealSysTime()))) {
+            connection_.last_recv_data_time_ = GET_APP_TIME;
+            rudp_.Flush(uint32(System::GetRealSysTime()));
+            FlushRecvData();
+            if (!rudp_.IsSendWindowFull() && connection_.HasSendDataAwaiting() &&
+                !connection_.is_writing_.test_and_set()) {
+                StartNextWrite();
+            }
+        }
+        StartNextReceive();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnReceiveComplete[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnReceiveComplete[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnReceiveComplete[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+void UdpTransport::OnTimeout(const boost::system::error_code &ec)
+{
+    TRY_BEGIN {
+
+        if (!connection_.IsActive() || ec) {
+            return;
+        }
+
+        rudp_.Update(uint32(System::GetRealSysTime()));
+        if (rudp_.IsDeadLink()) {
+            WLOG("Udp connection[%s:%hu] dead link.", connection_.addr_.c_str(), connection_.port_);
+            connection_.Close();
+            return;
+        }
+        if (!rudp_.IsSendWindowFull() && connection_.HasSendDataAwaiting() &&
+            !connection_.is_writing_.test_and_set()) {
+            StartNextWrite();
+        }
+        StartTimer();
+
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &e) {
+        WLOG("OnTimeout[%s:%hu] exception[%s] occurred.", connection_.addr_.c_str(), connection_.port_, e.what());
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(const IException &e) {
+        WLOG("OnTimeout[%s:%hu] exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        e.Print();
+        connection_.Close();
+    } CATCH_END
+    CATCH_BEGIN(...) {
+        WLOG("OnTimeout[%s:%hu] unknown exception occurred.", connection_.addr_.c_str(), connection_.port_);
+        connection_.Close();
+    } CATCH_END
+}
+
+// a full socket buffer drops the datagram, the arq sends it again.
+void UdpTransport::SendDatagram(const char *data, size_t size)
+{
+    boost::system::error_code ec;
+    sock_.send(boost::asio::buffer(data, size), 0, ec);
+}
+
+void UdpTransport::FlushRecvData()
+{
+    while (rudp_.GetRecvSize() != 0) {
+        size_t size = 0;
+        char *buffer = connection_.recv_pipe_->GetRecvDataBuffer(size);
+        if (buffer == nullptr || size == 0) {
+            break;
+        }
+        const size_t bytes = rudp_.Recv(buffer, size);
+        if (NetworkStats::IsEnabled()) {
+            DataPipeCounter::Add(connection_.counter_.bytes_recv, bytes);
+        }
+        connection_.OnRecvDataCallback(buffer, bytes);
+    }
+}
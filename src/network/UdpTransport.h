@@ -0,0 +1,40 @@
+#pragma once
+
+#include "ConnectionTransport.h"
+#include "ReliableUdp.h"
+#include <memory>
+
+// reliable udp over a socket connected to the peer.  the arq runs on a
+// timer of its own, what it sends goes out at once, a full socket buffer
+// drops the datagram and the arq sends it again.
+class UdpTransport : public ConnectionTransport
+{
+public:
+    UdpTransport(Connection &connection, uint32 conv);
+    virtual ~UdpTransport();
+
+    // hello is the datagram the listener took for the peer, false if it is
+    // not taken in by the conversation.
+    bool Assign(const boost::asio::ip::udp::socket::protocol_type &protocol,
+        SOCKET socket, const char *hello, size_t size);
+
+    virtual void AsyncConnect(const std::string &address, const std::string &port);
+    virtual void StartNextRead();
+    virtual void StartNextWrite();
+    virtual void Close();
+
+private:
+    void StartNextReceive();
+    void StartTimer();
+    void OnResolveComplete(const boost::system::error_code &ec, boost::asio::ip::udp::resolver::iterator itr);
+    void OnReceiveComplete(const boost::system::error_code &ec, std::size_t bytes);
+    void OnTimeout(const boost::system::error_code &ec);
+    void SendDatagram(const char *data, size_t size);
+    void FlushRecvData();
+
+    boost::asio::ip::udp::resolver resolver_;
+    boost::asio::ip::udp::socket sock_;
+    boost::asio::steady_timer timer_;
+    ReliableUdp rudp_;
+    std::unique_ptr<char[]> datagram_;
+};
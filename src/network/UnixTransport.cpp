@@ -0,0 +1,111 @@
+#include "UnixTransport.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+#include <sys/un.h>
+
+UnixTransport::UnixTransport(Connection &connection)
+: StreamTransport(connection)
+, connect_timer_(connection.get_io_service())
+, connect_retries_(0)
+{
+}
+
+UnixTransport::~UnixTransport()
+{
+}
+
+void UnixTransport::Assign(SOCKET socket)
+{
+    sock_.assign(boost::asio::local::stream_protocol(), socket);
+    sock_.non_blocking(true);
+}
+
+void UnixTransport::AsyncConnect(const std::string &address, const std::string &port)
+{
+    path_ = address.substr(address.find(':') + 1);
+    std::shared_ptr<Connection> self = connection_.shared_from_this();
+    connection_.get_io_service().post([this, self]() {
+        Connect();
+    });
+}
+
+void UnixTransport::Close()
+{
+    boost::system::error_code ec;
+    connect_timer_.cancel(ec);
+    StreamTransport::Close();
+}
+
+// a local connect completes at once or fails, except while the listener
+// backlog is full, then it is tried again on a timer instead of blocking
+// the worker.
+void UnixTransport::Connect()
+{
+    boost::system::error_code ec;
+    sock_.open(boost::asio::local::stream_protocol(), ec);
+    if (!ec) {
+        sock_.non_blocking(true, ec);
+    }
+    if (!ec) {
+        connect_retries_ = 0;
+        StartNextConnect();
+        return;
+    }
+    OnConnectComplete(ec);
+}
+
+void UnixTransport::StartNextConnect()
+{
+    boost::system::error_code ec;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path_.size() >= sizeof(addr.sun_path)) {
+        ec = boost::asio::error::name_too_long;
+    } else {
+        memcpy(addr.sun_path, path_.data(), path_.size());
+        if (connect(sock_.native_handle(), (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            const int error = GET_SOCKET_ERROR();
+            std::shared_ptr<Connection> self = connection_.shared_from_this();
+            if (error == ERROR_INPROGRESS) {
+                sock_.async_write_some(boost::asio::null_buffers(),
+                    [this, self](const boost::system::error_code &ec, std::size_t) {
+                        OnConnectReady(ec);
+                    });
+                return;
+            }
+            if (error == EAGAIN && ++connect_retries_ <= UNIX_CONNECT_MAX_RETRIES) {
+                connect_timer_.expires_from_now(std::chrono::milliseconds(UNIX_CONNECT_RETRY_INTERVAL));
+                connect_timer_.async_wait([this, self](const boost::system::error_code &ec) {
+                    OnConnectRetry(ec);
+                });
+                return;
+            }
+            ec.assign(error, boost::asio::error::get_system_category());
+        }
+    }
+    OnConnectComplete(ec);
+}
+
+void UnixTransport::OnConnectRetry(const boost::system::error_code &ec)
+{
+    if (connection_.IsActive() && !ec) {
+        StartNextConnect();
+    }
+}
+
+void UnixTransport::OnConnectReady(const boost::system::error_code &ec)
+{
+    boost::system::error_code error = ec;
+    if (!error) {
+        boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_ERROR> option;
+        sock_.get_option(option, error);
+        if (!error && option.value() != 0) {
+            error.assign(option.value(), boost::asio::error::get_system_category());
+        }
+    }
+    OnConnectComplete(error);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "StreamTransport.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+// a connect refused by a full unix listener backlog is tried again
+// every interval ms, at most this many times.
+#define UNIX_CONNECT_RETRY_INTERVAL (10)
+#define UNIX_CONNECT_MAX_RETRIES (500)
+
+// a unix domain stream socket, the path follows the prefix of the address.
+class UnixTransport : public StreamTransport<boost::asio::local::stream_protocol>
+{
+public:
+    UnixTransport(Connection &connection);
+    virtual ~UnixTransport();
+
+    void Assign(SOCKET socket);
+
+    virtual void AsyncConnect(const std::string &address, const std::string &port);
+    virtual void Close();
+
+private:
+    void Connect();
+    void StartNextConnect();
+    void OnConnectRetry(const boost::system::error_code &ec);
+    void OnConnectReady(const boost::system::error_code &ec);
+
+    std::string path_;
+    boost::asio::steady_timer connect_timer_;
+    size_t connect_retries_;
+};
+
+#endif
@@ -0,0 +1,508 @@
+#include "UringService.h"
+#include "Exception.h"
+#include <string.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define URING_SUPPORTED
+#endif
+#endif
+
+#if defined(URING_SUPPORTED)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if !defined(__NR_io_uring_setup)
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#define __NR_io_uring_register 427
+#endif
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// the kernel reads the sq tail and writes the cq tail concurrently.
+struct UringService::Ring {
+    int fd = -1;
+    void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED;
+    size_t sq_size = 0, cq_size = 0;
+    struct io_uring_sqe *sqes = (struct io_uring_sqe *)MAP_FAILED;
+    size_t sqes_size = 0;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_flags = nullptr, *sq_array = nullptr;
+    unsigned sq_mask = 0, sq_entries = 0;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    struct io_uring_cqe *cqes = nullptr;
+};
+
+UringService::UringService(boost::asio::io_service &io_service)
+: io_service_(io_service)
+, ring_(new Ring)
+, pending_(0)
+, is_submit_posted_(false)
+, is_closing_(false)
+, inflight_(nullptr)
+, event_value_(0)
+, event_(io_service)
+{
+}
+
+UringService::~UringService()
+{
+    Close();
+}
+
+void UringService::Open(unsigned entries, boost::system::error_code &ec)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    Ring &ring = *ring_;
+    ring.fd = io_uring_setup(entries, &params);
+    if (ring.fd < 0) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        return;
+    }
+
+    // without fast poll a socket read would block a kernel worker thread.
+    if ((params.features & IORING_FEAT_NODROP) == 0 ||
+        (params.features & IORING_FEAT_FAST_POLL) == 0) {
+        ec = boost::asio::error::operation_not_supported;
+        Close();
+        return;
+    }
+
+    ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        ring.sq_size = ring.cq_size = std::max(ring.sq_size, ring.cq_size);
+    }
+    ring.sq_ptr = mmap(nullptr, ring.sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        ring.cq_ptr = ring.sq_ptr;
+    } else if (ring.sq_ptr != MAP_FAILED) {
+        ring.cq_ptr = mmap(nullptr, ring.cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    }
+    ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = (struct io_uring_sqe *)mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sq_ptr == MAP_FAILED || ring.cq_ptr == MAP_FAILED || ring.sqes == MAP_FAILED) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        Close();
+        return;
+    }
+
+    char *sq = (char *)ring.sq_ptr, *cq = (char *)ring.cq_ptr;
+    ring.sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring.sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring.sq_flags = (unsigned *)(sq + params.sq_off.flags);
+    ring.sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring.sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring.sq_entries = params.sq_entries;
+    ring.cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring.cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring.cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    int event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event == -1) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        Close();
+        return;
+    }
+    event_.assign(event, ec);
+    if (ec) {
+        close(event);
+        Close();
+        return;
+    }
+    if (io_uring_register(ring.fd, IORING_REGISTER_EVENTFD, &event, 1) != 0) {
+        ec.assign(errno, boost::asio::error::get_system_category());
+        Close();
+        return;
+    }
+
+    // a sparse table is filled as connections come, older kernels go
+    // without registered buffers.
+#if defined(IORING_RSRC_REGISTER_SPARSE)
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = URING_BUFFER_SLOTS;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (io_uring_register(ring.fd, IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) == 0) {
+        for (int index = URING_BUFFER_SLOTS - 1; index >= 0; --index) {
+            free_buffers_.push_back(index);
+        }
+    }
+#endif
+
+    StartNextWait();
+}
+
+// what completed already is still delivered, the rest is cancelled, so
+// no owner is held past the ring and no buffer is left to the kernel.
+void UringService::Close()
+{
+    boost::system::error_code ec;
+    event_.close(ec);
+
+    Ring &ring = *ring_;
+    if (ring.fd != -1) {
+        is_closing_ = true;
+        Submit();
+        CancelAll();
+        is_closing_ = false;
+    }
+    if (ring.sqes != MAP_FAILED) {
+        munmap(ring.sqes, ring.sqes_size);
+    }
+    if (ring.cq_ptr != MAP_FAILED && ring.cq_ptr != ring.sq_ptr) {
+        munmap(ring.cq_ptr, ring.cq_size);
+    }
+    if (ring.sq_ptr != MAP_FAILED) {
+        munmap(ring.sq_ptr, ring.sq_size);
+    }
+    if (ring.fd != -1) {
+        close(ring.fd);
+    }
+    *ring_ = Ring();
+    free_buffers_.clear();
+    pending_ = 0;
+}
+
+int UringService::RegisterBuffer(char *data, size_t size)
+{
+#if defined(IORING_RSRC_REGISTER_SPARSE)
+    if (free_buffers_.empty()) {
+        return -1;
+    }
+    const int index = free_buffers_.back();
+    struct iovec iov = {data, size};
+    uint64 tag = 0;
+    struct io_uring_rsrc_update2 update;
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.data = (uint64)(uintptr_t)&iov;
+    update.tags = (uint64)(uintptr_t)&tag;
+    update.nr = 1;
+    if (io_uring_register(ring_->fd, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) != 1) {
+        return -1;
+    }
+    free_buffers_.pop_back();
+    return index;
+#else
+    return -1;
+#endif
+}
+
+void UringService::UnregisterBuffer(int index)
+{
+#if defined(IORING_RSRC_REGISTER_SPARSE)
+    struct iovec iov = {nullptr, 0};
+    uint64 tag = 0;
+    struct io_uring_rsrc_update2 update;
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.data = (uint64)(uintptr_t)&iov;
+    update.tags = (uint64)(uintptr_t)&tag;
+    update.nr = 1;
+    if (io_uring_register(ring_->fd, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) == 1) {
+        free_buffers_.push_back(index);
+    }
+#endif
+}
+
+// a socket reads at offset 0, fixed buffers go through the read path.
+void UringService::AsyncRecv(int fd, char *buffer, size_t size, int buffer_index, UringOp &op)
+{
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)GetSqe(op);
+    if (buffer_index >= 0) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = buffer_index;
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+    }
+    sqe->fd = fd;
+    sqe->addr = (uint64)(uintptr_t)buffer;
+    sqe->len = (unsigned)std::min<size_t>(size, INT_MAX);
+    op.buffer = buffer;
+    PostSubmit();
+}
+
+void UringService::AsyncSend(int fd, const char *buffer, size_t size, UringOp &op)
+{
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)GetSqe(op);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64)(uintptr_t)buffer;
+    sqe->len = (unsigned)std::min<size_t>(size, INT_MAX);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    op.buffer = buffer;
+    PostSubmit();
+}
+
+void UringService::AsyncSend(int fd, const SendDataSpan spans[], size_t count, UringOp &op)
+{
+    for (size_t i = 0; i < count; ++i) {
+        op.iov[i].iov_base = (void *)spans[i].data;
+        op.iov[i].iov_len = spans[i].size;
+    }
+    memset(&op.msg, 0, sizeof(op.msg));
+    op.msg.msg_iov = op.iov;
+    op.msg.msg_iovlen = count;
+
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)GetSqe(op);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64)(uintptr_t)&op.msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    op.buffer = count != 0 ? spans[0].data : nullptr;
+    PostSubmit();
+}
+
+// the request is tracked until its completion is reaped.
+void *UringService::GetSqe(UringOp &op)
+{
+    if (is_closing_) {
+        throw boost::system::system_error(boost::asio::error::bad_descriptor);
+    }
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)NewSqe();
+    sqe->user_data = (uint64)(uintptr_t)&op;
+    op.prev = nullptr, op.next = inflight_;
+    if (inflight_ != nullptr) {
+        inflight_->prev = &op;
+    }
+    inflight_ = &op;
+    return sqe;
+}
+
+// a full queue is submitted at once to make room.
+void *UringService::NewSqe()
+{
+    Ring &ring = *ring_;
+    if (ring.fd == -1) {
+        throw boost::system::system_error(boost::asio::error::bad_descriptor);
+    }
+    const unsigned tail = *ring.sq_tail;
+    if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        Submit();
+        if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+            throw boost::system::system_error(boost::asio::error::no_buffer_space);
+        }
+    }
+    const unsigned index = tail & ring.sq_mask;
+    struct io_uring_sqe *sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++pending_;
+    return sqe;
+}
+
+void UringService::Submit()
+{
+    while (pending_ != 0) {
+        const int ret = io_uring_enter(ring_->fd, pending_, 0, 0);
+        if (ret >= 0) {
+            pending_ -= std::min<unsigned>(ret, pending_);
+        } else if (errno == EBUSY || errno == EAGAIN) {
+            // completions back up, reaping them frees the kernel's hands.
+            ReapCompletions();
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+}
+
+// the head is read again for every entry, a completion may reap in turn.
+void UringService::ReapCompletions()
+{
+    Ring &ring = *ring_;
+    while (true) {
+        const unsigned head = *ring.cq_head;
+        if (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            // overflowed completions are only flushed on entering the kernel.
+            if ((__atomic_load_n(ring.sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) == 0 ||
+                io_uring_enter(ring.fd, 0, 0, IORING_ENTER_GETEVENTS) < 0 ||
+                __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE) == head) {
+                break;
+            }
+            continue;
+        }
+        const struct io_uring_cqe &cqe = ring.cqes[head & ring.cq_mask];
+        UringOp *op = (UringOp *)(uintptr_t)cqe.user_data;
+        const int result = cqe.res;
+        __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+        // a cancel request carries no op, its target completes apart.
+        if (op != nullptr) {
+            Unlink(*op);
+            op->complete(*op, result);
+        }
+    }
+}
+
+// the kernel is waited on until it gives every request back, whatever
+// it could not report is failed here.
+void UringService::CancelAll()
+{
+    TRY_BEGIN {
+        for (UringOp *op = inflight_; op != nullptr; op = op->next) {
+            struct io_uring_sqe *sqe = (struct io_uring_sqe *)NewSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = (uint64)(uintptr_t)op;
+        }
+        Submit();
+    } TRY_END
+    CATCH_BEGIN(const boost::system::system_error &) {
+    } CATCH_END
+
+    Ring &ring = *ring_;
+    ReapCompletions();
+    while (inflight_ != nullptr) {
+        if (io_uring_enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            break;
+        }
+        ReapCompletions();
+    }
+    while (inflight_ != nullptr) {
+        UringOp &op = *inflight_;
+        Unlink(op);
+        op.complete(op, -ECANCELED);
+    }
+}
+
+void UringService::StartNextWait()
+{
+    event_.async_read_some(boost::asio::buffer(&event_value_, sizeof(event_value_)),
+        std::bind(&UringService::OnRingEvent, this, std::placeholders::_1));
+}
+#else
+struct UringService::Ring {};
+
+UringService::UringService(boost::asio::io_service &io_service)
+: io_service_(io_service)
+, ring_(new Ring)
+, pending_(0)
+, is_submit_posted_(false)
+, is_closing_(false)
+, inflight_(nullptr)
+, event_value_(0)
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+, event_(io_service)
+#endif
+{
+}
+
+UringService::~UringService()
+{
+}
+
+void UringService::Open(unsigned entries, boost::system::error_code &ec)
+{
+    ec = boost::asio::error::operation_not_supported;
+}
+
+void UringService::Close()
+{
+}
+
+int UringService::RegisterBuffer(char *data, size_t size)
+{
+    return -1;
+}
+
+void UringService::UnregisterBuffer(int index)
+{
+}
+
+void UringService::AsyncRecv(int fd, char *buffer, size_t size, int buffer_index, UringOp &op)
+{
+}
+
+void UringService::AsyncSend(int fd, const char *buffer, size_t size, UringOp &op)
+{
+}
+
+void UringService::AsyncSend(int fd, const SendDataSpan spans[], size_t count, UringOp &op)
+{
+}
+
+void *UringService::GetSqe(UringOp &op)
+{
+    return nullptr;
+}
+
+void *UringService::NewSqe()
+{
+    return nullptr;
+}
+
+void UringService::CancelAll()
+{
+}
+
+void UringService::Submit()
+{
+}
+
+void UringService::ReapCompletions()
+{
+}
+
+void UringService::StartNextWait()
+{
+}
+#endif
+
+void UringService::Unlink(UringOp &op)
+{
+    if (op.prev != nullptr) {
+        op.prev->next = op.next;
+    } else {
+        inflight_ = op.next;
+    }
+    if (op.next != nullptr) {
+        op.next->prev = op.prev;
+    }
+    op.prev = op.next = nullptr;
+}
+
+void UringService::PostSubmit()
+{
+    if (!is_submit_posted_) {
+        is_submit_posted_ = true;
+        io_service_.post([this]() {
+            is_submit_posted_ = false;
+            Submit();
+        });
+    }
+}
+
+// the eventfd read resets it, completions posted after it signal again.
+void UringService::OnRingEvent(const boost::system::error_code &ec)
+{
+    if (ec) {
+        return;
+    }
+    ReapCompletions();
+    StartNextWait();
+}
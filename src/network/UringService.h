@@ -0,0 +1,82 @@
+#pragma once
+
+#include "AsioHeader.h"
+#include "SendBuffer.h"
+#include <memory>
+#include <vector>
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#define URING_DEFAULT_ENTRIES (4096)
+#define URING_BUFFER_SLOTS (1024)
+
+// a request in flight, embedded in its owner, which is kept alive until
+// complete has run.  result is the byte count or a negated errno.
+struct UringOp {
+    void (*complete)(UringOp &op, int result) = nullptr;
+    std::shared_ptr<void> owner;
+    const char *buffer = nullptr;
+    UringOp *prev = nullptr, *next = nullptr;
+#if defined(__linux__)
+    struct msghdr msg;
+    struct iovec iov[MAX_SEND_DATA_SPANS];
+#endif
+};
+
+// an io_uring beside the io service of one worker, used from its thread
+// only.  requests queued while handlers run are submitted together once
+// the worker is back in its loop, and completions are reaped in a batch
+// when the ring signals its eventfd through the io service.
+class UringService
+{
+public:
+    UringService(boost::asio::io_service &io_service);
+    ~UringService();
+
+    // fails where the kernel lacks io_uring, or forbids it.
+    void Open(unsigned entries, boost::system::error_code &ec);
+    // requests in flight are cancelled, each completes with its error.
+    void Close();
+
+    // a registered buffer skips pinning its pages on every read, -1 if
+    // the table is full or the kernel can not register buffers.
+    int RegisterBuffer(char *data, size_t size);
+    void UnregisterBuffer(int index);
+
+    // a buffer index of -1 reads into memory not registered.
+    void AsyncRecv(int fd, char *buffer, size_t size, int buffer_index, UringOp &op);
+    void AsyncSend(int fd, const char *buffer, size_t size, UringOp &op);
+    void AsyncSend(int fd, const SendDataSpan spans[], size_t count, UringOp &op);
+
+    // the kernel takes hold of descriptors on submission only, so pending
+    // requests are submitted before one is closed.
+    void Submit();
+
+private:
+    struct Ring;
+
+    void *GetSqe(UringOp &op);
+    void *NewSqe();
+    void CancelAll();
+    void Unlink(UringOp &op);
+    void PostSubmit();
+    void StartNextWait();
+    void OnRingEvent(const boost::system::error_code &ec);
+    void ReapCompletions();
+
+    boost::asio::io_service &io_service_;
+    std::unique_ptr<Ring> ring_;
+    unsigned pending_;
+    bool is_submit_posted_;
+    bool is_closing_;
+    UringOp *inflight_;
+
+    std::vector<int> free_buffers_;
+
+    uint64 event_value_;
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+    boost::asio::posix::stream_descriptor event_;
+#endif
+};
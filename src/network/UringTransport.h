@@ -0,0 +1,123 @@
+#pragma once
+
+#include "StreamTransport.h"
+#include "IOServiceManager.h"
+#include "UringService.h"
+
+// the socket calls of a stream transport go through the io_uring of the
+// worker instead of asio, connects and the rest stay with the transport.
+template <typename Transport>
+class UringTransport : public Transport
+{
+public:
+    UringTransport(Connection &connection, UringService &uring);
+    virtual ~UringTransport() {}
+
+    virtual void Close();
+
+protected:
+    virtual void AsyncRead(char *buffer, size_t size);
+    virtual void AsyncWrite(const SendDataSpan spans[], size_t count);
+
+private:
+    static void OnReadComplete(UringOp &op, int result);
+    static void OnWriteComplete(UringOp &op, int result);
+
+    UringService *uring_;
+    UringOp read_op_, write_op_;
+    bool is_buffer_tried_;
+    int buffer_index_;
+    const char *buffer_data_;
+    size_t buffer_size_;
+};
+
+template <typename Transport>
+UringTransport<Transport>::UringTransport(Connection &connection, UringService &uring)
+: Transport(connection)
+, uring_(&uring)
+, is_buffer_tried_(false)
+, buffer_index_(-1)
+, buffer_data_(nullptr)
+, buffer_size_(0)
+{
+    read_op_.complete = &UringTransport::OnReadComplete;
+    write_op_.complete = &UringTransport::OnWriteComplete;
+}
+
+template <typename Transport>
+void UringTransport<Transport>::Close()
+{
+    // the ring is gone with the manager, a connection may outlive it.
+    if (uring_ != nullptr && uring_ == sIOServiceManager.GetUringService(this->connection_.get_worker_index())) {
+        // submitted requests hold the socket, shutting it down ends them.
+        boost::system::error_code ec;
+        uring_->Submit();
+        this->sock_.shutdown(boost::asio::socket_base::shutdown_both, ec);
+        if (buffer_index_ != -1) {
+            uring_->UnregisterBuffer(buffer_index_);
+            buffer_index_ = -1;
+        }
+    }
+    uring_ = nullptr;
+    Transport::Close();
+}
+
+// the receive buffer of the pipes is registered on the first read, a
+// buffer outside of it is read as a plain one.
+template <typename Transport>
+void UringTransport<Transport>::AsyncRead(char *buffer, size_t size)
+{
+    if (!is_buffer_tried_) {
+        is_buffer_tried_ = true;
+        char *data = nullptr;
+        size_t region = 0;
+        if (this->connection_.recv_pipe_->GetRecvDataRegion(data, region)) {
+            buffer_index_ = uring_->RegisterBuffer(data, region);
+            buffer_data_ = data, buffer_size_ = region;
+        }
+    }
+    const bool is_registered = buffer_index_ != -1 &&
+        buffer >= buffer_data_ && buffer + size <= buffer_data_ + buffer_size_;
+
+    // completions are reaped later, a request refused holds no owner.
+    uring_->AsyncRecv(this->sock_.native_handle(), buffer, size,
+        is_registered ? buffer_index_ : -1, read_op_);
+    read_op_.owner = this->connection_.shared_from_this();
+}
+
+template <typename Transport>
+void UringTransport<Transport>::AsyncWrite(const SendDataSpan spans[], size_t count)
+{
+    if (count == 1) {
+        uring_->AsyncSend(this->sock_.native_handle(), spans[0].data, spans[0].size, write_op_);
+    } else {
+        uring_->AsyncSend(this->sock_.native_handle(), spans, count, write_op_);
+    }
+    write_op_.owner = this->connection_.shared_from_this();
+}
+
+template <typename Transport>
+void UringTransport<Transport>::OnReadComplete(UringOp &op, int result)
+{
+    std::shared_ptr<Connection> self = std::static_pointer_cast<Connection>(op.owner);
+    op.owner.reset();
+    boost::system::error_code ec;
+    if (result < 0) {
+        ec.assign(-result, boost::asio::error::get_system_category());
+    } else if (result == 0) {
+        ec = boost::asio::error::eof;
+    }
+    self->OnReadComplete(ec, op.buffer, std::max(result, 0));
+}
+
+template <typename Transport>
+void UringTransport<Transport>::OnWriteComplete(UringOp &op, int result)
+{
+    std::shared_ptr<Connection> self = std::static_pointer_cast<Connection>(op.owner);
+    op.owner.reset();
+    boost::system::error_code ec;
+    if (result < 0) {
+        ec.assign(-result, boost::asio::error::get_system_category());
+    }
+    self->OnWriteComplete(ec, op.buffer, std::max(result, 0));
+}
@@ -0,0 +1,276 @@
+#include "CipherStream.h"
+#include "Crypto.hpp"
+#include <openssl/rand.h>
+#include <string.h>
+
+namespace aead {
+
+static const size_t SECRET_SIZE = 32;
+static const size_t HELLO_NONCE_SIZE = 32;
+static const size_t X25519_KEY_SIZE = 32;
+
+static const EVP_CIPHER *GetCipher(CipherType type)
+{
+    switch (type) {
+    case AES_128_GCM: return EVP_aes_128_gcm();
+    case AES_256_GCM: return EVP_aes_256_gcm();
+    case CHACHA20_POLY1305: return EVP_chacha20_poly1305();
+    default: return nullptr;
+    }
+}
+
+static std::string RandomBytes(size_t size)
+{
+    std::string bytes(size, '\0');
+    if (RAND_bytes((unsigned char *)bytes.data(), size) != 1)
+        bytes.clear();
+    return bytes;
+}
+
+Cipher::Cipher()
+: ctx_(EVP_CIPHER_CTX_new())
+, sequence_(0)
+, is_encrypt_(true)
+{
+    memset(iv_, 0, sizeof(iv_));
+}
+
+Cipher::~Cipher()
+{
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+bool Cipher::Init(CipherType type, const std::string &key, const std::string &iv, bool is_encrypt)
+{
+    const EVP_CIPHER *cipher = GetCipher(type);
+    if (ctx_ == nullptr || cipher == nullptr || iv.size() != NONCE_SIZE ||
+        key.size() != size_t(EVP_CIPHER_key_length(cipher))) {
+        return false;
+    }
+    if (EVP_CipherInit_ex(ctx_, cipher, nullptr, nullptr, nullptr, is_encrypt) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_SET_IVLEN, NONCE_SIZE, nullptr) != 1 ||
+        EVP_CipherInit_ex(ctx_, nullptr, nullptr,
+            (const unsigned char *)key.data(), nullptr, is_encrypt) != 1) {
+        return false;
+    }
+    memcpy(iv_, iv.data(), NONCE_SIZE);
+    sequence_ = 0;
+    is_encrypt_ = is_encrypt;
+    return true;
+}
+
+// only the nonce changes per record, the key schedule is kept.
+bool Cipher::Begin(const void *aad, size_t aadlen)
+{
+    unsigned char nonce[NONCE_SIZE];
+    memcpy(nonce, iv_, NONCE_SIZE);
+    for (size_t i = 0; i < 8; ++i) {
+        nonce[NONCE_SIZE - 1 - i] ^= (unsigned char)(sequence_ >> (i * 8));
+    }
+    ++sequence_;
+    int outl = 0;
+    return EVP_CipherInit_ex(ctx_, nullptr, nullptr, nullptr, nonce, is_encrypt_) == 1 &&
+        EVP_CipherUpdate(ctx_, nullptr, &outl, (const unsigned char *)aad, aadlen) == 1;
+}
+
+bool Cipher::Update(const void *in, void *out, size_t len)
+{
+    int outl = 0;
+    return EVP_CipherUpdate(ctx_, (unsigned char *)out, &outl,
+        (const unsigned char *)in, len) == 1 && size_t(outl) == len;
+}
+
+bool Cipher::Seal(void *tag)
+{
+    unsigned char block[EVP_MAX_BLOCK_LENGTH];
+    int outl = 0;
+    return EVP_CipherFinal_ex(ctx_, block, &outl) == 1 && outl == 0 &&
+        EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_GET_TAG, TAG_SIZE, tag) == 1;
+}
+
+bool Cipher::Open(const void *tag)
+{
+    unsigned char block[EVP_MAX_BLOCK_LENGTH];
+    int outl = 0;
+    return EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, (void *)tag) == 1 &&
+        EVP_CipherFinal_ex(ctx_, block, &outl) == 1 && outl == 0;
+}
+
+Handshake::Handshake()
+: has_outgoing_(false)
+, is_done_(false)
+{
+}
+
+Handshake::~Handshake()
+{
+}
+
+std::string Handshake::TakeOutgoing()
+{
+    std::string message;
+    message.swap(outgoing_);
+    has_outgoing_.store(false, std::memory_order_release);
+    return message;
+}
+
+void Handshake::PushOutgoing(const std::string &message)
+{
+    outgoing_ = message;
+    has_outgoing_.store(true, std::memory_order_release);
+}
+
+bool Handshake::Derive(CipherType type, const std::string &secret, bool is_server)
+{
+    const EVP_CIPHER *cipher = GetCipher(type);
+    if (cipher == nullptr) {
+        return false;
+    }
+    // the cipher came in the clear, a peer told another one derives other keys.
+    auto derive = [&secret, type](const char *label, size_t size) {
+        const std::string material = secret + char(type) + label;
+        return sha::feed256(material.data(), material.size()).substr(0, size);
+    };
+    const size_t keylen = EVP_CIPHER_key_length(cipher);
+    const std::string c2s_key = derive("c2s key", keylen), c2s_iv = derive("c2s iv", NONCE_SIZE);
+    const std::string s2c_key = derive("s2c key", keylen), s2c_iv = derive("s2c iv", NONCE_SIZE);
+    if (!send_cipher_.Init(type, is_server ? s2c_key : c2s_key, is_server ? s2c_iv : c2s_iv, true) ||
+        !recv_cipher_.Init(type, is_server ? c2s_key : s2c_key, is_server ? c2s_iv : s2c_iv, false)) {
+        return false;
+    }
+    is_done_.store(true, std::memory_order_release);
+    return true;
+}
+
+RsaHandshake::RsaHandshake(RSA *rsa, CipherType type)
+: rsa_(rsa)
+, type_(type)
+, nonce_(RandomBytes(HELLO_NONCE_SIZE))
+{
+    PushOutgoing(std::string(1, char(type_)) + nonce_ + rsa::encode_pubkey(rsa_));
+}
+
+RsaHandshake::RsaHandshake(const std::string &pubkey)
+: rsa_(nullptr)
+, pubkey_(pubkey)
+, type_(AES_128_GCM)
+{
+}
+
+bool RsaHandshake::Feed(const void *data, size_t size)
+{
+    if (IsDone()) {
+        return false;
+    }
+    return rsa_ != nullptr ? FeedSecret(data, size) : FeedHello(data, size);
+}
+
+// the server nonce keeps a replayed client secret from reusing old keys.
+bool RsaHandshake::FeedHello(const void *data, size_t size)
+{
+    if (size <= 1 + HELLO_NONCE_SIZE) {
+        return false;
+    }
+    const char *hello = (const char *)data;
+    const std::string pubkey(hello + 1 + HELLO_NONCE_SIZE, size - 1 - HELLO_NONCE_SIZE);
+    if (pubkey_.empty() || pubkey != pubkey_) {
+        return false;
+    }
+    type_ = CipherType((unsigned char)hello[0]);
+    nonce_.assign(hello + 1, HELLO_NONCE_SIZE);
+    const std::string secret = RandomBytes(SECRET_SIZE);
+    if (secret.empty() || GetCipher(type_) == nullptr) {
+        return false;
+    }
+    const std::string message = rsa::public_encrypt(pubkey, secret.data(), secret.size());
+    if (message.empty()) {
+        return false;
+    }
+    PushOutgoing(message);
+    return Derive(type_, secret + nonce_, false);
+}
+
+bool RsaHandshake::FeedSecret(const void *data, size_t size)
+{
+    if (nonce_.size() != HELLO_NONCE_SIZE) {
+        return false;
+    }
+    const std::string secret = rsa::private_decrypt(rsa_, data, size);
+    if (secret.size() != SECRET_SIZE) {
+        return false;
+    }
+    return Derive(type_, secret + nonce_, true);
+}
+
+EcdhHandshake::EcdhHandshake(EVP_PKEY *key, CipherType type)
+: key_(key)
+, is_server_(true)
+, type_(type)
+, nonce_(RandomBytes(HELLO_NONCE_SIZE))
+{
+    if (key_ != nullptr) {
+        PushOutgoing(std::string(1, char(type_)) + nonce_ + x25519::encode_pubkey(key_));
+    }
+}
+
+EcdhHandshake::EcdhHandshake(const std::string &pubkey)
+: key_(nullptr)
+, is_server_(false)
+, pubkey_(pubkey)
+, type_(AES_128_GCM)
+{
+}
+
+EcdhHandshake::~EcdhHandshake()
+{
+    if (!is_server_) {
+        x25519::free_key(key_);
+    }
+}
+
+bool EcdhHandshake::Feed(const void *data, size_t size)
+{
+    if (IsDone()) {
+        return false;
+    }
+    return is_server_ ? FeedPubkey(data, size) : FeedHello(data, size);
+}
+
+bool EcdhHandshake::FeedHello(const void *data, size_t size)
+{
+    if (size != 1 + HELLO_NONCE_SIZE + X25519_KEY_SIZE) {
+        return false;
+    }
+    const char *hello = (const char *)data;
+    const std::string pubkey(hello + 1 + HELLO_NONCE_SIZE, X25519_KEY_SIZE);
+    if (pubkey_.empty() || pubkey != pubkey_) {
+        return false;
+    }
+    type_ = CipherType((unsigned char)hello[0]);
+    nonce_.assign(hello + 1, HELLO_NONCE_SIZE);
+    if (GetCipher(type_) == nullptr || (key_ = x25519::generate_key()) == nullptr) {
+        return false;
+    }
+    const std::string shared = x25519::derive(key_, pubkey);
+    const std::string message = x25519::encode_pubkey(key_);
+    if (shared.empty() || message.size() != X25519_KEY_SIZE) {
+        return false;
+    }
+    PushOutgoing(message);
+    return Derive(type_, shared + nonce_ + message, false);
+}
+
+bool EcdhHandshake::FeedPubkey(const void *data, size_t size)
+{
+    if (key_ == nullptr || size != X25519_KEY_SIZE) {
+        return false;
+    }
+    const std::string pubkey((const char *)data, size);
+    const std::string shared = x25519::derive(key_, pubkey);
+    if (shared.empty()) {
+        return false;
+    }
+    return Derive(type_, shared + nonce_ + pubkey, true);
+}
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace aead {
+
+enum CipherType {
+    AES_128_GCM,
+    AES_256_GCM,
+    CHACHA20_POLY1305,
+};
+
+static const size_t TAG_SIZE = 16;
+static const size_t NONCE_SIZE = 12;
+
+// one direction of a record stream, the nonce is iv ^ record sequence.
+class Cipher
+{
+public:
+    Cipher();
+    ~Cipher();
+
+    bool Init(CipherType type, const std::string &key, const std::string &iv, bool is_encrypt);
+
+    bool Begin(const void *aad, size_t aadlen);
+    bool Update(const void *in, void *out, size_t len);
+    bool Seal(void *tag);
+    bool Open(const void *tag);
+
+private:
+    EVP_CIPHER_CTX *ctx_;
+    unsigned char iv_[NONCE_SIZE];
+    uint64_t sequence_;
+    bool is_encrypt_;
+};
+
+// keys both directions of one connection, shared by its send and recv pipes.
+// messages are produced and consumed on the io thread only.
+class Handshake
+{
+public:
+    Handshake();
+    virtual ~Handshake();
+
+    virtual bool Feed(const void *data, size_t size) = 0;
+
+    bool IsDone() const { return is_done_.load(std::memory_order_acquire); }
+    bool HasOutgoing() const { return has_outgoing_.load(std::memory_order_acquire); }
+    std::string TakeOutgoing();
+
+    Cipher &GetSendCipher() { return send_cipher_; }
+    Cipher &GetRecvCipher() { return recv_cipher_; }
+
+protected:
+    void PushOutgoing(const std::string &message);
+    bool Derive(CipherType type, const std::string &secret, bool is_server);
+
+private:
+    Cipher send_cipher_, recv_cipher_;
+    std::string outgoing_;
+    std::atomic<bool> has_outgoing_;
+    std::atomic<bool> is_done_;
+};
+
+// server hello is [cipher:1][nonce:32][pubkey], the client answers with
+// a random secret encrypted by that pubkey.
+class RsaHandshake : public Handshake
+{
+public:
+    // server side, rsa is shared by every connection and not owned.
+    RsaHandshake(RSA *rsa, CipherType type);
+    // client side, pubkey pins the server key, without one every hello
+    // is refused, as nothing would tell the server from a man in the middle.
+    explicit RsaHandshake(const std::string &pubkey);
+
+    virtual bool Feed(const void *data, size_t size);
+
+private:
+    bool FeedHello(const void *data, size_t size);
+    bool FeedSecret(const void *data, size_t size);
+
+    RSA * const rsa_;
+    const std::string pubkey_;
+    CipherType type_;
+    std::string nonce_;
+};
+
+// server hello is [cipher:1][nonce:32][pubkey:32], the client answers with
+// its ephemeral pubkey.  the server pays one x25519 multiplication instead
+// of an rsa private decryption.
+class EcdhHandshake : public Handshake
+{
+public:
+    // server side, key is shared by every connection and not owned, it must
+    // be long lived, so that clients can pin its pubkey.
+    EcdhHandshake(EVP_PKEY *key, CipherType type);
+    // client side, pubkey pins the server key, without one every hello
+    // is refused, as nothing would tell the server from a man in the middle.
+    explicit EcdhHandshake(const std::string &pubkey);
+    virtual ~EcdhHandshake();
+
+    virtual bool Feed(const void *data, size_t size);
+
+private:
+    bool FeedHello(const void *data, size_t size);
+    bool FeedPubkey(const void *data, size_t size);
+
+    EVP_PKEY *key_;
+    const bool is_server_;
+    const std::string pubkey_;
+    CipherType type_;
+    std::string nonce_;
+};
+
+}
@@ -54,6 +54,61 @@ std::string private_decrypt(RSA *rsa, const void *data, size_t len)
 
 }
 
+namespace x25519 {
+
+EVP_PKEY *generate_key()
+{
+    EVP_PKEY *key = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr);
+    if (ctx != nullptr) {
+        if (EVP_PKEY_keygen_init(ctx) != 1 || EVP_PKEY_keygen(ctx, &key) != 1)
+            key = nullptr;
+        EVP_PKEY_CTX_free(ctx);
+    }
+    return key;
+}
+
+void free_key(EVP_PKEY *key)
+{
+    if (key != nullptr)
+        EVP_PKEY_free(key);
+}
+
+std::string encode_pubkey(EVP_PKEY *key)
+{
+    std::string pubkey(32, '\0');
+    size_t len = pubkey.size();
+    if (EVP_PKEY_get_raw_public_key(key, (unsigned char *)pubkey.data(), &len) != 1)
+        len = 0;
+    pubkey.resize(len);
+    return pubkey;
+}
+
+std::string derive(EVP_PKEY *key, const std::string &pubkey)
+{
+    std::string secret;
+    EVP_PKEY *peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr,
+        (const unsigned char *)pubkey.data(), pubkey.size());
+    EVP_PKEY_CTX *ctx = peer != nullptr ? EVP_PKEY_CTX_new(key, nullptr) : nullptr;
+    if (ctx != nullptr) {
+        size_t len = 0;
+        if (EVP_PKEY_derive_init(ctx) == 1 && EVP_PKEY_derive_set_peer(ctx, peer) == 1 &&
+            EVP_PKEY_derive(ctx, nullptr, &len) == 1) {
+            secret.resize(len);
+            if (EVP_PKEY_derive(ctx, (unsigned char *)secret.data(), &len) == 1)
+                secret.resize(len);
+            else
+                secret.clear();
+        }
+        EVP_PKEY_CTX_free(ctx);
+    }
+    if (peer != nullptr)
+        EVP_PKEY_free(peer);
+    return secret;
+}
+
+}
+
 namespace hex {
 
 std::string dump(const void *data, size_t len)
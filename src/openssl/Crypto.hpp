@@ -1,5 +1,6 @@
 #pragma once
 
+#include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <string>
 
@@ -15,6 +16,17 @@ std::string private_decrypt(RSA *rsa, const void *data, size_t len);
 
 }
 
+namespace x25519 {
+
+EVP_PKEY *generate_key();
+void free_key(EVP_PKEY *key);
+
+std::string encode_pubkey(EVP_PKEY *key);
+
+std::string derive(EVP_PKEY *key, const std::string &pubkey);
+
+}
+
 namespace hex {
 
 std::string dump(const void *data, size_t len);
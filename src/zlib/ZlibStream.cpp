@@ -85,7 +85,7 @@ bool InflateStream::Inflate(const void *in, size_t &inlen, void *out, size_t &ou
     stream_.next_out = (Bytef*)out;
     stream_.avail_out = outlen;
     int ret = inflate(&stream_, Z_SYNC_FLUSH);
-    if (ret != Z_OK) {
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
         WLOG("inflate(Z_SYNC_FLUSH) Has Error %d.", ret);
         return false;
     }
@@ -0,0 +1,116 @@
+import os
+import struct
+import heapq
+from collections import defaultdict
+
+# capture files hold plain wire packets: [len:2][opcode:2][payload],
+# len counts the 4 header bytes, both fields little-endian.
+PACKET_HEADER_SIZE = 4
+MAX_DICTIONARY_SIZE = 64 * 1024
+
+
+def read_packets(filepath):
+    data = open(filepath, 'rb').read()
+    pos = 0
+    while pos + PACKET_HEADER_SIZE <= len(data):
+        size, opcode = struct.unpack_from('<HH', data, pos)
+        if size < PACKET_HEADER_SIZE or pos + size > len(data):
+            raise ValueError('%s: broken packet at offset %d' % (filepath, pos))
+        yield opcode, data[pos:pos + size]
+        pos += size
+
+
+def collect_samples(paths):
+    groups = defaultdict(list)
+    for path in paths:
+        if os.path.isdir(path):
+            for entry in sorted(os.listdir(path)):
+                entrypath = os.path.join(path, entry)
+                if os.path.isfile(entrypath):
+                    for opcode, packet in read_packets(entrypath):
+                        groups[opcode].append(packet)
+        else:
+            for opcode, packet in read_packets(path):
+                groups[opcode].append(packet)
+    return groups
+
+
+def count_kmers(packets, kmer):
+    # counted once per packet, so a byte run repeated inside one
+    # packet is not mistaken for one shared by many packets.
+    freq = defaultdict(int)
+    for packet in packets:
+        for key in set(packet[i:i + kmer] for i in range(len(packet) - kmer + 1)):
+            freq[key] += 1
+    return freq
+
+
+def segment_score(segment, freq, kmer):
+    keys = set(segment[i:i + kmer] for i in range(len(segment) - kmer + 1))
+    return sum(freq.get(key, 0) for key in keys)
+
+
+def select_segments(packets, budget, kmer, segment):
+    freq = count_kmers(packets, kmer)
+    heap = []
+    step = max(segment // 4, 1)
+    for packet in packets:
+        for pos in range(0, max(len(packet) - segment, 0) + 1, step):
+            candidate = packet[pos:pos + segment]
+            score = segment_score(candidate, freq, kmer)
+            if score > len(candidate):
+                heap.append((-score, candidate))
+    heapq.heapify(heap)
+
+    selected, used, seen = [], 0, set()
+    while heap and used < budget:
+        score, candidate = heapq.heappop(heap)
+        rescore = segment_score(candidate, freq, kmer)
+        if rescore != -score:
+            if rescore > len(candidate):
+                heapq.heappush(heap, (-rescore, candidate))
+            continue
+        if candidate in seen:
+            continue
+        seen.add(candidate)
+        selected.append((rescore, candidate))
+        used += len(candidate)
+        for i in range(len(candidate) - kmer + 1):
+            freq.pop(candidate[i:i + kmer], None)
+    return selected
+
+
+def train_dictionary(inputs, output, dict_size=16 * 1024, kmer=6,
+                     segment=64, max_samples=4000):
+    dict_size = min(dict_size, MAX_DICTIONARY_SIZE)
+    groups = collect_samples(inputs)
+    total = sum(len(p) for packets in groups.values() for p in packets)
+    if total == 0:
+        raise ValueError('no packet samples')
+
+    selected = []
+    for opcode, packets in sorted(groups.items()):
+        weight = sum(len(p) for p in packets)
+        budget = dict_size * weight // total
+        if budget < segment or len(packets) < 2:
+            continue
+        packets = packets[-max_samples:]
+        selected.extend(select_segments(packets, budget, kmer, segment))
+
+    # the best segments go last, they stay closest to the live data.
+    selected.sort(key=lambda item: item[0])
+    content = b''.join(candidate for score, candidate in selected)
+    content = content[-dict_size:]
+    open(output, 'wb').write(content)
+    return len(content)
+
+
+if __name__ == '__main__':
+    import argparse
+    parser = argparse.ArgumentParser(description='train a lz4 dictionary from packet captures.')
+    parser.add_argument('inputs', nargs='+', help='capture files or directories')
+    parser.add_argument('-o', '--output', default='lz4.dict')
+    parser.add_argument('-s', '--size', type=int, default=16 * 1024)
+    args = parser.parse_args()
+    size = train_dictionary(args.inputs, args.output, args.size)
+    print('%s: %d bytes' % (args.output, size))